@@ -0,0 +1,141 @@
+#include "BatchCalibration.hpp"
+#include "Profiler.hpp"
+
+#include <QtConcurrentMap>
+#include <QTime>
+#include <boost/bind.hpp>
+#include <stdexcept>
+
+using namespace qcam_calib;
+
+BatchResult::BatchResult():
+    camera_id(-1),
+    images(0),
+    chessboards(0),
+    detection_time(0),
+    solve_time(0)
+{
+}
+
+BatchResult BatchCalibration::calibrateCamera(const DatasetPtr &dataset,int camera_id,int cols,int rows,float dx,float dy,
+                                              CalibrationProgress *progress,
+                                              const OutlierRejection &rejection,int max_views)
+{
+    BatchResult result;
+    result.camera_id = camera_id;
+    try
+    {
+        CameraDataPtr camera = dataset->getCamera(camera_id);
+        result.camera_name = camera->name;
+        Profiler::setCurrentItem(QString::fromStdString(camera->name));
+        result.images = camera->images.size();
+
+        //find missing chessboards
+        QTime timer;
+        timer.start();
+        std::map<int,ImageDataPtr>::const_iterator iter = camera->images.begin();
+        for(;iter != camera->images.end();++iter)
+        {
+            if(iter->second->detected)
+                continue;
+            if(progress && !progress->step(0,0,timer.elapsed()*0.001))
+                throw std::runtime_error("canceled");
+            Profiler::setCurrentItem(QString::fromStdString(iter->second->name));
+            QVector<QPointF> corners = ImageItem::findChessboard(ImageItem::getImage(*iter->second),cols,rows,camera->detector);
+            dataset->setChessboard(camera_id,iter->first,convertFromQt(corners),cv::Size(cols,rows));
+        }
+        result.detection_time = timer.elapsed()*0.001;
+
+        //solve
+        Profiler::setCurrentItem(QString::fromStdString(camera->name));
+        timer.restart();
+        camera = dataset->getCamera(camera_id);
+        result.chessboards = camera->countChessboards();
+        if(result.chessboards < MIN_CALIBRATION_CHESSBOARDS)
+            throw std::runtime_error(QString("not enough chessboards for calibration, at least %1 are needed")
+                                     .arg(MIN_CALIBRATION_CHESSBOARDS).toStdString());
+        result.calibration = qcam_calib::calibrateCamera(createCalibrationData(*camera,cols,rows,dx,dy,max_views),rejection,progress,
+                                                         camera->calibration.get(),camera->solver);
+        result.solve_time = timer.elapsed()*0.001;
+        if(result.calibration.canceled)
+            throw std::runtime_error("canceled");
+        dataset->setCalibration(camera_id,result.calibration);
+    }
+    catch(const std::exception &e)
+    {
+        result.error = e.what();
+    }
+    return result;
+}
+
+BatchCalibration::BatchCalibration(QObject *parent):
+    QObject(parent),
+    max_views(0),
+    canceled(0),
+    watcher(NULL)
+{
+    watcher = new QFutureWatcher<BatchResult>(this);
+    connect(watcher,SIGNAL(resultReadyAt(int)),SLOT(resultReady(int)));
+    connect(watcher,SIGNAL(progressRangeChanged(int,int)),SIGNAL(progressRangeChanged(int,int)));
+    connect(watcher,SIGNAL(progressValueChanged(int)),SIGNAL(progressValueChanged(int)));
+    connect(watcher,SIGNAL(finished()),SIGNAL(finished()));
+}
+
+BatchCalibration::~BatchCalibration()
+{
+    cancel();
+    watcher->waitForFinished();
+}
+
+BatchResult BatchCalibration::run(const DatasetPtr &dataset,int camera_id,int cols,int rows,float dx,float dy)
+{
+    return calibrateCamera(dataset,camera_id,cols,rows,dx,dy,this,rejection,max_views);
+}
+
+void BatchCalibration::start(const DatasetPtr &dataset,const QList<int> &camera_ids,int cols,int rows,float dx,float dy)
+{
+    if(isRunning())
+        throw std::runtime_error("BatchCalibration: batch is already running");
+    canceled = 0;
+    watcher->setFuture(QtConcurrent::mapped(camera_ids,boost::bind(&BatchCalibration::run,this,dataset,_1,cols,rows,dx,dy)));
+}
+
+bool BatchCalibration::isRunning()const
+{
+    return watcher->isRunning();
+}
+
+void BatchCalibration::setOutlierRejection(const OutlierRejection &rejection)
+{
+    if(isRunning())
+        throw std::runtime_error("BatchCalibration: cannot change the outlier rejection while running");
+    this->rejection = rejection;
+}
+
+void BatchCalibration::setMaxViews(int max_views)
+{
+    if(isRunning())
+        throw std::runtime_error("BatchCalibration: cannot change the number of views while running");
+    this->max_views = max_views;
+}
+
+QList<BatchResult> BatchCalibration::getResults()const
+{
+    return watcher->future().results();
+}
+
+bool BatchCalibration::step(int iteration,double error,double elapsed)
+{
+    return canceled == 0;
+}
+
+void BatchCalibration::cancel()
+{
+    canceled = 1;
+    watcher->cancel();
+}
+
+void BatchCalibration::resultReady(int index)
+{
+    emit cameraFinished(watcher->resultAt(index).camera_id);
+}
@@ -0,0 +1,98 @@
+#ifndef QCAMCALIB_BATCH_CALIBRATION_HPP
+#define QCAMCALIB_BATCH_CALIBRATION_HPP
+
+#include <QObject>
+#include <QList>
+#include <QFutureWatcher>
+#include <QAtomicInt>
+#include <string>
+
+#include "Calibration.hpp"
+#include "Dataset.hpp"
+#include "Items.hpp"
+
+namespace qcam_calib
+{
+    /**
+     * \brief Outcome of calibrating one camera in a batch
+     */
+    struct BatchResult
+    {
+        BatchResult();
+
+        int camera_id;
+        std::string camera_name;
+        int images;
+        int chessboards;
+        double detection_time;          // seconds
+        double solve_time;              // seconds
+        CalibrationResult calibration;
+        std::string error;              // empty on success
+    };
+
+    /**
+     * \brief Calibrates several cameras in parallel
+     *
+     * Each camera is a separate task on the global thread pool. A task first
+     * searches chessboards in all images of the camera which were not searched
+     * yet and then solves the calibration, so detection of one camera overlaps
+     * with solving another one. Results are stored in the Dataset.
+     */
+    class BatchCalibration : public QObject, public CalibrationProgress
+    {
+        Q_OBJECT
+        public:
+            /**
+             * \brief Detects the missing chessboards of a camera and calibrates it
+             *
+             * Chessboards are searched with the detector settings of the camera.
+             * This function is thread safe and can be used without a BatchCalibration object.
+             */
+            static BatchResult calibrateCamera(const DatasetPtr &dataset,int camera_id,int cols,int rows,float dx,float dy,
+                                               CalibrationProgress *progress = NULL,
+                                               const OutlierRejection &rejection = OutlierRejection(),int max_views = 0);
+
+            BatchCalibration(QObject *parent = 0);
+            virtual ~BatchCalibration();
+
+            void start(const DatasetPtr &dataset,const QList<int> &camera_ids,int cols,int rows,float dx,float dy);
+            bool isRunning()const;
+            QList<BatchResult> getResults()const;
+
+            /**
+             * \brief Sets the outlier view rejection used by the next batch (disabled by default)
+             */
+            void setOutlierRejection(const OutlierRejection &rejection);
+
+            /**
+             * \brief Limits the number of views per camera used by the next batch, 0 uses all views
+             */
+            void setMaxViews(int max_views);
+
+            // CalibrationProgress interface, called from the worker threads
+            virtual bool step(int iteration,double error,double elapsed);
+
+        public slots:
+            void cancel();
+
+        signals:
+            void cameraFinished(int camera_id);
+            void progressRangeChanged(int minimum,int maximum);
+            void progressValueChanged(int value);
+            void finished();
+
+        private slots:
+            void resultReady(int index);
+
+        private:
+            BatchResult run(const DatasetPtr &dataset,int camera_id,int cols,int rows,float dx,float dy);
+
+        private:
+            OutlierRejection rejection;
+            int max_views;
+            QAtomicInt canceled;
+            QFutureWatcher<BatchResult> *watcher;
+    };
+}
+
+#endif
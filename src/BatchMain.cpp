@@ -0,0 +1,284 @@
+#include <QCoreApplication>
+#include <QStringList>
+#include <QDir>
+#include <QFileInfo>
+#include <QImage>
+#include <QFile>
+#include <QTime>
+#include <QThreadPool>
+#include <QtConcurrentMap>
+
+#include <iostream>
+#include <stdexcept>
+#include <boost/bind.hpp>
+
+#include "Items.hpp"
+#include "Dataset.hpp"
+#include "Calibration.hpp"
+#include "CornerCache.hpp"
+
+using namespace qcam_calib;
+
+struct DetectionResult
+{
+    QString path;
+    QSize size;
+    QVector<QPointF> chessboard;
+    double decode_time;
+    double detection_time;
+    bool cached;
+};
+
+DetectionResult detect(const QString &path,int cols,int rows,const DetectorSettings &detector,bool use_cache)
+{
+    DetectionResult result;
+    result.path = path;
+    result.decode_time = 0;
+    result.detection_time = 0;
+    result.cached = false;
+
+    QTime timer;
+    timer.start();
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+        return result;
+    QByteArray content = file.readAll();
+    file.close();
+
+    QString key;
+    if(use_cache)
+    {
+        key = CornerCache::createKey(content,cols,rows,detector);
+        result.cached = CornerCache::load(path,key,result.size,result.chessboard);
+        if(result.cached)
+        {
+            result.detection_time = timer.elapsed()*0.001;
+            return result;
+        }
+    }
+
+    QImage image = QImage::fromData(content);
+    result.decode_time = timer.elapsed()*0.001;
+    result.size = image.size();
+    timer.restart();
+    if(!image.isNull())
+    {
+        result.chessboard = ImageItem::findChessboard(image,cols,rows,detector);
+        if(use_cache)
+            CornerCache::store(path,key,result.size,result.chessboard);
+    }
+    result.detection_time = timer.elapsed()*0.001;
+    return result;
+}
+
+// expands wildcards in the file name part of the given patterns
+QStringList expandGlobs(const QStringList &patterns)
+{
+    QStringList paths;
+    QStringList::const_iterator iter = patterns.begin();
+    for(;iter != patterns.end();++iter)
+    {
+        QFileInfo info(*iter);
+        if(!iter->contains('*') && !iter->contains('?') && !iter->contains('['))
+        {
+            paths << *iter;
+            continue;
+        }
+        QDir dir = info.dir();
+        QStringList files = dir.entryList(QStringList() << info.fileName(),QDir::Files,QDir::Name);
+        QStringList::const_iterator file = files.begin();
+        for(;file != files.end();++file)
+            paths << dir.filePath(*file);
+    }
+    return paths;
+}
+
+void usage()
+{
+    std::cerr << "usage: QCameraCalibBatch [options] --output <parameter.yml> <images or globs>...\n"
+              << "options:\n"
+              << "  --cols <n>        inner corners per chessboard row (default 9)\n"
+              << "  --rows <n>        inner corners per chessboard column (default 6)\n"
+              << "  --dx <mm>         width of a chessboard cell (default 35)\n"
+              << "  --dy <mm>         height of a chessboard cell (default 35)\n"
+              << "  --pyramid         search chessboards on a downscaled image first\n"
+              << "  --sector-based    search chessboards with findChessboardCornersSB (OpenCV 4)\n"
+              << "  --flags <n>       cv::CALIB_CB_* flags of the chessboard detector\n"
+              << "  --no-cache        do not use the detection cache in .qcam_calib next to the images\n"
+              << "  --reject-outliers <k>  iteratively drop views with an error above median + k * MAD\n"
+              << "  --max-views <n>   calibrate with at most n views selected for coverage and pose diversity\n"
+              << "  --distortion <m>  distortion model: radial_tangential (default), rational, thin_prism or fisheye\n"
+              << "  --sparse          solve with the sparse Schur complement solver instead of cv::calibrateCamera\n"
+              << "  --threads <n>     number of worker threads (default: number of cores)\n";
+}
+
+int main( int argc, char* argv[] )
+{
+    QCoreApplication app(argc, argv);
+
+    int cols = 9;
+    int rows = 6;
+    float dx = 35;
+    float dy = 35;
+    DetectorSettings detector;
+    int detector_flags = -1;
+    bool use_cache = true;
+    OutlierRejection rejection;
+    int max_views = 0;
+    CalibrationSolver solver = SOLVER_DENSE;
+    DistortionModel distortion = DISTORTION_RADIAL_TANGENTIAL;
+    QString output;
+    QStringList patterns;
+
+    QStringList args = app.arguments();
+    for(int i=1;i<args.size();++i)
+    {
+        const QString &arg = args[i];
+        const bool has_value = i+1 < args.size();
+        if(arg == "--cols" && has_value)
+            cols = args[++i].toInt();
+        else if(arg == "--rows" && has_value)
+            rows = args[++i].toInt();
+        else if(arg == "--dx" && has_value)
+            dx = args[++i].toFloat();
+        else if(arg == "--dy" && has_value)
+            dy = args[++i].toFloat();
+        else if(arg == "--output" && has_value)
+            output = args[++i];
+        else if(arg == "--threads" && has_value)
+            QThreadPool::globalInstance()->setMaxThreadCount(args[++i].toInt());
+        else if(arg == "--pyramid")
+            detector.mode = DETECTION_PYRAMID;
+        else if(arg == "--sector-based")
+        {
+            detector.engine = DETECTOR_SECTOR_BASED;
+            detector.flags = DetectorSettings::getDefaultFlags(DETECTOR_SECTOR_BASED);
+        }
+        else if(arg == "--flags" && has_value)
+            detector_flags = args[++i].toInt();
+        else if(arg == "--no-cache")
+            use_cache = false;
+        else if(arg == "--max-views" && has_value)
+            max_views = args[++i].toInt();
+        else if(arg == "--sparse")
+            solver = SOLVER_SPARSE;
+        else if(arg == "--distortion" && has_value)
+        {
+            if(!findDistortionModel(args[++i].toStdString(),distortion))
+            {
+                std::cerr << "unknown distortion model " << args[i].toStdString() << std::endl;
+                usage();
+                return 1;
+            }
+        }
+        else if(arg == "--reject-outliers" && has_value)
+        {
+            rejection.enabled = true;
+            rejection.threshold = args[++i].toDouble();
+        }
+        else if(arg == "--help" || arg == "-h")
+        {
+            usage();
+            return 0;
+        }
+        else if(arg.startsWith("--"))
+        {
+            std::cerr << "unknown or incomplete option " << arg.toStdString() << std::endl;
+            usage();
+            return 1;
+        }
+        else
+            patterns << arg;
+    }
+    if(output.isEmpty() || patterns.empty() || cols < 2 || rows < 2)
+    {
+        usage();
+        return 1;
+    }
+
+    if(detector_flags >= 0)
+        detector.flags = detector_flags;
+    if(!ChessboardDetector::isAvailable(detector.engine))
+    {
+        std::cerr << "the selected chessboard detector requires OpenCV 4" << std::endl;
+        return 1;
+    }
+
+    QStringList paths = expandGlobs(patterns);
+    if(paths.empty())
+    {
+        std::cerr << "no images found" << std::endl;
+        return 1;
+    }
+
+    //load images and find chessboards in parallel
+    QTime timer;
+    timer.start();
+    QList<DetectionResult> results = QtConcurrent::blockingMapped<QList<DetectionResult> >(paths,boost::bind(detect,_1,cols,rows,detector,use_cache));
+    const double detection_wall_time = timer.elapsed()*0.001;
+
+    DatasetPtr dataset(new Dataset);
+    dataset->addCamera(0,"camera_0");
+    dataset->setDetector(0,detector);
+    dataset->setSolver(0,solver);
+    dataset->setDistortionModel(0,distortion);
+    double decode_time = 0;
+    double detection_time = 0;
+    int chessboards = 0;
+    int cached = 0;
+    QList<DetectionResult>::const_iterator iter = results.begin();
+    for(;iter != results.end();++iter)
+    {
+        decode_time += iter->decode_time;
+        detection_time += iter->detection_time;
+        if(!iter->size.isValid())
+        {
+            std::cerr << "cannot load image " << iter->path.toStdString() << std::endl;
+            continue;
+        }
+        ImageData data;
+        data.name = QFileInfo(iter->path).fileName().toStdString();
+        data.path = iter->path.toStdString();
+        data.size = cv::Size(iter->size.width(),iter->size.height());
+        ImageDataPtr image = dataset->addImage(0,data);
+        dataset->setChessboard(0,image->id,convertFromQt(iter->chessboard),cv::Size(cols,rows));
+        if(!iter->chessboard.empty())
+            ++chessboards;
+        if(iter->cached)
+            ++cached;
+    }
+
+    std::cout << "images:            " << paths.size() << "\n"
+              << "chessboards:       " << chessboards << "\n"
+              << "cache hits:        " << cached << "\n"
+              << "threads:           " << QThreadPool::globalInstance()->maxThreadCount() << "\n"
+              << "detection [s]:     " << detection_wall_time << " (decode " << decode_time
+              << " s, search " << detection_time << " s summed over all threads)\n"
+              << "throughput [1/s]:  " << (detection_wall_time > 0 ? paths.size()/detection_wall_time : 0) << std::endl;
+
+    try
+    {
+        timer.restart();
+        CalibrationResult result = calibrateCamera(createCalibrationData(*dataset->getCamera(0),cols,rows,dx,dy,max_views),rejection,NULL,NULL,solver);
+        const double solve_time = timer.elapsed()*0.001;
+        saveCalibration(output.toStdString(),result);
+
+        std::cout << "solve [s]:         " << solve_time << " (" << result.iterations << " iterations)\n"
+                  << "rms error [px]:    " << result.error << "\n"
+                  << "views:             " << result.image_ids.size() << "\n"
+                  << "rejected views:    " << result.rejected_ids.size() << "\n"
+                  << "camera matrix:     " << result.camera_matrix.reshape(1,1) << "\n"
+                  << "distortion model:  " << getDistortionModelName(result.distortion) << "\n"
+                  << "dist coeffs:       " << result.dist_coeffs.reshape(1,1) << "\n"
+                  << "saved to           " << output.toStdString() << std::endl;
+        for(size_t i=0;i < result.rejected_ids.size();++i)
+            std::cout << "rejected:          " << dataset->getImage(0,result.rejected_ids[i])->name
+                      << " (" << result.rejected_errors[i] << " px)" << std::endl;
+    }
+    catch(const std::exception &e)
+    {
+        std::cerr << "calibration failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,543 @@
+#include <QCoreApplication>
+#include <QStringList>
+#include <QImage>
+#include <QBuffer>
+#include <QFile>
+#include <QElapsedTimer>
+#include <QStandardItemModel>
+#include <QPainter>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cmath>
+
+#include "Items.hpp"
+#include "ImageView.hpp"
+#include "Dataset.hpp"
+#include "Calibration.hpp"
+#include "ImageBuffer.hpp"
+
+using namespace qcam_calib;
+
+/**
+ * Benchmark of the detection and calibration hot paths on synthetic data.
+ *
+ * For each resolution and distortion level a set of chessboard images is
+ * rendered with random board poses and encoded as JPG. Afterwards each stage
+ * is timed separately and its latency percentiles, throughput and the peak
+ * memory of the process are printed as one JSON object per line.
+ */
+
+struct Config
+{
+    cv::Size size;
+    double k1;
+};
+
+struct Frame
+{
+    QByteArray jpg;
+    std::vector<cv::Point2f> corners;   // ground truth
+};
+
+// corners of the large dataset used to check the interactive budget of the residual heatmap
+static const int LARGE_DATASET_CORNERS = 200000;
+static const double INTERACTIVE_BUDGET_MS = 50;
+
+// accepts every step, it makes the dense solver report its progress in steps
+class StepCounter : public CalibrationProgress
+{
+    public:
+        StepCounter():steps(0){};
+
+        bool step(int iteration,double error,double elapsed)
+        {
+            ++steps;
+            return true;
+        }
+
+        int steps;
+};
+
+// returns the peak resident set size of the process in kbytes
+long peakMemory()
+{
+    QFile file("/proc/self/status");
+    if(!file.open(QIODevice::ReadOnly))
+        return -1;
+    QList<QByteArray> lines = file.readAll().split('\n');
+    QList<QByteArray>::const_iterator iter = lines.begin();
+    for(;iter != lines.end();++iter)
+    {
+        if(iter->startsWith("VmHWM:"))
+            return iter->mid(6).trimmed().split(' ').front().toLong();
+    }
+    return -1;
+}
+
+class Stage
+{
+    public:
+        Stage(const std::string &name):name(name){};
+
+        void start()
+        {
+            timer.start();
+        }
+
+        void stop()
+        {
+            samples.push_back(timer.nsecsElapsed()*1e-6);
+        }
+
+        double percentile(double p)const
+        {
+            if(samples.empty())
+                return 0;
+            // nearest rank
+            std::vector<double> sorted(samples);
+            std::sort(sorted.begin(),sorted.end());
+            size_t rank = size_t(std::ceil(p*sorted.size()));
+            return sorted[std::min(sorted.size(),std::max(rank,size_t(1)))-1];
+        }
+
+        std::string toJson(const Config &config,const std::string &extra = std::string())const
+        {
+            double sum = 0;
+            for(size_t i=0;i<samples.size();++i)
+                sum += samples[i];
+            std::stringstream strstr;
+            strstr << "{\"stage\":\"" << name << "\""
+                   << ",\"width\":" << config.size.width << ",\"height\":" << config.size.height
+                   << ",\"k1\":" << config.k1
+                   << ",\"count\":" << samples.size()
+                   << ",\"mean_ms\":" << (samples.empty() ? 0 : sum/samples.size())
+                   << ",\"p50_ms\":" << percentile(0.5)
+                   << ",\"p90_ms\":" << percentile(0.9)
+                   << ",\"p99_ms\":" << percentile(0.99)
+                   << ",\"max_ms\":" << percentile(1.0)
+                   << ",\"throughput_per_s\":" << (sum > 0 ? samples.size()*1000.0/sum : 0)
+                   << ",\"peak_rss_kb\":" << peakMemory()
+                   << extra << "}";
+            return strstr.str();
+        }
+
+    private:
+        std::string name;
+        QElapsedTimer timer;
+        std::vector<double> samples;
+};
+
+cv::Mat createBoardImage(int cols,int rows,int square,int margin)
+{
+    cv::Mat board((rows+1)*square+2*margin,(cols+1)*square+2*margin,CV_8UC1,cv::Scalar(255));
+    for(int row=0;row <= rows;++row)
+    {
+        for(int col=0;col <= cols;++col)
+        {
+            if((row+col)%2)
+                continue;
+            cv::rectangle(board,cv::Rect(margin+col*square,margin+row*square,square,square),cv::Scalar(0),-1);
+        }
+    }
+    return board;
+}
+
+// creates maps which distort an undistorted image
+void createDistortionMaps(const cv::Mat &k,const cv::Mat &dist,const cv::Size &size,cv::Mat &map_x,cv::Mat &map_y)
+{
+    std::vector<cv::Point2f> points;
+    points.reserve(size.area());
+    for(int y=0;y < size.height;++y)
+        for(int x=0;x < size.width;++x)
+            points.push_back(cv::Point2f(x,y));
+    std::vector<cv::Point2f> undistorted;
+    cv::undistortPoints(points,undistorted,k,dist,cv::noArray(),k);
+    map_x.create(size,CV_32FC1);
+    map_y.create(size,CV_32FC1);
+    for(int y=0,i=0;y < size.height;++y)
+    {
+        for(int x=0;x < size.width;++x,++i)
+        {
+            map_x.at<float>(y,x) = undistorted[i].x;
+            map_y.at<float>(y,x) = undistorted[i].y;
+        }
+    }
+}
+
+std::vector<Frame> createFrames(const Config &config,int count,int cols,int rows,float square,
+                                cv::Mat &k,cv::Mat &dist,cv::RNG &rng)
+{
+    const double f = config.size.width*0.8;
+    k = (cv::Mat_<double>(3,3) << f,0,config.size.width*0.5,0,f,config.size.height*0.5,0,0,1);
+    dist = (cv::Mat_<double>(4,1) << config.k1,0,0,0);
+
+    // render the board with 20 pixels per cell
+    const int board_square = 20;
+    const int margin = board_square;
+    const double scale = board_square/square;
+    cv::Mat board = createBoardImage(cols,rows,board_square,margin);
+    // the first inner corner lies on the border between two pixels
+    const double offset = (margin+board_square-0.5)/scale;
+    cv::Mat world_from_board = (cv::Mat_<double>(3,3) << 1.0/scale,0,-offset,
+                                                         0,1.0/scale,-offset,
+                                                         0,0,1);
+    std::vector<cv::Point3f> object_points;
+    for(int row=0;row < rows;++row)
+        for(int col=0;col < cols;++col)
+            object_points.push_back(cv::Point3f(col*square,row*square,0));
+
+    cv::Mat map_x,map_y;
+    if(config.k1 != 0)
+        createDistortionMaps(k,dist,config.size,map_x,map_y);
+
+    const double width = (cols+1)*square;
+    const double height = (rows+1)*square;
+    std::vector<Frame> frames;
+    for(int i=0;i < count;++i)
+    {
+        // random pose with the board covering roughly half of the image width
+        cv::Mat rvec = (cv::Mat_<double>(3,1) << rng.uniform(-0.5,0.5),rng.uniform(-0.5,0.5),rng.uniform(-0.3,0.3));
+        cv::Mat r;
+        cv::Rodrigues(rvec,r);
+        const double z = f*width/(config.size.width*rng.uniform(0.4,0.6));
+        cv::Mat center = (cv::Mat_<double>(3,1) << width*0.5-square,height*0.5-square,0);
+        cv::Mat tvec = -r*center + (cv::Mat_<double>(3,1) << rng.uniform(-0.15,0.15)*z,rng.uniform(-0.1,0.1)*z,z);
+
+        cv::Mat rt(3,3,CV_64FC1);
+        r.col(0).copyTo(rt.col(0));
+        r.col(1).copyTo(rt.col(1));
+        tvec.copyTo(rt.col(2));
+        cv::Mat h = k*rt*world_from_board;
+
+        cv::Mat image;
+        cv::warpPerspective(board,image,h,config.size,cv::INTER_LINEAR,cv::BORDER_CONSTANT,cv::Scalar(128));
+        if(!map_x.empty())
+        {
+            cv::Mat distorted;
+            cv::remap(image,distorted,map_x,map_y,cv::INTER_LINEAR,cv::BORDER_CONSTANT,cv::Scalar(128));
+            image = distorted;
+        }
+
+        Frame frame;
+        cv::projectPoints(object_points,rvec,tvec,k,dist,frame.corners);
+        cv::Mat rgb;
+        cv::cvtColor(image,rgb,cv::COLOR_GRAY2RGB);
+        QImage qimage(rgb.data,rgb.cols,rgb.rows,rgb.step,QImage::Format_RGB888);
+        QBuffer buffer(&frame.jpg);
+        buffer.open(QIODevice::WriteOnly);
+        qimage.save(&buffer,"JPG",95);
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+// mean distance between detected and true corners
+// the detector might return the corners in reversed order
+double cornerError(const QVector<QPointF> &detected,const std::vector<cv::Point2f> &truth)
+{
+    if(detected.size() != (int)truth.size() || truth.empty())
+        return -1;
+    const size_t count = truth.size();
+    double sum = 0;
+    double sum_reversed = 0;
+    for(size_t i=0;i < count;++i)
+    {
+        const cv::Point2f &p = truth[i];
+        const QPointF &p1 = detected[i];
+        const QPointF &p2 = detected[count-1-i];
+        sum += std::sqrt((p1.x()-p.x)*(p1.x()-p.x)+(p1.y()-p.y)*(p1.y()-p.y));
+        sum_reversed += std::sqrt((p2.x()-p.x)*(p2.x()-p.x)+(p2.y()-p.y)*(p2.y()-p.y));
+    }
+    return std::min(sum,sum_reversed)/count;
+}
+
+void runBenchmark(const Config &config,int count,int cols,int rows,float square,cv::RNG &rng)
+{
+    cv::Mat k,dist;
+    std::vector<Frame> frames = createFrames(config,count,cols,rows,square,k,dist,rng);
+
+    // the model is only needed to measure ImageItem::setChessboard in its real environment
+    QStandardItemModel model;
+    DatasetPtr dataset(new Dataset);
+    CameraItem *camera = new CameraItem(dataset,0,"camera_0");
+    model.appendRow(camera);
+
+    Stage decode("decode");
+    Stage gray("gray_view");
+    Stage convert_to_qt("convertToQt");
+    Stage convert_from_qt("convertFromQt");
+    Stage set_chessboard("setChessboard");
+    Stage chessboard_overlay("chessboard_overlay");
+    Stage calibrate("calibrate");
+    Stage calibrate_progress("calibrate_progress");
+    Stage calibrate_sparse("calibrate_sparse");
+    Stage residual_heatmap("residual_heatmap");
+    Stage residual_heatmap_large("residual_heatmap_large");
+    Stage undistort_maps("undistort_maps");
+    Stage undistort("undistort");
+    // all engines are compared on the same frames
+    std::vector<DetectorSettings> detectors;
+    std::vector<Stage> detect;
+    detectors.push_back(DetectorSettings(DETECTION_FULL_RESOLUTION));
+    detect.push_back(Stage("detect_full_resolution"));
+    detectors.push_back(DetectorSettings(DETECTION_PYRAMID));
+    detect.push_back(Stage("detect_pyramid"));
+    if(ChessboardDetector::isAvailable(DETECTOR_SECTOR_BASED))
+    {
+        const int flags = DetectorSettings::getDefaultFlags(DETECTOR_SECTOR_BASED);
+        detectors.push_back(DetectorSettings(DETECTOR_SECTOR_BASED,flags,DETECTION_FULL_RESOLUTION));
+        detect.push_back(Stage("detect_sb_full_resolution"));
+        detectors.push_back(DetectorSettings(DETECTOR_SECTOR_BASED,flags,DETECTION_PYRAMID));
+        detect.push_back(Stage("detect_sb_pyramid"));
+    }
+    const int mode_count = detectors.size();
+    std::vector<int> detected(mode_count,0);
+    std::vector<double> errors(mode_count,0);
+
+    // the overlay is painted like ImageView does it, the canvas is reused
+    ChessboardItem overlay;
+    QImage canvas(config.size.width,config.size.height,QImage::Format_RGB32);
+
+    for(size_t i=0;i < frames.size();++i)
+    {
+        decode.start();
+        QImage image = QImage::fromData(frames[i].jpg);
+        decode.stop();
+
+        gray.start();
+        ImageBuffer gray_buffer = ImageBuffer(image).toGray();
+        gray.stop();
+
+        QVector<QPointF> corners;
+        for(int mode=0;mode < mode_count;++mode)
+        {
+            detect[mode].start();
+            QVector<QPointF> result = ImageItem::findChessboard(image,cols,rows,detectors[mode]);
+            detect[mode].stop();
+            double error = cornerError(result,frames[i].corners);
+            if(error >= 0)
+            {
+                ++detected[mode];
+                errors[mode] += error;
+            }
+            if(corners.empty())
+                corners = result;
+        }
+        if(corners.empty())
+            continue;
+
+        convert_from_qt.start();
+        std::vector<cv::Point2f> points = convertFromQt(corners);
+        convert_from_qt.stop();
+        convert_to_qt.start();
+        corners = convertToQt(points);
+        convert_to_qt.stop();
+
+        ImageItem *item = camera->addImage(QString("image_%1.jpg").arg(i),image);
+        set_chessboard.start();
+        item->setChessboard(corners,cols,rows);
+        set_chessboard.stop();
+
+        chessboard_overlay.start();
+        overlay.setChessboard(corners,cols,rows);
+        {
+            QPainter painter(&canvas);
+            overlay.paint(&painter,NULL);
+        }
+        chessboard_overlay.stop();
+    }
+
+    std::cout << decode.toJson(config) << std::endl;
+    std::cout << gray.toJson(config) << std::endl;
+    for(int mode=0;mode < mode_count;++mode)
+    {
+        std::stringstream extra;
+        extra << ",\"detected\":" << detected[mode] << ",\"frames\":" << frames.size()
+              << ",\"mean_corner_error_px\":" << (detected[mode] ? errors[mode]/detected[mode] : -1);
+        std::cout << detect[mode].toJson(config,extra.str()) << std::endl;
+    }
+    std::cout << convert_from_qt.toJson(config) << std::endl;
+    std::cout << convert_to_qt.toJson(config) << std::endl;
+    std::cout << set_chessboard.toJson(config) << std::endl;
+    std::cout << chessboard_overlay.toJson(config) << std::endl;
+
+    if(camera->countChessboards() < 5)
+        return;
+    // both solvers are compared on the same views
+    CalibrationData data = camera->getCalibrationData(cols,rows,square,square);
+    const CalibrationSolver solvers[2] = {SOLVER_DENSE,SOLVER_SPARSE};
+    CalibrationResult result,dense_result;
+    for(int s=0;s < 2;++s)
+    {
+        Stage &stage = s == 0 ? calibrate : calibrate_sparse;
+        for(int i=0;i < 3;++i)
+        {
+            stage.start();
+            result = calibrateCamera(data,NULL,30,NULL,solvers[s]);
+            stage.stop();
+        }
+        std::stringstream extra;
+        extra << ",\"views\":" << data.getViewCount()
+              << ",\"iterations\":" << result.iterations
+              << ",\"rms_error_px\":" << result.error
+              << ",\"fx_error\":" << result.camera_matrix.at<double>(0,0)-k.at<double>(0,0)
+              << ",\"k1_error\":" << result.dist_coeffs.at<double>(0)-config.k1;
+        std::cout << stage.toJson(config,extra.str()) << std::endl;
+        if(solvers[s] == SOLVER_DENSE)
+            dense_result = result;
+    }
+
+    // with progress receiver the dense solver runs in steps, it must end where the single solve ends
+    StepCounter counter;
+    CalibrationResult stepped_result;
+    for(int i=0;i < 3;++i)
+    {
+        counter.steps = 0;
+        calibrate_progress.start();
+        stepped_result = calibrateCamera(data,&counter,30,NULL,SOLVER_DENSE);
+        calibrate_progress.stop();
+    }
+    {
+        const double fx_difference = stepped_result.camera_matrix.at<double>(0,0)-dense_result.camera_matrix.at<double>(0,0);
+        const double rms_difference = stepped_result.error-dense_result.error;
+        std::stringstream extra;
+        extra << ",\"steps\":" << counter.steps
+              << ",\"fx_difference\":" << fx_difference
+              << ",\"k1_difference\":" << stepped_result.dist_coeffs.at<double>(0)-dense_result.dist_coeffs.at<double>(0)
+              << ",\"rms_difference_px\":" << rms_difference
+              << ",\"matches_single_solve\":" << (std::fabs(rms_difference) <= 1e-4*dense_result.error &&
+                                                 std::fabs(fx_difference) <= 1e-3*dense_result.camera_matrix.at<double>(0,0) ? "true" : "false");
+        std::cout << calibrate_progress.toJson(config,extra.str()) << std::endl;
+    }
+
+    // interactive display of the residuals
+    ResidualHeatmap heatmap;
+    for(int i=0;i < 10;++i)
+    {
+        residual_heatmap.start();
+        heatmap = computeResidualHeatmap(data,result);
+        residual_heatmap.stop();
+    }
+    std::stringstream extra;
+    extra << ",\"corners\":" << heatmap.corners << ",\"max_cell_error_px\":" << heatmap.max_error;
+    std::cout << residual_heatmap.toJson(config,extra.str()) << std::endl;
+
+    // the heatmap must stay interactive for hundreds of thousands of corners,
+    // the views are repeated until the dataset is large enough
+    const std::vector<cv::Point3f> board(data.object_points.begin<cv::Point3f>(),data.object_points.end<cv::Point3f>());
+    const int large_views = (LARGE_DATASET_CORNERS+int(board.size())-1)/int(board.size());
+    CalibrationData large_data;
+    large_data.reserve(board,large_views);
+    large_data.image_size = data.image_size;
+    large_data.distortion = data.distortion;
+    CalibrationResult large_result = result;
+    large_result.rvecs.clear();
+    large_result.tvecs.clear();
+    large_result.image_ids.clear();
+    for(int i=0;i < large_views;++i)
+    {
+        const int view = i%data.getViewCount();
+        cv::Mat rvec,tvec;
+        if(!result.getViewPose(data.image_ids[view],rvec,tvec))
+            continue;
+        const cv::Mat points = data.getImagePoints(view);
+        large_data.addView(i,std::vector<cv::Point2f>(points.begin<cv::Point2f>(),points.end<cv::Point2f>()));
+        large_result.image_ids.push_back(i);
+        large_result.rvecs.push_back(rvec);
+        large_result.tvecs.push_back(tvec);
+    }
+    for(int i=0;i < 10;++i)
+    {
+        residual_heatmap_large.start();
+        heatmap = computeResidualHeatmap(large_data,large_result);
+        residual_heatmap_large.stop();
+    }
+    std::stringstream extra_large;
+    extra_large << ",\"corners\":" << heatmap.corners << ",\"budget_ms\":" << INTERACTIVE_BUDGET_MS
+                << ",\"within_budget\":" << (residual_heatmap_large.percentile(0.9) < INTERACTIVE_BUDGET_MS ? "true" : "false");
+    std::cout << residual_heatmap_large.toJson(config,extra_large.str()) << std::endl;
+
+    // undistortion preview, the maps are built once per calibration
+    undistort_maps.start();
+    const UndistortMaps maps = createUndistortMaps(result);
+    undistort_maps.stop();
+    for(size_t i=0;i < frames.size();++i)
+    {
+        const QImage image = QImage::fromData(frames[i].jpg);
+        undistort.start();
+        ImageView::undistortImage(QString("frame:%1").arg(i),image,maps);
+        undistort.stop();
+    }
+    std::cout << undistort_maps.toJson(config) << std::endl;
+    std::cout << undistort.toJson(config) << std::endl;
+}
+
+void usage()
+{
+    std::cerr << "usage: QCamCalibBenchmark [options]\n"
+              << "options:\n"
+              << "  --frames <n>              images per configuration (default 20)\n"
+              << "  --resolutions <list>      comma separated WxH list (default 640x480,1920x1080,4000x3000)\n"
+              << "  --distortions <list>      comma separated k1 list (default 0,-0.1,-0.3)\n"
+              << "  --seed <n>                random seed (default 42)\n"
+              << "Prints one JSON object per stage and configuration.\n";
+}
+
+int main( int argc, char* argv[] )
+{
+    QCoreApplication app(argc, argv);
+
+    int count = 20;
+    int seed = 42;
+    QStringList resolutions = QString("640x480,1920x1080,4000x3000").split(',');
+    QStringList distortions = QString("0,-0.1,-0.3").split(',');
+
+    QStringList args = app.arguments();
+    for(int i=1;i<args.size();++i)
+    {
+        const QString &arg = args[i];
+        const bool has_value = i+1 < args.size();
+        if(arg == "--frames" && has_value)
+            count = args[++i].toInt();
+        else if(arg == "--resolutions" && has_value)
+            resolutions = args[++i].split(',');
+        else if(arg == "--distortions" && has_value)
+            distortions = args[++i].split(',');
+        else if(arg == "--seed" && has_value)
+            seed = args[++i].toInt();
+        else
+        {
+            usage();
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+    }
+
+    cv::RNG rng(seed);
+    QStringList::const_iterator resolution = resolutions.begin();
+    for(;resolution != resolutions.end();++resolution)
+    {
+        QStringList size = resolution->split('x');
+        if(size.size() != 2)
+        {
+            std::cerr << "invalid resolution " << resolution->toStdString() << std::endl;
+            return 1;
+        }
+        QStringList::const_iterator distortion = distortions.begin();
+        for(;distortion != distortions.end();++distortion)
+        {
+            Config config;
+            config.size = cv::Size(size[0].toInt(),size[1].toInt());
+            config.k1 = distortion->toDouble();
+            runBenchmark(config,count,9,6,35,rng);
+        }
+    }
+    return 0;
+}
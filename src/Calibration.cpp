@@ -0,0 +1,732 @@
+#include "Calibration.hpp"
+#include "SparseCalibration.hpp"
+#include "Profiler.hpp"
+
+#include <opencv2/core/version.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <stdexcept>
+#include <ctime>
+#include <limits>
+#include <map>
+#include <QTime>
+#include <QAtomicInt>
+#include <QList>
+#include <QtConcurrentMap>
+#include <boost/bind.hpp>
+
+using namespace qcam_calib;
+
+// number of solver iterations between two progress reports
+static const int ITERATIONS_PER_STEP = 5;
+
+CalibrationData::CalibrationData():
+    distortion(DISTORTION_RADIAL_TANGENTIAL)
+{
+    offsets.push_back(0);
+}
+
+void CalibrationData::reserve(const std::vector<cv::Point3f> &board,int views)
+{
+    object_points = cv::Mat(board,true);
+    image_points = cv::Mat((int)board.size()*views,1,CV_32FC2);
+    offsets.assign(1,0);
+    offsets.reserve(views+1);
+    image_ids.clear();
+    image_ids.reserve(views);
+}
+
+void CalibrationData::addView(int image_id,const std::vector<cv::Point2f> &corners)
+{
+    if((int)corners.size() != object_points.rows)
+        throw std::runtime_error("CalibrationData: the corners do not match the board");
+    const int begin = offsets.back();
+    const int end = begin+(int)corners.size();
+    if(end > image_points.rows)
+    {
+        // grow geometrically if more views are added than reserved
+        cv::Mat points(std::max(end,2*image_points.rows),1,CV_32FC2);
+        if(begin > 0)
+            image_points.rowRange(0,begin).copyTo(points.rowRange(0,begin));
+        image_points = points;
+    }
+    if(!corners.empty())
+        memcpy(image_points.ptr<cv::Point2f>(begin),&corners[0],corners.size()*sizeof(cv::Point2f));
+    offsets.push_back(end);
+    image_ids.push_back(image_id);
+}
+
+int CalibrationData::getViewCount()const
+{
+    return (int)offsets.size()-1;
+}
+
+cv::Mat CalibrationData::getImagePoints(int view)const
+{
+    return image_points.rowRange(offsets[view],offsets[view+1]);
+}
+
+std::vector<cv::Mat> CalibrationData::getImagePointViews()const
+{
+    std::vector<cv::Mat> views;
+    views.reserve(getViewCount());
+    for(int i=0;i < getViewCount();++i)
+        views.push_back(getImagePoints(i));
+    return views;
+}
+
+std::vector<cv::Mat> CalibrationData::getObjectPointViews()const
+{
+    return std::vector<cv::Mat>(getViewCount(),object_points);
+}
+
+CalibrationData CalibrationData::selectViews(const std::vector<int> &views)const
+{
+    CalibrationData data;
+    data.image_size = image_size;
+    data.distortion = distortion;
+    data.object_points = object_points;
+    data.image_points = cv::Mat(object_points.rows*(int)views.size(),1,CV_32FC2);
+    data.offsets.reserve(views.size()+1);
+    data.image_ids.reserve(views.size());
+    std::vector<int>::const_iterator iter = views.begin();
+    for(;iter != views.end();++iter)
+    {
+        const int begin = data.offsets.back();
+        const int end = begin+offsets[*iter+1]-offsets[*iter];
+        if(end > data.image_points.rows)
+            throw std::runtime_error("CalibrationData: views do not match the board");
+        getImagePoints(*iter).copyTo(data.image_points.rowRange(begin,end));
+        data.offsets.push_back(end);
+        data.image_ids.push_back(image_ids[*iter]);
+    }
+    return data;
+}
+
+CalibrationResult::CalibrationResult():
+    distortion(DISTORTION_RADIAL_TANGENTIAL),
+    error(0),
+    pixel_error(0),
+    iterations(0),
+    canceled(false),
+    warm_started(false)
+{
+}
+
+bool CalibrationResult::getViewPose(int image_id,cv::Mat &rvec,cv::Mat &tvec)const
+{
+    for(size_t i=0;i < image_ids.size() && i < rvecs.size() && i < tvecs.size();++i)
+    {
+        if(image_ids[i] == image_id)
+        {
+            rvec = rvecs[i];
+            tvec = tvecs[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+double CalibrationResult::getViewError(int image_id)const
+{
+    for(size_t i=0;i < image_ids.size() && i < view_errors.size();++i)
+    {
+        if(image_ids[i] == image_id)
+            return view_errors[i];
+    }
+    for(size_t i=0;i < rejected_ids.size() && i < rejected_errors.size();++i)
+    {
+        if(rejected_ids[i] == image_id)
+            return rejected_errors[i];
+    }
+    return -1;
+}
+
+bool CalibrationResult::isRejected(int image_id)const
+{
+    return std::find(rejected_ids.begin(),rejected_ids.end(),image_id) != rejected_ids.end();
+}
+
+OutlierRejection::OutlierRejection():
+    enabled(false),
+    threshold(3.0),
+    min_error(0.5),
+    max_rounds(5),
+    min_views(5)
+{
+}
+
+// a previous result is only a sensible guess for images of the same size
+static bool canWarmStart(const CalibrationResult &initial,const CalibrationData &data)
+{
+    return initial.image_size == data.image_size && initial.distortion == data.distortion &&
+           initial.camera_matrix.rows == 3 && initial.camera_matrix.cols == 3 &&
+           initial.camera_matrix.type() == CV_64FC1 &&
+           int(initial.dist_coeffs.total()) == getDistortionCoeffCount(data.distortion) &&
+           initial.dist_coeffs.type() == CV_64FC1;
+}
+
+// OpenCV might return more coefficients than the model has, e.g. a fixed k3
+static cv::Mat resizeCoeffs(const cv::Mat &coeffs,int count)
+{
+    cv::Mat result = cv::Mat::zeros(count,1,CV_64FC1);
+    const cv::Mat values = coeffs.clone().reshape(1,coeffs.total());
+    const int n = std::min(count,values.rows);
+    values.rowRange(0,n).convertTo(result.rowRange(0,n),CV_64F);
+    return result;
+}
+
+// one call of the OpenCV solver of the distortion model
+static double runOpenCVSolver(const std::vector<cv::Mat> &object_points,const std::vector<cv::Mat> &image_points,const cv::Size &size,
+                              bool guess,const cv::TermCriteria &criteria,CalibrationResult &result)
+{
+    int flags = guess ? cv::CALIB_USE_INTRINSIC_GUESS : 0;
+    switch(result.distortion)
+    {
+    case DISTORTION_RADIAL_TANGENTIAL:
+        flags |= cv::CALIB_FIX_K3;
+        break;
+    case DISTORTION_RATIONAL:
+        flags |= cv::CALIB_RATIONAL_MODEL;
+        break;
+    case DISTORTION_THIN_PRISM:
+#if CV_MAJOR_VERSION >= 3
+        flags |= cv::CALIB_RATIONAL_MODEL | cv::CALIB_THIN_PRISM_MODEL;
+        break;
+#else
+        throw std::runtime_error("the thin prism model requires OpenCV 3 or the sparse solver");
+#endif
+    case DISTORTION_FISHEYE:
+#if CV_MAJOR_VERSION >= 3
+        flags = cv::fisheye::CALIB_RECOMPUTE_EXTRINSIC | cv::fisheye::CALIB_FIX_SKEW;
+        if(guess)
+            flags |= cv::fisheye::CALIB_USE_INTRINSIC_GUESS;
+        return cv::fisheye::calibrate(object_points,image_points,size,result.camera_matrix,result.dist_coeffs,
+                                      result.rvecs,result.tvecs,flags,criteria);
+#else
+        throw std::runtime_error("the fisheye model requires OpenCV 3 or the sparse solver");
+#endif
+    default:
+        throw std::runtime_error("unknown distortion model");
+    }
+    return cv::calibrateCamera(object_points,image_points,size,result.camera_matrix,result.dist_coeffs,
+                               result.rvecs,result.tvecs,flags,criteria);
+}
+
+static CalibrationResult calibrateCameraDense(const CalibrationData &data,CalibrationProgress *progress,int max_iterations,
+                                              const CalibrationResult *initial)
+{
+    const std::vector<cv::Mat> image_points = data.getImagePointViews();
+    const std::vector<cv::Mat> object_points = data.getObjectPointViews();
+
+    QTime timer;
+    timer.start();
+
+    CalibrationResult result;
+    result.image_ids = data.image_ids;
+    result.image_size = data.image_size;
+    result.distortion = data.distortion;
+    const int coeff_count = getDistortionCoeffCount(data.distortion);
+    bool guess = false;
+    if(initial)
+    {
+        // cv::calibrateCamera estimates the initial view poses from the intrinsic guess
+        result.camera_matrix = initial->camera_matrix.clone();
+        result.dist_coeffs = initial->dist_coeffs.clone().reshape(1,coeff_count);
+        result.warm_started = true;
+        guess = true;
+    }
+    else
+    {
+        result.camera_matrix = cv::Mat(3,3,CV_64FC1);
+        result.dist_coeffs = cv::Mat::zeros(coeff_count,1,CV_64FC1);
+    }
+    if(!progress)
+    {
+        // nothing to report, a single solve keeps the damping of cv::calibrateCamera
+        ScopedProfile profile("calibrateCamera");
+        result.error = runOpenCVSolver(object_points,image_points,data.image_size,guess,
+                                       cv::TermCriteria(cv::TermCriteria::COUNT+cv::TermCriteria::EPS,max_iterations,DBL_EPSILON),result);
+        result.dist_coeffs = resizeCoeffs(result.dist_coeffs,coeff_count);
+        result.iterations = max_iterations;
+    }
+    double last_error = DBL_MAX;
+    while(progress && result.iterations < max_iterations)
+    {
+        const int count = std::min(ITERATIONS_PER_STEP,max_iterations-result.iterations);
+        ScopedProfile profile("calibrateCamera");
+
+        // the solver writes the intrinsic guess in place
+        CalibrationResult previous = result;
+        previous.camera_matrix = result.camera_matrix.clone();
+        previous.dist_coeffs = result.dist_coeffs.clone();
+        result.rvecs.clear();
+        result.tvecs.clear();
+        result.error = runOpenCVSolver(object_points,image_points,data.image_size,guess,
+                                       cv::TermCriteria(cv::TermCriteria::COUNT+cv::TermCriteria::EPS,count,DBL_EPSILON),result);
+        result.dist_coeffs = resizeCoeffs(result.dist_coeffs,coeff_count);
+        result.iterations += count;
+        guess = true;
+
+        if(!progress->step(result.iterations,result.error,timer.elapsed()*0.001))
+        {
+            result.canceled = true;
+            break;
+        }
+        // each step stops at the same criteria as a single solve, so the
+        // solver converged if a whole step does not change the error
+        if(result.error >= last_error)
+        {
+            // a restarted step might end slightly worse than the previous one
+            if(result.error > last_error)
+            {
+                previous.iterations = result.iterations;
+                result = previous;
+            }
+            break;
+        }
+        last_error = result.error;
+    }
+
+    // cv::fisheye returns the poses as 1x1 CV_64FC3
+    for(size_t i=0;i < result.rvecs.size();++i)
+    {
+        result.rvecs[i] = result.rvecs[i].reshape(1,3);
+        result.tvecs[i] = result.tvecs[i].reshape(1,3);
+    }
+    return result;
+}
+
+CalibrationResult qcam_calib::calibrateCamera(const CalibrationData &data,CalibrationProgress *progress,int max_iterations,
+                                              const CalibrationResult *initial,CalibrationSolver solver)
+{
+    if(data.getViewCount() < 1)
+        throw std::runtime_error("not enough detected chessboards");
+    if(initial && !canWarmStart(*initial,data))
+        initial = NULL;
+
+    CalibrationResult result;
+    if(solver == SOLVER_SPARSE)
+        result = calibrateCameraSparse(data,progress,max_iterations,initial);
+    else
+        result = calibrateCameraDense(data,progress,max_iterations,initial);
+    result.pixel_error = sqrt(result.error/data.object_points.rows);
+    if(!result.canceled)
+        result.view_errors = computeViewErrors(data,result);
+    return result;
+}
+
+// number of grid cells along the longer image side used to measure the coverage
+static const int COVERAGE_GRID_SIZE = 16;
+
+// describes the pose of the board in a view by its homography
+static void computePoseDescriptor(const CalibrationData &data,int view,float *descriptor)
+{
+    // outer corners of the board in the model and in the image
+    const cv::Mat points = data.getImagePoints(view);
+    const int count = points.rows;
+    int cols = 1;
+    const cv::Point3f *model = data.object_points.ptr<cv::Point3f>(0);
+    while(cols < count && model[cols].y == model[0].y)
+        ++cols;
+    const int rows = count/cols;
+    const int index[4] = {0,cols-1,count-1,count-cols};
+    cv::Point2f src[4],dst[4];
+    for(int i=0;i < 4;++i)
+    {
+        src[i] = cv::Point2f(model[index[i]].x,model[index[i]].y);
+        dst[i] = points.at<cv::Point2f>(index[i]);
+    }
+
+    const float width = (float)data.image_size.width;
+    const float height = (float)data.image_size.height;
+    const float diagonal = std::sqrt(width*width+height*height);
+    cv::Point2f center(0,0);
+    for(int i=0;i < 4;++i)
+        center += dst[i]*0.25f;
+    const cv::Point2f side = dst[1]-dst[0];
+    const float angle = std::atan2(side.y,side.x);
+    const float area = (float)std::fabs(cv::contourArea(std::vector<cv::Point2f>(dst,dst+4)));
+
+    descriptor[0] = center.x/width;
+    descriptor[1] = center.y/height;
+    descriptor[2] = std::sqrt(area)/diagonal*2;
+    descriptor[3] = std::cos(angle);
+    descriptor[4] = std::sin(angle);
+    descriptor[5] = 0;
+    descriptor[6] = 0;
+    if(cols > 1 && rows > 1)
+    {
+        // the perspective part of the homography in board size units is the tilt
+        const float board_size = std::max(src[2].x-src[0].x,src[2].y-src[0].y);
+        for(int i=0;i < 4;++i)
+            src[i] *= 1.0f/board_size;
+        cv::Mat h = cv::getPerspectiveTransform(src,dst);
+        const double scale = h.at<double>(2,2);
+        descriptor[5] = (float)(h.at<double>(2,0)/scale);
+        descriptor[6] = (float)(h.at<double>(2,1)/scale);
+    }
+}
+
+std::vector<int> qcam_calib::selectViewSubset(const CalibrationData &data,int max_views)
+{
+    ScopedProfile profile("view selection");
+    const int view_count = data.getViewCount();
+    std::vector<int> selected;
+    if(max_views <= 0 || view_count <= max_views)
+    {
+        for(int i=0;i < view_count;++i)
+            selected.push_back(i);
+        return selected;
+    }
+
+    // grid cells hit by the corners of each view
+    const int longer_side = std::max(std::max(data.image_size.width,data.image_size.height),1);
+    const float cell_size = (float)longer_side/COVERAGE_GRID_SIZE;
+    const int grid_cols = std::max(1,(int)std::ceil(data.image_size.width/cell_size));
+    const int grid_rows = std::max(1,(int)std::ceil(data.image_size.height/cell_size));
+    std::vector<std::vector<int> > cells(view_count);
+    size_t max_cells = 1;
+    for(int view=0;view < view_count;++view)
+    {
+        const cv::Mat points = data.getImagePoints(view);
+        for(int i=0;i < points.rows;++i)
+        {
+            const cv::Point2f &p = points.at<cv::Point2f>(i);
+            const int col = std::min(std::max((int)(p.x/cell_size),0),grid_cols-1);
+            const int row = std::min(std::max((int)(p.y/cell_size),0),grid_rows-1);
+            cells[view].push_back(row*grid_cols+col);
+        }
+        std::sort(cells[view].begin(),cells[view].end());
+        cells[view].erase(std::unique(cells[view].begin(),cells[view].end()),cells[view].end());
+        max_cells = std::max(max_cells,cells[view].size());
+    }
+
+    const int descriptor_size = 7;
+    std::vector<float> descriptors(view_count*descriptor_size);
+    for(int view=0;view < view_count;++view)
+        computePoseDescriptor(data,view,&descriptors[view*descriptor_size]);
+
+    // greedy selection, the first view is the one covering the most cells
+    std::vector<int> hits(grid_cols*grid_rows,0);
+    std::vector<float> distances(view_count,FLT_MAX);
+    std::vector<bool> used(view_count,false);
+    while((int)selected.size() < max_views)
+    {
+        int best = -1;
+        double best_score = -1;
+        for(int view=0;view < view_count;++view)
+        {
+            if(used[view])
+                continue;
+            double coverage = 0;
+            std::vector<int>::const_iterator iter = cells[view].begin();
+            for(;iter != cells[view].end();++iter)
+                coverage += 1.0/(1+hits[*iter]);
+            double score = coverage/max_cells;
+            if(!selected.empty())
+                score += std::sqrt(distances[view]);
+            if(score > best_score)
+            {
+                best_score = score;
+                best = view;
+            }
+        }
+        if(best < 0)
+            break;
+
+        used[best] = true;
+        selected.push_back(best);
+        std::vector<int>::const_iterator iter = cells[best].begin();
+        for(;iter != cells[best].end();++iter)
+            ++hits[*iter];
+        const float *d1 = &descriptors[best*descriptor_size];
+        for(int view=0;view < view_count;++view)
+        {
+            const float *d2 = &descriptors[view*descriptor_size];
+            float distance = 0;
+            for(int i=0;i < descriptor_size;++i)
+                distance += (d1[i]-d2[i])*(d1[i]-d2[i]);
+            distances[view] = std::min(distances[view],distance);
+        }
+    }
+    std::sort(selected.begin(),selected.end());
+    return selected;
+}
+
+static double rmsError(const cv::Mat &points,const std::vector<cv::Point2f> &projected)
+{
+    if(projected.empty())
+        return 0;
+    const cv::Point2f *p = points.ptr<cv::Point2f>(0);
+    double sum = 0;
+    for(size_t i=0;i < projected.size();++i)
+    {
+        const cv::Point2f d = p[i]-projected[i];
+        sum += d.x*d.x+d.y*d.y;
+    }
+    return sqrt(sum/projected.size());
+}
+
+static double computeViewError(const CalibrationData *data,const CalibrationResult *result,int view)
+{
+    std::vector<cv::Point2f> projected;
+    const CameraModel model(result->distortion,result->camera_matrix,result->dist_coeffs);
+    model.project(data->object_points,result->rvecs[view],result->tvecs[view],projected);
+    return rmsError(data->getImagePoints(view),projected);
+}
+
+std::vector<double> qcam_calib::computeViewErrors(const CalibrationData &data,const CalibrationResult &result)
+{
+    if((int)result.rvecs.size() != data.getViewCount() || (int)result.tvecs.size() != data.getViewCount())
+        throw std::runtime_error("computeViewErrors: the result does not match the data");
+
+    ScopedProfile profile("view errors");
+    QList<int> views;
+    for(int i=0;i < data.getViewCount();++i)
+        views << i;
+    QList<double> errors = QtConcurrent::blockingMapped<QList<double> >(views,boost::bind(computeViewError,&data,&result,_1));
+    return std::vector<double>(errors.begin(),errors.end());
+}
+
+ResidualHeatmap::ResidualHeatmap():
+    cell_size(0),
+    max_error(0),
+    corners(0)
+{
+}
+
+bool ResidualHeatmap::empty()const
+{
+    return errors.empty();
+}
+
+// writes the residuals of one view into its rows of the shared buffer, the views do not overlap
+static void computeViewResiduals(const CalibrationData *data,const CameraModel *model,const std::vector<int> *poses,
+                                 const CalibrationResult *result,cv::Mat *residuals,int view)
+{
+    cv::Mat rows = residuals->rowRange(data->offsets[view],data->offsets[view+1]);
+    const int pose = (*poses)[view];
+    if(pose < 0)
+    {
+        rows.setTo(cv::Scalar::all(std::numeric_limits<float>::quiet_NaN()));
+        return;
+    }
+    std::vector<cv::Point2f> projected;
+    model->project(data->object_points,result->rvecs[pose],result->tvecs[pose],projected);
+    cv::subtract(cv::Mat(projected),data->getImagePoints(view),rows);
+}
+
+cv::Mat qcam_calib::computeResiduals(const CalibrationData &data,const CalibrationResult &result)
+{
+    ScopedProfile profile("residuals");
+
+    // index of the pose of each view in the result
+    std::map<int,int> result_views;
+    for(size_t i=0;i < result.image_ids.size() && i < result.rvecs.size() && i < result.tvecs.size();++i)
+        result_views[result.image_ids[i]] = i;
+    std::vector<int> poses(data.getViewCount(),-1);
+    QList<int> views;
+    for(int i=0;i < data.getViewCount();++i)
+    {
+        std::map<int,int>::const_iterator iter = result_views.find(data.image_ids[i]);
+        if(iter != result_views.end())
+            poses[i] = iter->second;
+        views << i;
+    }
+
+    const CameraModel model(result.distortion,result.camera_matrix,result.dist_coeffs);
+    cv::Mat residuals(data.image_points.rows,1,CV_32FC2);
+    QtConcurrent::blockingMap(views,boost::bind(computeViewResiduals,&data,&model,&poses,&result,&residuals,_1));
+    profile.addAllocation(residuals.total()*residuals.elemSize());
+    return residuals;
+}
+
+ResidualHeatmap qcam_calib::computeResidualHeatmap(const CalibrationData &data,const CalibrationResult &result,int cells)
+{
+    if(cells < 1 || data.image_size.width <= 0 || data.image_size.height <= 0)
+        throw std::runtime_error("computeResidualHeatmap: invalid grid");
+
+    const cv::Mat residuals = computeResiduals(data,result);
+
+    ScopedProfile profile("residual heatmap");
+    ResidualHeatmap heatmap;
+    heatmap.image_size = data.image_size;
+    heatmap.cell_size = (std::max(data.image_size.width,data.image_size.height)+cells-1)/cells;
+    const int cols = (data.image_size.width+heatmap.cell_size-1)/heatmap.cell_size;
+    const int rows = (data.image_size.height+heatmap.cell_size-1)/heatmap.cell_size;
+    cv::Mat sums = cv::Mat::zeros(rows,cols,CV_64FC1);
+    heatmap.counts = cv::Mat::zeros(rows,cols,CV_32SC1);
+
+    const float scale = 1.0f/heatmap.cell_size;
+    const cv::Point2f *corners = data.image_points.ptr<cv::Point2f>();
+    const cv::Point2f *r = residuals.ptr<cv::Point2f>();
+    for(int i=0;i < residuals.rows;++i)
+    {
+        // NaN marks views without a pose
+        const float e = r[i].x*r[i].x+r[i].y*r[i].y;
+        if(e != e)
+            continue;
+        const int col = std::min(std::max(int(corners[i].x*scale),0),cols-1);
+        const int row = std::min(std::max(int(corners[i].y*scale),0),rows-1);
+        sums.at<double>(row,col) += e;
+        ++heatmap.counts.at<int>(row,col);
+        ++heatmap.corners;
+    }
+
+    heatmap.errors = cv::Mat::zeros(rows,cols,CV_32FC1);
+    for(int row=0;row < rows;++row)
+    {
+        for(int col=0;col < cols;++col)
+        {
+            const int count = heatmap.counts.at<int>(row,col);
+            if(count == 0)
+                continue;
+            const float error = std::sqrt(sums.at<double>(row,col)/count);
+            heatmap.errors.at<float>(row,col) = error;
+            heatmap.max_error = std::max(heatmap.max_error,double(error));
+        }
+    }
+    return heatmap;
+}
+
+UndistortMaps::UndistortMaps():
+    id(-1)
+{
+}
+
+bool UndistortMaps::empty()const
+{
+    return map1.empty();
+}
+
+UndistortMaps qcam_calib::createUndistortMaps(const CalibrationResult &result)
+{
+    static QAtomicInt next_id;
+
+    ScopedProfile profile("undistortion maps");
+    UndistortMaps maps;
+    maps.id = next_id.fetchAndAddRelaxed(1);
+    maps.image_size = result.image_size;
+    const CameraModel model(result.distortion,result.camera_matrix,result.dist_coeffs);
+    model.initUndistortMaps(result.image_size,maps.map1,maps.map2);
+    profile.addAllocation(maps.map1.total()*maps.map1.elemSize()+maps.map2.total()*maps.map2.elemSize());
+    return maps;
+}
+
+static double median(std::vector<double> values)
+{
+    if(values.empty())
+        return 0;
+    const size_t n = values.size()/2;
+    std::nth_element(values.begin(),values.begin()+n,values.end());
+    return values[n];
+}
+
+// continues the iteration count of the progress over several solver runs
+class RoundProgress : public CalibrationProgress
+{
+    public:
+        RoundProgress(CalibrationProgress *progress):
+            progress(progress),
+            iterations(0)
+        {
+            timer.start();
+        }
+
+        virtual bool step(int iteration,double error,double elapsed)
+        {
+            return progress->step(iterations+iteration,error,timer.elapsed()*0.001);
+        }
+
+        CalibrationProgress *progress;
+        int iterations;
+        QTime timer;
+};
+
+CalibrationResult qcam_calib::calibrateCamera(const CalibrationData &data,const OutlierRejection &rejection,
+                                              CalibrationProgress *progress,const CalibrationResult *initial,
+                                              CalibrationSolver solver)
+{
+    RoundProgress round_progress(progress);
+    CalibrationProgress *step_progress = progress ? &round_progress : NULL;
+    CalibrationResult result = calibrateCamera(data,step_progress,30,initial,solver);
+
+    // indices into data of the views used by result
+    std::vector<int> views;
+    for(int i=0;i < data.getViewCount();++i)
+        views.push_back(i);
+    std::vector<int> rejected;
+
+    for(int round=0;rejection.enabled && round < rejection.max_rounds && !result.canceled;++round)
+    {
+        const double m = median(result.view_errors);
+        std::vector<double> deviations;
+        for(size_t i=0;i < result.view_errors.size();++i)
+            deviations.push_back(fabs(result.view_errors[i]-m));
+        const double threshold = std::max(m+rejection.threshold*1.4826*median(deviations),rejection.min_error);
+
+        // drop the worst views first so that at least min_views are kept
+        std::vector<std::pair<double,int> > order;
+        for(size_t i=0;i < views.size();++i)
+            order.push_back(std::make_pair(result.view_errors[i],(int)i));
+        std::sort(order.begin(),order.end());
+        std::vector<bool> keep(views.size(),true);
+        int kept = (int)views.size();
+        for(int i=(int)order.size()-1;i >= 0 && order[i].first > threshold && kept > rejection.min_views;--i)
+        {
+            keep[order[i].second] = false;
+            --kept;
+        }
+        if(kept == (int)views.size())
+            break;
+
+        std::vector<int> next_views;
+        for(size_t i=0;i < views.size();++i)
+        {
+            if(keep[i])
+                next_views.push_back(views[i]);
+            else
+                rejected.push_back(views[i]);
+        }
+        views = next_views;
+
+        round_progress.iterations = result.iterations;
+        const CalibrationResult previous = result;
+        result = calibrateCamera(data.selectViews(views),step_progress,30,&previous,solver);
+        result.iterations += round_progress.iterations;
+    }
+
+    // errors of the rejected views under the final intrinsics
+    std::vector<int>::const_iterator iter = rejected.begin();
+    for(;iter != rejected.end() && !result.canceled;++iter)
+    {
+        cv::Mat rvec,tvec;
+        std::vector<cv::Point2f> projected;
+        const cv::Mat points = data.getImagePoints(*iter);
+        const CameraModel model(result.distortion,result.camera_matrix,result.dist_coeffs);
+        model.solvePose(data.object_points,points,rvec,tvec);
+        model.project(data.object_points,rvec,tvec,projected);
+        result.rejected_ids.push_back(data.image_ids[*iter]);
+        result.rejected_errors.push_back(rmsError(points,projected));
+    }
+    return result;
+}
+
+void qcam_calib::saveCalibration(const std::string &path,const CalibrationResult &result)
+{
+    cv::FileStorage fs(path, cv::FileStorage::WRITE);
+    if(!fs.isOpened())
+        throw std::runtime_error("cannot open " + path);
+    time_t rawtime; time(&rawtime);
+    fs << "calibrationDate" << asctime(localtime(&rawtime));
+    fs << "cameraMatrix" << result.camera_matrix;
+    fs << "distortionModel" << getDistortionModelName(result.distortion);
+    fs << "distCoeffs" << result.dist_coeffs;
+    fs.release();
+}
@@ -0,0 +1,293 @@
+#ifndef QCAMCALIB_CALIBRATION_HPP
+#define QCAMCALIB_CALIBRATION_HPP
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+#include <string>
+
+#include "CameraModel.hpp"
+
+namespace qcam_calib
+{
+    /**
+     * \brief Input of a single camera calibration
+     *
+     * The corners of all views are stored in one contiguous float buffer. The
+     * corners of view i are the rows offsets[i] to offsets[i+1]-1. All views
+     * share the same board model. The solvers get headers on these buffers,
+     * so a solve only allocates one header per view and does not convert or
+     * copy the corners. selectViews copies the corners of the selected views
+     * into a new buffer, which happens once per outlier rejection round.
+     */
+    struct CalibrationData
+    {
+        CalibrationData();
+
+        cv::Mat image_points;           // Nx1 CV_32FC2, the corners of all views
+        cv::Mat object_points;          // Mx1 CV_32FC3, the board model of a single view
+        std::vector<int> offsets;       // first row of each view in image_points followed by N
+        std::vector<int> image_ids;     // id of the image each view was taken from
+        cv::Size image_size;
+        DistortionModel distortion;     // the model which is calibrated
+
+        /**
+         * \brief Allocates the buffer for the given number of views
+         *
+         * \param[in] board The board model
+         * \param[in] views The number of views which are going to be added
+         */
+        void reserve(const std::vector<cv::Point3f> &board,int views);
+
+        /**
+         * \brief Appends the corners of a view, they must match the board model
+         */
+        void addView(int image_id,const std::vector<cv::Point2f> &corners);
+
+        int getViewCount()const;
+
+        /**
+         * \brief Returns the corners of a view as header on the shared buffer
+         */
+        cv::Mat getImagePoints(int view)const;
+
+        /**
+         * \brief Returns one header per view as expected by the OpenCV calibration functions
+         */
+        std::vector<cv::Mat> getImagePointViews()const;
+        std::vector<cv::Mat> getObjectPointViews()const;
+
+        /**
+         * \brief Returns a copy holding only the given views
+         */
+        CalibrationData selectViews(const std::vector<int> &views)const;
+    };
+
+    /**
+     * \brief Output of a single camera calibration
+     */
+    struct CalibrationResult
+    {
+        CalibrationResult();
+
+        cv::Mat camera_matrix;          // 3x3 CV_64FC1
+        cv::Mat dist_coeffs;            // Nx1 CV_64FC1, N and order depend on the distortion model
+        DistortionModel distortion;
+        std::vector<cv::Mat> rvecs;
+        std::vector<cv::Mat> tvecs;
+        std::vector<int> image_ids;     // image id of each view in rvecs and tvecs
+        std::vector<double> view_errors;// rms reprojection error of each view in pixel
+        std::vector<int> rejected_ids;  // images which were dropped as outliers
+        std::vector<double> rejected_errors; // their rms reprojection error in pixel
+        cv::Size image_size;
+        double error;                   // rms reprojection error as returned by cv::calibrateCamera
+        double pixel_error;
+        int iterations;
+        bool canceled;
+        bool warm_started;              // true if the solver started from a previous result
+
+        /**
+         * \brief Returns the pose of the chessboard in the given image
+         *
+         * \return false if the image was not part of the calibration
+         */
+        bool getViewPose(int image_id,cv::Mat &rvec,cv::Mat &tvec)const;
+
+        /**
+         * \brief Returns the rms reprojection error of the chessboard in the given image
+         *
+         * \return -1 if the error is unknown
+         */
+        double getViewError(int image_id)const;
+        bool isRejected(int image_id)const;
+    };
+
+    /**
+     * \brief Parameters of the iterative outlier view rejection
+     *
+     * After each solve all views with a reprojection error above
+     * median + threshold * 1.4826 * MAD are dropped and the remaining views
+     * are solved again, starting from the current result. Views below
+     * min_error are never dropped.
+     */
+    struct OutlierRejection
+    {
+        OutlierRejection();
+
+        bool enabled;
+        double threshold;               // in robust standard deviations
+        double min_error;               // pixel
+        int max_rounds;
+        int min_views;                  // never drop below this number of views
+    };
+
+    // minimal number of chessboards a camera needs to be calibrated
+    static const int MIN_CALIBRATION_CHESSBOARDS = 5;
+
+    /**
+     * \brief Selects the solver of the single camera calibration
+     *
+     * SOLVER_DENSE uses cv::calibrateCamera which builds a dense jacobian over
+     * all view poses. SOLVER_SPARSE eliminates the view poses with the Schur
+     * complement (see calibrateCameraSparse) and scales better to many views.
+     * Both estimate the same parameters.
+     */
+    enum CalibrationSolver
+    {
+        SOLVER_DENSE = 0,
+        SOLVER_SPARSE = 1
+    };
+
+    /**
+     * \brief Receives the progress of a running calibration
+     */
+    class CalibrationProgress
+    {
+        public:
+            virtual ~CalibrationProgress(){};
+
+            /**
+             * \brief Is called after each solver step
+             *
+             * \param[in] iteration The number of Levenberg-Marquardt iterations so far
+             * \param[in] error The current rms reprojection error
+             * \param[in] elapsed The elapsed time in seconds
+             * \return false to cancel the calibration
+             */
+            virtual bool step(int iteration,double error,double elapsed) = 0;
+    };
+
+    /**
+     * \brief Calibrates a pinhole camera with cv::calibrateCamera or the sparse solver
+     *
+     * The distortion model is taken from the data. The dense solver uses
+     * cv::fisheye::calibrate for DISTORTION_FISHEYE and needs OpenCV 3 for
+     * DISTORTION_FISHEYE and DISTORTION_THIN_PRISM, the sparse solver
+     * supports all models.
+     *
+     * If a progress receiver is given, cv::calibrateCamera is run in steps of a few
+     * iterations, each one starting from the previous estimate, so that the progress
+     * can be reported and the calibration can be canceled in between. The steps
+     * use the termination criteria of a single solve and run until the error does
+     * not change any more or max_iterations is reached. Without progress receiver
+     * the solver runs once. The sparse solver reports after each iteration.
+     *
+     * If an initial result for the same image size is given the solver starts
+     * from its intrinsics instead of the default initialization. This is meant
+     * for recalibrating after a few images were added or removed, where the
+     * previous solution is already close to the new one.
+     *
+     * \param[in] data The detected chessboards
+     * \param[in] progress Optional receiver of the progress
+     * \param[in] max_iterations The maximal number of iterations
+     * \param[in] initial Optional previous result used as initial guess
+     * \param[in] solver The solver backend
+     */
+    CalibrationResult calibrateCamera(const CalibrationData &data,CalibrationProgress *progress = NULL,int max_iterations = 30,
+                                      const CalibrationResult *initial = NULL,CalibrationSolver solver = SOLVER_DENSE);
+
+    /**
+     * \brief Selects a subset of views which covers the image and the board poses well
+     *
+     * The views are picked greedily. Each step takes the view which adds the
+     * most uncovered image area, measured on a grid of cells hit by corners,
+     * plus the largest distance to the already selected views in a pose
+     * descriptor (position, scale, rotation and tilt of the board derived
+     * from its homography). No calibration is needed.
+     *
+     * \param[in] data The detected chessboards
+     * \param[in] max_views The maximal number of views
+     * \return The indices of the selected views in ascending order
+     */
+    std::vector<int> selectViewSubset(const CalibrationData &data,int max_views);
+
+    /**
+     * \brief Computes the rms reprojection error of each view in parallel
+     *
+     * \param[in] data The views of the calibration
+     * \param[in] result A calibration of exactly these views
+     */
+    std::vector<double> computeViewErrors(const CalibrationData &data,const CalibrationResult &result);
+
+    /**
+     * \brief Reprojection residuals of all corners aggregated on a grid of square cells
+     */
+    struct ResidualHeatmap
+    {
+        ResidualHeatmap();
+
+        cv::Size image_size;
+        int cell_size;                  // edge length of a cell in pixel
+        cv::Mat errors;                 // CV_32FC1 rms residual of the corners in each cell, 0 if empty
+        cv::Mat counts;                 // CV_32SC1 number of corners in each cell
+        double max_error;               // largest value of errors
+        int corners;                    // number of corners in total
+
+        bool empty()const;
+    };
+
+    /**
+     * \brief Computes the reprojection residual of each corner
+     *
+     * The views are projected in parallel with the kernel of the distortion
+     * model and subtracted from the detected corners with a vectorized
+     * cv::subtract. The views are matched to the result by image id. Views
+     * without a pose in the result, e.g. rejected ones, get NaN.
+     *
+     * \return Residuals (projected - detected) in the order of data.image_points as CV_32FC2
+     */
+    cv::Mat computeResiduals(const CalibrationData &data,const CalibrationResult &result);
+
+    /**
+     * \brief Aggregates the residuals of all corners into an image plane heatmap
+     *
+     * Each corner is assigned to the cell of its detected position.
+     *
+     * \param[in] data The detected chessboards
+     * \param[in] result A calibration of the camera
+     * \param[in] cells The number of cells along the longer image side
+     */
+    ResidualHeatmap computeResidualHeatmap(const CalibrationData &data,const CalibrationResult &result,int cells = 32);
+
+    /**
+     * \brief Remap tables which undistort the images of a calibrated camera
+     *
+     * The maps are read only after their creation and can be shared with
+     * worker threads.
+     */
+    struct UndistortMaps
+    {
+        UndistortMaps();
+
+        int id;                         // unique for each created set of maps, -1 if empty
+        cv::Size image_size;
+        cv::Mat map1;                   // CV_16SC2
+        cv::Mat map2;                   // CV_16UC1
+
+        bool empty()const;
+    };
+
+    /**
+     * \brief Builds the remap tables of a calibration for images of result.image_size
+     *
+     * See CameraModel::initUndistortMaps.
+     */
+    UndistortMaps createUndistortMaps(const CalibrationResult &result);
+
+    /**
+     * \brief Calibrates a camera and iteratively drops outlier views
+     *
+     * Behaves like calibrateCamera if the rejection is disabled. The errors of
+     * dropped views are computed from the final intrinsics and a new pose
+     * estimate and are reported in rejected_errors.
+     */
+    CalibrationResult calibrateCamera(const CalibrationData &data,const OutlierRejection &rejection,
+                                      CalibrationProgress *progress = NULL,const CalibrationResult *initial = NULL,
+                                      CalibrationSolver solver = SOLVER_DENSE);
+
+    /**
+     * \brief Saves camera matrix, distortion model and distortion coefficients as YAML or XML
+     */
+    void saveCalibration(const std::string &path,const CalibrationResult &result);
+}
+
+#endif
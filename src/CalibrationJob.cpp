@@ -0,0 +1,113 @@
+#include "CalibrationJob.hpp"
+
+#include <QtConcurrentRun>
+#include <stdexcept>
+#include <boost/bind.hpp>
+
+using namespace qcam_calib;
+
+CalibrationJob::CalibrationJob(QObject *parent):
+    QObject(parent),
+    camera_id(-1),
+    max_views(0),
+    canceled(0),
+    watcher(NULL)
+{
+    watcher = new QFutureWatcher<CalibrationResult>(this);
+    connect(watcher,SIGNAL(finished()),SLOT(calibrationFinished()));
+}
+
+CalibrationJob::~CalibrationJob()
+{
+    cancel();
+    watcher->waitForFinished();
+}
+
+CalibrationResult CalibrationJob::run(CalibrationJob *job,DatasetPtr dataset,int camera_id,int cols,int rows,float dx,float dy,bool warm_start)
+{
+    try
+    {
+        CameraDataPtr camera = dataset->getCamera(camera_id);
+        const CalibrationResult *initial = warm_start ? camera->calibration.get() : NULL;
+        CalibrationResult result = calibrateCamera(createCalibrationData(*camera,cols,rows,dx,dy,job->max_views),job->rejection,job,initial,
+                                                   camera->solver);
+        if(!result.canceled)
+            dataset->setCalibration(camera_id,result);
+        return result;
+    }
+    catch(const std::exception &e)
+    {
+        job->error = e.what();
+    }
+    return CalibrationResult();
+}
+
+void CalibrationJob::start(const DatasetPtr &dataset,int camera_id,int cols,int rows,float dx,float dy,bool warm_start)
+{
+    if(isRunning())
+        throw std::runtime_error("CalibrationJob: calibration is already running");
+    this->camera_id = camera_id;
+    error.clear();
+    canceled = 0;
+    watcher->setFuture(QtConcurrent::run(boost::bind(CalibrationJob::run,this,dataset,camera_id,cols,rows,dx,dy,warm_start)));
+}
+
+bool CalibrationJob::isRunning()const
+{
+    return watcher->isRunning();
+}
+
+int CalibrationJob::getCameraId()const
+{
+    return camera_id;
+}
+
+void CalibrationJob::setOutlierRejection(const OutlierRejection &rejection)
+{
+    if(isRunning())
+        throw std::runtime_error("CalibrationJob: cannot change the outlier rejection while running");
+    this->rejection = rejection;
+}
+
+OutlierRejection CalibrationJob::getOutlierRejection()const
+{
+    return rejection;
+}
+
+void CalibrationJob::setMaxViews(int max_views)
+{
+    if(isRunning())
+        throw std::runtime_error("CalibrationJob: cannot change the number of views while running");
+    this->max_views = max_views;
+}
+
+int CalibrationJob::getMaxViews()const
+{
+    return max_views;
+}
+
+CalibrationResult CalibrationJob::getResult()const
+{
+    return watcher->result();
+}
+
+QString CalibrationJob::getError()const
+{
+    return error;
+}
+
+bool CalibrationJob::step(int iteration,double error,double elapsed)
+{
+    emit progress(iteration,error,elapsed);
+    return canceled == 0;
+}
+
+void CalibrationJob::cancel()
+{
+    canceled = 1;
+}
+
+void CalibrationJob::calibrationFinished()
+{
+    emit finished(camera_id);
+}
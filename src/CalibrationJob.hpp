@@ -0,0 +1,97 @@
+#ifndef QCAMCALIB_CALIBRATION_JOB_HPP
+#define QCAMCALIB_CALIBRATION_JOB_HPP
+
+#include <QObject>
+#include <QFutureWatcher>
+#include <QAtomicInt>
+#include <QString>
+
+#include "Calibration.hpp"
+#include "Dataset.hpp"
+
+namespace qcam_calib
+{
+    /**
+     * \brief Runs a camera calibration in the background
+     *
+     * The job works on a snapshot of the camera taken from the Dataset and
+     * stores the result back into the Dataset, so it never touches the item model.
+     * The progress is reported through the progress signal which is delivered
+     * to the thread owning the job. The job can be canceled at any time, the
+     * calibration then stops after the current solver step.
+     */
+    class CalibrationJob : public QObject, public CalibrationProgress
+    {
+        Q_OBJECT
+        public:
+            CalibrationJob(QObject *parent = 0);
+            virtual ~CalibrationJob();
+
+            /**
+             * \brief Starts the calibration
+             *
+             * \param[in] dataset The dataset holding the camera
+             * \param[in] camera_id The id of the calibrated camera which is passed through to finished
+             * \param[in] cols The number of inner chessboard corners per row
+             * \param[in] rows The number of inner chessboard corners per column
+             * \param[in] dx The width of a chessboard cell
+             * \param[in] dy The height of a chessboard cell
+             * \param[in] warm_start Starts from the current calibration of the camera if there is one
+             */
+            void start(const DatasetPtr &dataset,int camera_id,int cols,int rows,float dx,float dy,bool warm_start=true);
+            bool isRunning()const;
+            int getCameraId()const;
+
+            /**
+             * \brief Sets the outlier view rejection used by the next calibrations (disabled by default)
+             */
+            void setOutlierRejection(const OutlierRejection &rejection);
+            OutlierRejection getOutlierRejection()const;
+
+            /**
+             * \brief Limits the number of views used by the next calibrations
+             *
+             * \param[in] max_views The size of the subset picked by selectViewSubset, 0 uses all views
+             */
+            void setMaxViews(int max_views);
+            int getMaxViews()const;
+
+            /**
+             * \brief Returns the result of the last calibration
+             *
+             * \note The result is also stored in the Dataset unless the calibration was canceled
+             */
+            CalibrationResult getResult()const;
+
+            /**
+             * \brief Returns the error message if the last calibration failed
+             */
+            QString getError()const;
+
+            // CalibrationProgress interface, called from the worker thread
+            virtual bool step(int iteration,double error,double elapsed);
+
+        public slots:
+            void cancel();
+
+        signals:
+            void progress(int iteration,double error,double elapsed);
+            void finished(int camera_id);
+
+        private slots:
+            void calibrationFinished();
+
+        private:
+            static CalibrationResult run(CalibrationJob *job,DatasetPtr dataset,int camera_id,int cols,int rows,float dx,float dy,bool warm_start);
+
+        private:
+            int camera_id;
+            OutlierRejection rejection;
+            int max_views;
+            QString error;
+            QAtomicInt canceled;
+            QFutureWatcher<CalibrationResult> *watcher;
+    };
+}
+
+#endif
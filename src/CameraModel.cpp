@@ -0,0 +1,533 @@
+#include "CameraModel.hpp"
+
+#include <opencv2/core/version.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace qcam_calib;
+
+static const char *PINHOLE_COEFF_NAMES[] = {"k1","k2","p1","p2","k3","k4","k5","k6","s1","s2","s3","s4"};
+static const char *FISHEYE_COEFF_NAMES[] = {"k1","k2","k3","k4"};
+static const char *MODEL_NAMES[DISTORTION_MODEL_COUNT] = {"radial_tangential","rational","thin_prism","fisheye"};
+
+// iterations used to invert the distortion
+static const int MAX_UNDISTORT_ITERATIONS = 20;
+
+// below this distance to the optical axis the fisheye model is the identity
+static const double FISHEYE_EPSILON = 1e-8;
+
+/**
+ * Radial and tangential distortion of cv::projectPoints with N = 4, 8 or 12
+ * coefficients. The conditions on N are resolved at compile time.
+ *
+ * distort maps the normalized point (x,y) to (u,v). dxy receives
+ * d(u,v)/d(x,y) as 2x2 and dk d(u,v)/d(coefficients) as 2xN, both row major.
+ */
+template<int N>
+struct PinholeDistortion
+{
+    enum { COEFFS = N };
+
+    static inline void distort(const double *k,double x,double y,double &u,double &v,double *dxy,double *dk)
+    {
+        const double r2 = x*x+y*y;
+        const double r4 = r2*r2;
+        const double r6 = r4*r2;
+        double a = 1+k[0]*r2+k[1]*r4;
+        double b = 1;
+        double da = k[0]+2*k[1]*r2;     // derivatives by r2
+        double db = 0;
+        if(N > 4)
+        {
+            a += k[4]*r6;
+            b += k[5]*r2+k[6]*r4+k[7]*r6;
+            da += 3*k[4]*r4;
+            db = k[5]+2*k[6]*r2+3*k[7]*r4;
+        }
+        const double b_inv = 1/b;
+        const double radial = a*b_inv;
+        const double dradial = (da-radial*db)*b_inv;
+        const double xy = x*y;
+        u = x*radial+2*k[2]*xy+k[3]*(r2+2*x*x);
+        v = y*radial+k[2]*(r2+2*y*y)+2*k[3]*xy;
+        double dux = radial+2*x*x*dradial+2*k[2]*y+6*k[3]*x;
+        double duy = 2*xy*dradial+2*k[2]*x+2*k[3]*y;
+        double dvx = duy;
+        double dvy = radial+2*y*y*dradial+6*k[2]*y+2*k[3]*x;
+        if(N > 8)
+        {
+            u += k[8]*r2+k[9]*r4;
+            v += k[10]*r2+k[11]*r4;
+            const double dsu = k[8]+2*k[9]*r2;
+            const double dsv = k[10]+2*k[11]*r2;
+            dux += 2*x*dsu;
+            duy += 2*y*dsu;
+            dvx += 2*x*dsv;
+            dvy += 2*y*dsv;
+        }
+        if(dxy)
+        {
+            dxy[0] = dux;
+            dxy[1] = duy;
+            dxy[2] = dvx;
+            dxy[3] = dvy;
+        }
+        if(dk)
+        {
+            double *du = dk;
+            double *dv = dk+N;
+            du[0] = x*r2*b_inv; dv[0] = y*r2*b_inv;
+            du[1] = x*r4*b_inv; dv[1] = y*r4*b_inv;
+            du[2] = 2*xy;       dv[2] = r2+2*y*y;
+            du[3] = r2+2*x*x;   dv[3] = 2*xy;
+            if(N > 4)
+            {
+                const double c = -radial*b_inv;
+                du[4] = x*r6*b_inv; dv[4] = y*r6*b_inv;
+                du[5] = x*c*r2;     dv[5] = y*c*r2;
+                du[6] = x*c*r4;     dv[6] = y*c*r4;
+                du[7] = x*c*r6;     dv[7] = y*c*r6;
+            }
+            if(N > 8)
+            {
+                du[8] = r2;  dv[8] = 0;
+                du[9] = r4;  dv[9] = 0;
+                du[10] = 0;  dv[10] = r2;
+                du[11] = 0;  dv[11] = r4;
+            }
+        }
+    }
+    // distortion of a block of points without derivatives, the loop has no
+    // branches and is auto-vectorized by the compiler
+    static inline void distort(const double *k,const double *x,const double *y,double *u,double *v,int count)
+    {
+        const double k0 = k[0], k1 = k[1], k2 = k[2], k3 = k[3];
+        const double k4 = N > 4 ? k[4] : 0, k5 = N > 4 ? k[5] : 0, k6 = N > 4 ? k[6] : 0, k7 = N > 4 ? k[7] : 0;
+        const double k8 = N > 8 ? k[8] : 0, k9 = N > 8 ? k[9] : 0, k10 = N > 8 ? k[10] : 0, k11 = N > 8 ? k[11] : 0;
+        for(int i=0;i < count;++i)
+        {
+            const double xi = x[i];
+            const double yi = y[i];
+            const double r2 = xi*xi+yi*yi;
+            const double r4 = r2*r2;
+            const double r6 = r4*r2;
+            const double xy = xi*yi;
+            double radial = 1+k0*r2+k1*r4;
+            if(N > 4)
+                radial = (radial+k4*r6)/(1+k5*r2+k6*r4+k7*r6);
+            double ui = xi*radial+2*k2*xy+k3*(r2+2*xi*xi);
+            double vi = yi*radial+k2*(r2+2*yi*yi)+2*k3*xy;
+            if(N > 8)
+            {
+                ui += k8*r2+k9*r4;
+                vi += k10*r2+k11*r4;
+            }
+            u[i] = ui;
+            v[i] = vi;
+        }
+    }
+};
+
+/**
+ * Equidistant fisheye distortion of cv::fisheye,
+ * theta_d = theta*(1+k1*theta^2+k2*theta^4+k3*theta^6+k4*theta^8)
+ */
+struct FisheyeDistortion
+{
+    enum { COEFFS = 4 };
+
+    static inline void distort(const double *k,double x,double y,double &u,double &v,double *dxy,double *dk)
+    {
+        const double r2 = x*x+y*y;
+        const double r = std::sqrt(r2);
+        const double theta = std::atan(r);
+        const double t2 = theta*theta;
+        const double t4 = t2*t2;
+        const double t6 = t4*t2;
+        const double t8 = t4*t4;
+        const double theta_d = theta*(1+k[0]*t2+k[1]*t4+k[2]*t6+k[3]*t8);
+        const bool on_axis = r < FISHEYE_EPSILON;
+        const double scale = on_axis ? 1 : theta_d/r;
+        u = x*scale;
+        v = y*scale;
+        if(dxy)
+        {
+            // derivative of the scale by r divided by r
+            double dscale = 0;
+            if(!on_axis)
+            {
+                const double dtheta_d = (1+3*k[0]*t2+5*k[1]*t4+7*k[2]*t6+9*k[3]*t8)/(1+r2);
+                dscale = (dtheta_d-scale)/r2;
+            }
+            dxy[0] = scale+x*x*dscale;
+            dxy[1] = x*y*dscale;
+            dxy[2] = dxy[1];
+            dxy[3] = scale+y*y*dscale;
+        }
+        if(dk)
+        {
+            const double f = on_axis ? 1 : theta/r;
+            const double t[4] = {t2,t4,t6,t8};
+            for(int i=0;i < 4;++i)
+            {
+                dk[i] = x*f*t[i];
+                dk[4+i] = y*f*t[i];
+            }
+        }
+    }
+    // atan is not vectorized, the block is distorted point by point
+    static inline void distort(const double *k,const double *x,const double *y,double *u,double *v,int count)
+    {
+        for(int i=0;i < count;++i)
+            distort(k,x[i],y[i],u[i],v[i],NULL,NULL);
+    }
+};
+
+// number of points which are transformed and distorted at once
+static const int PROJECTION_BLOCK = 64;
+
+/**
+ * Projection without jacobian. The points are processed in blocks stored as
+ * structure of arrays, so the transformation and the distortion are
+ * separate loops over contiguous doubles the compiler vectorizes.
+ */
+template<class Distortion>
+static void projectPointsBlocked(const double *k,double fx,double fy,double cx,double cy,
+                                 const cv::Point3f *points,int count,const double *R,const double *T,
+                                 std::vector<cv::Point2f> &image_points)
+{
+    // the pose is copied to locals, otherwise the compiler assumes it aliases the blocks
+    const double r0 = R[0], r1 = R[1], r2 = R[2], r3 = R[3], r4 = R[4], r5 = R[5], r6 = R[6], r7 = R[7], r8 = R[8];
+    const double t0 = T[0], t1 = T[1], t2 = T[2];
+    double x[PROJECTION_BLOCK],y[PROJECTION_BLOCK],u[PROJECTION_BLOCK],v[PROJECTION_BLOCK];
+    for(int start=0;start < count;start += PROJECTION_BLOCK)
+    {
+        const cv::Point3f *p = points+start;
+        const int size = std::min(PROJECTION_BLOCK,count-start);
+        for(int i=0;i < size;++i)
+        {
+            const double px = p[i].x, py = p[i].y, pz = p[i].z;
+            const double z_inv = 1/(r6*px+r7*py+r8*pz+t2);
+            x[i] = (r0*px+r1*py+r2*pz+t0)*z_inv;
+            y[i] = (r3*px+r4*py+r5*pz+t1)*z_inv;
+        }
+        Distortion::distort(k,x,y,u,v,size);
+        cv::Point2f *result = &image_points[start];
+        for(int i=0;i < size;++i)
+            result[i] = cv::Point2f(float(fx*u[i]+cx),float(fy*v[i]+cy));
+    }
+}
+
+template<class Distortion>
+static void projectPoints(const double *k,double fx,double fy,double cx,double cy,
+                          const cv::Mat &object_points,const cv::Mat &rvec,const cv::Mat &tvec,
+                          std::vector<cv::Point2f> &image_points,cv::Mat *jacobian)
+{
+    const int N = Distortion::COEFFS;
+    const int count = object_points.checkVector(3,CV_32F);
+    if(count < 0)
+        throw std::runtime_error("CameraModel: the object points must be CV_32FC3");
+
+    // poses might be given as 3x1, 1x3 or 1x1 CV_64FC3
+    cv::Mat r,t,rotation,drotation;
+    rvec.reshape(1,3).convertTo(r,CV_64F);
+    tvec.reshape(1,3).convertTo(t,CV_64F);
+    if(jacobian)
+        cv::Rodrigues(r,rotation,drotation);
+    else
+        cv::Rodrigues(r,rotation);
+    const double *R = rotation.ptr<double>();
+    const double *T = t.ptr<double>();
+
+    const cv::Point3f *points = object_points.ptr<cv::Point3f>();
+    image_points.resize(count);
+    if(!jacobian)
+    {
+        projectPointsBlocked<Distortion>(k,fx,fy,cx,cy,points,count,R,T,image_points);
+        return;
+    }
+    jacobian->create(2*count,10+N,CV_64FC1);
+    double dxy[4];
+    double dk[2*N];
+    for(int i=0;i < count;++i)
+    {
+        const cv::Point3f &p = points[i];
+        const double X = R[0]*p.x+R[1]*p.y+R[2]*p.z+T[0];
+        const double Y = R[3]*p.x+R[4]*p.y+R[5]*p.z+T[1];
+        const double Z = R[6]*p.x+R[7]*p.y+R[8]*p.z+T[2];
+        const double z_inv = 1/Z;
+        const double x = X*z_inv;
+        const double y = Y*z_inv;
+        double u,v;
+        Distortion::distort(k,x,y,u,v,dxy,dk);
+        image_points[i] = cv::Point2f(float(fx*u+cx),float(fy*v+cy));
+
+        // pixel by camera point
+        const double dx[3] = {z_inv,0,-x*z_inv};
+        const double dy[3] = {0,z_inv,-y*z_inv};
+        double dpx[3],dpy[3];
+        for(int j=0;j < 3;++j)
+        {
+            dpx[j] = fx*(dxy[0]*dx[j]+dxy[1]*dy[j]);
+            dpy[j] = fy*(dxy[2]*dx[j]+dxy[3]*dy[j]);
+        }
+        double *jx = jacobian->ptr<double>(2*i);
+        double *jy = jacobian->ptr<double>(2*i+1);
+        for(int j=0;j < 3;++j)
+        {
+            // row j of the Rodrigues jacobian is dR/dr_j in row major order
+            const double *d = drotation.ptr<double>(j);
+            const double dX = d[0]*p.x+d[1]*p.y+d[2]*p.z;
+            const double dY = d[3]*p.x+d[4]*p.y+d[5]*p.z;
+            const double dZ = d[6]*p.x+d[7]*p.y+d[8]*p.z;
+            jx[j] = dpx[0]*dX+dpx[1]*dY+dpx[2]*dZ;
+            jy[j] = dpy[0]*dX+dpy[1]*dY+dpy[2]*dZ;
+            jx[3+j] = dpx[j];
+            jy[3+j] = dpy[j];
+        }
+        jx[6] = u; jx[7] = 0; jx[8] = 1; jx[9] = 0;
+        jy[6] = 0; jy[7] = v; jy[8] = 0; jy[9] = 1;
+        for(int j=0;j < N;++j)
+        {
+            jx[10+j] = fx*dk[j];
+            jy[10+j] = fy*dk[N+j];
+        }
+    }
+}
+
+template<class Distortion>
+static void normalizePoints(const double *k,double fx,double fy,double cx,double cy,
+                            const cv::Mat &image_points,std::vector<cv::Point2f> &normalized)
+{
+    const int count = image_points.checkVector(2,CV_32F);
+    if(count < 0)
+        throw std::runtime_error("CameraModel: the image points must be CV_32FC2");
+    const cv::Point2f *points = image_points.ptr<cv::Point2f>();
+    normalized.resize(count);
+    double dxy[4];
+    for(int i=0;i < count;++i)
+    {
+        // Gauss-Newton starting from the distorted point
+        const double ud = (points[i].x-cx)/fx;
+        const double vd = (points[i].y-cy)/fy;
+        double x = ud;
+        double y = vd;
+        for(int iteration=0;iteration < MAX_UNDISTORT_ITERATIONS;++iteration)
+        {
+            double u,v;
+            Distortion::distort(k,x,y,u,v,dxy,NULL);
+            const double eu = u-ud;
+            const double ev = v-vd;
+            const double det = dxy[0]*dxy[3]-dxy[1]*dxy[2];
+            if(eu*eu+ev*ev < 1e-24 || std::fabs(det) < 1e-12)
+                break;
+            x -= (dxy[3]*eu-dxy[1]*ev)/det;
+            y -= (dxy[0]*ev-dxy[2]*eu)/det;
+        }
+        normalized[i] = cv::Point2f(float(x),float(y));
+    }
+}
+
+// source pixel of each undistorted pixel, the undistorted image has the same camera matrix
+template<class Distortion>
+static void distortMap(const double *k,double fx,double fy,double cx,double cy,cv::Mat &map_x,cv::Mat &map_y)
+{
+    for(int row=0;row < map_x.rows;++row)
+    {
+        float *px = map_x.ptr<float>(row);
+        float *py = map_y.ptr<float>(row);
+        const double y = (row-cy)/fy;
+        for(int col=0;col < map_x.cols;++col)
+        {
+            double u,v;
+            Distortion::distort(k,(col-cx)/fx,y,u,v,NULL,NULL);
+            px[col] = float(fx*u+cx);
+            py[col] = float(fy*v+cy);
+        }
+    }
+}
+
+int qcam_calib::getDistortionCoeffCount(DistortionModel model)
+{
+    switch(model)
+    {
+    case DISTORTION_RADIAL_TANGENTIAL:
+        return PinholeDistortion<4>::COEFFS;
+    case DISTORTION_RATIONAL:
+        return PinholeDistortion<8>::COEFFS;
+    case DISTORTION_THIN_PRISM:
+        return PinholeDistortion<12>::COEFFS;
+    case DISTORTION_FISHEYE:
+        return FisheyeDistortion::COEFFS;
+    default:
+        throw std::runtime_error("unknown distortion model");
+    }
+}
+
+const char *qcam_calib::getDistortionCoeffName(DistortionModel model,int index)
+{
+    if(index < 0 || index >= getDistortionCoeffCount(model))
+        throw std::runtime_error("invalid distortion coefficient");
+    return model == DISTORTION_FISHEYE ? FISHEYE_COEFF_NAMES[index] : PINHOLE_COEFF_NAMES[index];
+}
+
+const char *qcam_calib::getDistortionModelName(DistortionModel model)
+{
+    if(model < 0 || model >= DISTORTION_MODEL_COUNT)
+        throw std::runtime_error("unknown distortion model");
+    return MODEL_NAMES[model];
+}
+
+bool qcam_calib::findDistortionModel(const std::string &name,DistortionModel &model)
+{
+    for(int i=0;i < DISTORTION_MODEL_COUNT;++i)
+    {
+        if(name == MODEL_NAMES[i])
+        {
+            model = static_cast<DistortionModel>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+CameraModel::CameraModel(DistortionModel model,const cv::Mat &camera_matrix,const cv::Mat &dist_coeffs):
+    model(model)
+{
+    if(int(dist_coeffs.total()) != getDistortionCoeffCount(model))
+        throw std::runtime_error("CameraModel: the distortion coefficients do not match the model");
+    cv::Mat k,dist;
+    camera_matrix.convertTo(k,CV_64F);
+    dist_coeffs.reshape(1,dist_coeffs.total()).convertTo(dist,CV_64F);
+    fx = k.at<double>(0,0);
+    fy = k.at<double>(1,1);
+    cx = k.at<double>(0,2);
+    cy = k.at<double>(1,2);
+    coeffs.assign(dist.ptr<double>(),dist.ptr<double>()+dist.total());
+}
+
+CameraModel::CameraModel(DistortionModel model,const std::vector<double> &intrinsics):
+    model(model)
+{
+    if(int(intrinsics.size()) != 4+getDistortionCoeffCount(model))
+        throw std::runtime_error("CameraModel: the distortion coefficients do not match the model");
+    fx = intrinsics[0];
+    fy = intrinsics[1];
+    cx = intrinsics[2];
+    cy = intrinsics[3];
+    coeffs.assign(intrinsics.begin()+4,intrinsics.end());
+}
+
+DistortionModel CameraModel::getDistortionModel()const
+{
+    return model;
+}
+
+cv::Mat CameraModel::getCameraMatrix()const
+{
+    return (cv::Mat_<double>(3,3) << fx,0,cx,0,fy,cy,0,0,1);
+}
+
+cv::Mat CameraModel::getDistCoeffs()const
+{
+    return cv::Mat(coeffs,true);
+}
+
+void CameraModel::project(const cv::Mat &object_points,const cv::Mat &rvec,const cv::Mat &tvec,
+                          std::vector<cv::Point2f> &image_points,cv::Mat *jacobian)const
+{
+    const double *k = &coeffs[0];
+    switch(model)
+    {
+    case DISTORTION_RADIAL_TANGENTIAL:
+        projectPoints<PinholeDistortion<4> >(k,fx,fy,cx,cy,object_points,rvec,tvec,image_points,jacobian);
+        break;
+    case DISTORTION_RATIONAL:
+        projectPoints<PinholeDistortion<8> >(k,fx,fy,cx,cy,object_points,rvec,tvec,image_points,jacobian);
+        break;
+    case DISTORTION_THIN_PRISM:
+        projectPoints<PinholeDistortion<12> >(k,fx,fy,cx,cy,object_points,rvec,tvec,image_points,jacobian);
+        break;
+    case DISTORTION_FISHEYE:
+        projectPoints<FisheyeDistortion>(k,fx,fy,cx,cy,object_points,rvec,tvec,image_points,jacobian);
+        break;
+    default:
+        throw std::runtime_error("unknown distortion model");
+    }
+}
+
+void CameraModel::normalize(const cv::Mat &image_points,std::vector<cv::Point2f> &normalized)const
+{
+    const double *k = &coeffs[0];
+    switch(model)
+    {
+    case DISTORTION_RADIAL_TANGENTIAL:
+        normalizePoints<PinholeDistortion<4> >(k,fx,fy,cx,cy,image_points,normalized);
+        break;
+    case DISTORTION_RATIONAL:
+        normalizePoints<PinholeDistortion<8> >(k,fx,fy,cx,cy,image_points,normalized);
+        break;
+    case DISTORTION_THIN_PRISM:
+        normalizePoints<PinholeDistortion<12> >(k,fx,fy,cx,cy,image_points,normalized);
+        break;
+    case DISTORTION_FISHEYE:
+        normalizePoints<FisheyeDistortion>(k,fx,fy,cx,cy,image_points,normalized);
+        break;
+    default:
+        throw std::runtime_error("unknown distortion model");
+    }
+}
+
+void CameraModel::initUndistortMaps(const cv::Size &size,cv::Mat &map1,cv::Mat &map2)const
+{
+    const cv::Mat camera_matrix = getCameraMatrix();
+    const cv::Mat dist_coeffs = getDistCoeffs();
+    switch(model)
+    {
+    case DISTORTION_RADIAL_TANGENTIAL:
+    case DISTORTION_RATIONAL:
+#if CV_MAJOR_VERSION >= 3
+    case DISTORTION_THIN_PRISM:
+#endif
+        cv::initUndistortRectifyMap(camera_matrix,dist_coeffs,cv::Mat(),camera_matrix,size,CV_16SC2,map1,map2);
+        return;
+#if CV_MAJOR_VERSION >= 3
+    case DISTORTION_FISHEYE:
+        cv::fisheye::initUndistortRectifyMap(camera_matrix,dist_coeffs,cv::Mat::eye(3,3,CV_64FC1),camera_matrix,size,CV_16SC2,map1,map2);
+        return;
+#endif
+    default:
+        break;
+    }
+
+    // models which are not supported by this OpenCV version use the kernels
+    cv::Mat map_x(size,CV_32FC1);
+    cv::Mat map_y(size,CV_32FC1);
+    const double *k = &coeffs[0];
+    switch(model)
+    {
+    case DISTORTION_THIN_PRISM:
+        distortMap<PinholeDistortion<12> >(k,fx,fy,cx,cy,map_x,map_y);
+        break;
+    case DISTORTION_FISHEYE:
+        distortMap<FisheyeDistortion>(k,fx,fy,cx,cy,map_x,map_y);
+        break;
+    default:
+        throw std::runtime_error("unknown distortion model");
+    }
+    cv::convertMaps(map_x,map_y,map1,map2,CV_16SC2);
+}
+
+void CameraModel::solvePose(const cv::Mat &object_points,const cv::Mat &image_points,cv::Mat &rvec,cv::Mat &tvec)const
+{
+    // the pose of the undistorted points seen by an ideal camera
+    std::vector<cv::Point2f> normalized;
+    normalize(image_points,normalized);
+    cv::solvePnP(object_points,cv::Mat(normalized),cv::Mat::eye(3,3,CV_64FC1),cv::Mat(),rvec,tvec);
+    rvec.convertTo(rvec,CV_64F);
+    tvec.convertTo(tvec,CV_64F);
+}
@@ -0,0 +1,123 @@
+#ifndef QCAMCALIB_CAMERA_MODEL_HPP
+#define QCAMCALIB_CAMERA_MODEL_HPP
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+#include <string>
+
+namespace qcam_calib
+{
+    /**
+     * \brief The lens distortion model of a camera
+     *
+     * The coefficients of the first three models use the OpenCV order and
+     * are a prefix of each other (k1,k2,p1,p2,k3,k4,k5,k6,s1,s2,s3,s4).
+     * DISTORTION_FISHEYE is the equidistant model of cv::fisheye (k1,k2,k3,k4).
+     */
+    enum DistortionModel
+    {
+        DISTORTION_RADIAL_TANGENTIAL = 0,   // 4 coefficients
+        DISTORTION_RATIONAL = 1,            // 8 coefficients
+        DISTORTION_THIN_PRISM = 2,          // 12 coefficients
+        DISTORTION_FISHEYE = 3              // 4 coefficients
+    };
+    static const int DISTORTION_MODEL_COUNT = 4;
+
+    int getDistortionCoeffCount(DistortionModel model);
+
+    /**
+     * \brief Returns the name of a coefficient, e.g. "k1" or "s3"
+     */
+    const char *getDistortionCoeffName(DistortionModel model,int index);
+
+    /**
+     * \brief Returns the name of the model as written to parameter files
+     */
+    const char *getDistortionModelName(DistortionModel model);
+
+    /**
+     * \brief Looks up a model by the name returned by getDistortionModelName
+     *
+     * \return false if the name is unknown
+     */
+    bool findDistortionModel(const std::string &name,DistortionModel &model);
+
+    /**
+     * \brief Pinhole camera with lens distortion
+     *
+     * The projection and its derivatives are computed by kernels which are
+     * specialized at compile time for each distortion model, so the inner
+     * loops over the corners have a fixed number of coefficients and no
+     * branches on the model. Unlike cv::projectPoints this also covers the
+     * fisheye model, which lets all calibration code share one code path.
+     * Projections without jacobian are computed in blocks of points stored as
+     * structure of arrays, which lets the compiler vectorize the pinhole models.
+     */
+    class CameraModel
+    {
+        public:
+            /**
+             * \param[in] model The distortion model
+             * \param[in] camera_matrix The 3x3 camera matrix
+             * \param[in] dist_coeffs The getDistortionCoeffCount(model) coefficients
+             */
+            CameraModel(DistortionModel model,const cv::Mat &camera_matrix,const cv::Mat &dist_coeffs);
+
+            /**
+             * \param[in] intrinsics fx, fy, cx, cy followed by the distortion coefficients
+             */
+            CameraModel(DistortionModel model,const std::vector<double> &intrinsics);
+
+            DistortionModel getDistortionModel()const;
+            cv::Mat getCameraMatrix()const;
+            cv::Mat getDistCoeffs()const;
+
+            /**
+             * \brief Projects 3D points into the image
+             *
+             * The jacobian has the layout of cv::projectPoints: two rows per
+             * point (x,y) and the columns rvec, tvec, fx, fy, cx, cy and the
+             * distortion coefficients.
+             *
+             * \param[in] object_points Nx1 CV_32FC3 points
+             * \param[in] rvec The rotation vector of the object
+             * \param[in] tvec The translation of the object
+             * \param[out] image_points The projected points
+             * \param[out] jacobian Optional 2Nx(10+coefficients) CV_64FC1 jacobian
+             */
+            void project(const cv::Mat &object_points,const cv::Mat &rvec,const cv::Mat &tvec,
+                         std::vector<cv::Point2f> &image_points,cv::Mat *jacobian = NULL)const;
+
+            /**
+             * \brief Removes the distortion and returns normalized image coordinates
+             *
+             * The distortion is inverted iteratively with the jacobian of the kernel.
+             */
+            void normalize(const cv::Mat &image_points,std::vector<cv::Point2f> &normalized)const;
+
+            /**
+             * \brief Estimates the pose of a planar object from its projection
+             */
+            void solvePose(const cv::Mat &object_points,const cv::Mat &image_points,cv::Mat &rvec,cv::Mat &tvec)const;
+
+            /**
+             * \brief Computes fixed point remap tables which undistort images of the camera
+             *
+             * The undistorted image keeps the camera matrix. The maps are built
+             * with cv::initUndistortRectifyMap or cv::fisheye::initUndistortRectifyMap
+             * if OpenCV supports the model, otherwise with the kernels.
+             *
+             * \param[in] size The image size
+             * \param[out] map1 CV_16SC2 integer source positions for cv::remap
+             * \param[out] map2 CV_16UC1 interpolation table indices for cv::remap
+             */
+            void initUndistortMaps(const cv::Size &size,cv::Mat &map1,cv::Mat &map2)const;
+
+        private:
+            DistortionModel model;
+            double fx,fy,cx,cy;
+            std::vector<double> coeffs;
+    };
+}
+
+#endif
@@ -0,0 +1,117 @@
+#include "ChessboardDetector.hpp"
+#include "Profiler.hpp"
+
+#include <opencv2/core/version.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+#include <stdexcept>
+
+using namespace qcam_calib;
+
+DetectorSettings::DetectorSettings(DetectionMode mode):
+    engine(DETECTOR_CLASSIC),
+    flags(getDefaultFlags(DETECTOR_CLASSIC)),
+    mode(mode)
+{
+}
+
+DetectorSettings::DetectorSettings(DetectorEngine engine,int flags,DetectionMode mode):
+    engine(engine),
+    flags(flags),
+    mode(mode)
+{
+}
+
+int DetectorSettings::getDefaultFlags(DetectorEngine engine)
+{
+    switch(engine)
+    {
+    case DETECTOR_CLASSIC:
+        return cv::CALIB_CB_ADAPTIVE_THRESH + cv::CALIB_CB_NORMALIZE_IMAGE + cv::CALIB_CB_FAST_CHECK;
+    case DETECTOR_SECTOR_BASED:
+        return cv::CALIB_CB_NORMALIZE_IMAGE;
+    default:
+        throw std::runtime_error("unknown chessboard detector");
+    }
+}
+
+QString DetectorSettings::toString()const
+{
+    // the classic engine keeps the old name, so existing cache entries stay valid
+    if(engine == DETECTOR_CLASSIC && flags == getDefaultFlags(DETECTOR_CLASSIC))
+        return QString("m%1").arg(int(mode));
+    return QString("m%1_e%2_f%3").arg(int(mode)).arg(int(engine)).arg(flags);
+}
+
+bool DetectorSettings::operator==(const DetectorSettings &other)const
+{
+    return engine == other.engine && flags == other.flags && mode == other.mode;
+}
+
+bool DetectorSettings::operator!=(const DetectorSettings &other)const
+{
+    return !(*this == other);
+}
+
+ChessboardDetectorPtr ChessboardDetector::create(const DetectorSettings &settings)
+{
+    if(!isAvailable(settings.engine))
+        throw std::runtime_error("the selected chessboard detector requires OpenCV 4");
+    switch(settings.engine)
+    {
+    case DETECTOR_CLASSIC:
+        return ChessboardDetectorPtr(new ClassicDetector(settings.flags));
+    case DETECTOR_SECTOR_BASED:
+        return ChessboardDetectorPtr(new SectorDetector(settings.flags));
+    default:
+        throw std::runtime_error("unknown chessboard detector");
+    }
+}
+
+bool ChessboardDetector::isAvailable(DetectorEngine engine)
+{
+    switch(engine)
+    {
+    case DETECTOR_CLASSIC:
+        return true;
+    case DETECTOR_SECTOR_BASED:
+#if CV_MAJOR_VERSION >= 4
+        return true;
+#else
+        return false;
+#endif
+    default:
+        return false;
+    }
+}
+
+ClassicDetector::ClassicDetector(int flags):
+    flags(flags)
+{
+}
+
+bool ClassicDetector::find(const cv::Mat &gray,const cv::Size &board_size,std::vector<cv::Point2f> &corners)const
+{
+    ScopedProfile profile("findChessboardCorners");
+    if(cv::findChessboardCorners(gray,board_size,corners,flags))
+        return true;
+    corners.clear();
+    return false;
+}
+
+SectorDetector::SectorDetector(int flags):
+    flags(flags)
+{
+}
+
+bool SectorDetector::find(const cv::Mat &gray,const cv::Size &board_size,std::vector<cv::Point2f> &corners)const
+{
+#if CV_MAJOR_VERSION >= 4
+    ScopedProfile profile("findChessboardCornersSB");
+    if(cv::findChessboardCornersSB(gray,board_size,corners,flags))
+        return true;
+    corners.clear();
+    return false;
+#else
+    throw std::runtime_error("findChessboardCornersSB requires OpenCV 4");
+#endif
+}
@@ -0,0 +1,130 @@
+#ifndef QCAMCALIB_CHESSBOARD_DETECTOR_HPP
+#define QCAMCALIB_CHESSBOARD_DETECTOR_HPP
+
+#include <QString>
+#include <opencv2/core/core.hpp>
+#include <boost/shared_ptr.hpp>
+#include <vector>
+
+namespace qcam_calib
+{
+    /**
+     * \brief Selects how chessboard corners are searched
+     *
+     * DETECTION_PYRAMID searches on a downscaled gray image first and refines
+     * the corners at full resolution. It falls back to the full resolution
+     * search if no chessboard was found on the downscaled image.
+     */
+    enum DetectionMode
+    {
+        DETECTION_FULL_RESOLUTION = 0,
+        DETECTION_PYRAMID = 1
+    };
+
+    /**
+     * \brief The OpenCV function used to search the chessboard
+     *
+     * DETECTOR_SECTOR_BASED uses findChessboardCornersSB which is only
+     * available with OpenCV 4 or newer.
+     */
+    enum DetectorEngine
+    {
+        DETECTOR_CLASSIC = 0,
+        DETECTOR_SECTOR_BASED = 1
+    };
+
+    /**
+     * \brief Configures the chessboard detection of a camera
+     *
+     * The constructor is not explicit so a DetectionMode can be given wherever
+     * settings are expected, which selects the classic engine with its default flags.
+     */
+    struct DetectorSettings
+    {
+        DetectorSettings(DetectionMode mode = DETECTION_FULL_RESOLUTION);
+        DetectorSettings(DetectorEngine engine,int flags,DetectionMode mode = DETECTION_FULL_RESOLUTION);
+
+        /**
+         * \brief Returns the flags used if none are given for the engine
+         */
+        static int getDefaultFlags(DetectorEngine engine);
+
+        /**
+         * \brief Returns a short unique name of the settings, used for cache keys and reports
+         */
+        QString toString()const;
+
+        bool operator==(const DetectorSettings &other)const;
+        bool operator!=(const DetectorSettings &other)const;
+
+        DetectorEngine engine;
+        int flags;                  // cv::CALIB_CB_* flags of the engine
+        DetectionMode mode;
+    };
+
+    class ChessboardDetector;
+    typedef boost::shared_ptr<const ChessboardDetector> ChessboardDetectorPtr;
+
+    /**
+     * \brief Interface of a chessboard detection engine
+     *
+     * Engines search a gray image at the given resolution. Downscaling and
+     * refinement for DETECTION_PYRAMID are done by ImageItem::findChessboard
+     * on top of any engine. Engines are stateless and thread safe.
+     */
+    class ChessboardDetector
+    {
+        public:
+            virtual ~ChessboardDetector(){};
+
+            /**
+             * \brief Searches the chessboard in a gray image
+             *
+             * \param[in] gray The CV_8UC1 image
+             * \param[in] board_size The number of inner corners
+             * \param[out] corners The corners or an empty vector if no chessboard was found
+             * \return true if a chessboard was found
+             */
+            virtual bool find(const cv::Mat &gray,const cv::Size &board_size,std::vector<cv::Point2f> &corners)const = 0;
+
+            /**
+             * \brief Creates the engine for the given settings
+             *
+             * Throws std::runtime_error if the engine is not available.
+             */
+            static ChessboardDetectorPtr create(const DetectorSettings &settings);
+            static bool isAvailable(DetectorEngine engine);
+    };
+
+    /**
+     * \brief cv::findChessboardCorners
+     */
+    class ClassicDetector : public ChessboardDetector
+    {
+        public:
+            ClassicDetector(int flags);
+            virtual bool find(const cv::Mat &gray,const cv::Size &board_size,std::vector<cv::Point2f> &corners)const;
+
+        private:
+            int flags;
+    };
+
+    /**
+     * \brief cv::findChessboardCornersSB
+     *
+     * Searches for sector patterns instead of quads. It is more robust against
+     * blur and noise and returns sub pixel accurate corners without a
+     * separate refinement.
+     */
+    class SectorDetector : public ChessboardDetector
+    {
+        public:
+            SectorDetector(int flags);
+            virtual bool find(const cv::Mat &gray,const cv::Size &board_size,std::vector<cv::Point2f> &corners)const;
+
+        private:
+            int flags;
+    };
+}
+
+#endif
@@ -0,0 +1,156 @@
+#include "ChessboardTracker.hpp"
+#include "ImageBuffer.hpp"
+#include "Profiler.hpp"
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
+#include <algorithm>
+
+using namespace qcam_calib;
+
+// optical flow window and number of pyramid levels
+static const cv::Size FLOW_WINDOW(21,21);
+static const int FLOW_LEVELS = 3;
+
+// a roi covering more than this fraction of the frame is not worth searching before the full frame
+static const double MAX_ROI_FRACTION = 0.5;
+
+TrackingSettings::TrackingSettings():
+    optical_flow(true),
+    max_flow_error(0.5),
+    roi_margin(0.5),
+    redetect_interval(10)
+{
+}
+
+TrackingStatistics::TrackingStatistics():
+    frames(0),
+    tracked(0),
+    roi(0),
+    full(0),
+    lost(0)
+{
+}
+
+ChessboardTracker::ChessboardTracker(int cols,int rows,const DetectorSettings &detector,const TrackingSettings &settings):
+    cols(cols),
+    rows(rows),
+    detector(detector),
+    engine(ChessboardDetector::create(detector)),
+    settings(settings),
+    tracked_frames(0)
+{
+}
+
+void ChessboardTracker::reset()
+{
+    last_pyramid.clear();
+    last_corners.clear();
+    tracked_frames = 0;
+}
+
+TrackingStatistics ChessboardTracker::getStatistics()const
+{
+    return statistics;
+}
+
+QVector<QPointF> ChessboardTracker::track(const QImage &frame)
+{
+    ++statistics.frames;
+    ImageBuffer gray_buffer;
+    {
+        ScopedProfile profile("gray conversion");
+        gray_buffer = ImageBuffer(frame).toGray();
+    }
+    const cv::Mat &gray = gray_buffer.getConstMat();
+
+    // the last board is only used if the frame size did not change
+    if(!last_pyramid.empty() && last_pyramid.front().size() != gray.size())
+        reset();
+
+    std::vector<cv::Point2f> corners;
+    std::vector<cv::Mat> pyramid;
+    const bool redetect = settings.redetect_interval > 0 && tracked_frames >= settings.redetect_interval;
+    if(!last_corners.empty() && settings.optical_flow && !last_pyramid.empty() && !redetect)
+    {
+        {
+            ScopedProfile profile("flow pyramid");
+            cv::buildOpticalFlowPyramid(gray,pyramid,FLOW_WINDOW,FLOW_LEVELS);
+        }
+        if(trackFlow(gray,pyramid,corners))
+        {
+            ++statistics.tracked;
+            ++tracked_frames;
+        }
+    }
+    if(corners.empty() && !last_corners.empty() && searchRoi(gray,corners))
+    {
+        ++statistics.roi;
+        tracked_frames = 0;
+    }
+    if(corners.empty())
+    {
+        ++statistics.full;
+        tracked_frames = 0;
+        corners = convertFromQt(ImageItem::findChessboard(frame,cols,rows,detector));
+    }
+    if(corners.empty())
+        ++statistics.lost;
+
+    // the pyramid is only needed if the next frame can be tracked
+    if(settings.optical_flow && !corners.empty() && pyramid.empty())
+    {
+        ScopedProfile profile("flow pyramid");
+        cv::buildOpticalFlowPyramid(gray,pyramid,FLOW_WINDOW,FLOW_LEVELS);
+    }
+    last_pyramid.swap(pyramid);
+    last_corners = corners;
+    return convertToQt(corners);
+}
+
+bool ChessboardTracker::trackFlow(const cv::Mat &gray,const std::vector<cv::Mat> &pyramid,std::vector<cv::Point2f> &corners)const
+{
+    ScopedProfile profile("optical flow");
+    std::vector<cv::Point2f> backward;
+    std::vector<unsigned char> status,status_backward;
+    std::vector<float> error;
+    const cv::TermCriteria criteria(cv::TermCriteria::COUNT+cv::TermCriteria::EPS,30,0.01);
+    cv::calcOpticalFlowPyrLK(last_pyramid,pyramid,last_corners,corners,status,error,FLOW_WINDOW,FLOW_LEVELS,criteria);
+    cv::calcOpticalFlowPyrLK(pyramid,last_pyramid,corners,backward,status_backward,error,FLOW_WINDOW,FLOW_LEVELS,criteria);
+
+    // all corners must be tracked and must return to their origin
+    const cv::Rect frame(0,0,gray.cols,gray.rows);
+    const double max_error2 = settings.max_flow_error*settings.max_flow_error;
+    for(size_t i=0;i < corners.size();++i)
+    {
+        const cv::Point2f d = backward[i]-last_corners[i];
+        if(!status[i] || !status_backward[i] || d.x*d.x+d.y*d.y > max_error2 ||
+           !frame.contains(cv::Point(cvRound(corners[i].x),cvRound(corners[i].y))))
+        {
+            corners.clear();
+            return false;
+        }
+    }
+
+    // anchor the tracked corners to the saddle points of the new frame, flow alone drifts
+    cv::cornerSubPix(gray,corners,cv::Size(5,5),cv::Size(-1,-1),criteria);
+    return true;
+}
+
+bool ChessboardTracker::searchRoi(const cv::Mat &gray,std::vector<cv::Point2f> &corners)const
+{
+    cv::Rect roi = cv::boundingRect(last_corners);
+    const int margin = cvRound(std::max(roi.width,roi.height)*settings.roi_margin);
+    roi = cv::Rect(roi.x-margin,roi.y-margin,roi.width+2*margin,roi.height+2*margin) & cv::Rect(0,0,gray.cols,gray.rows);
+    if(roi.area() <= 0 || roi.area() > MAX_ROI_FRACTION*gray.total())
+        return false;
+
+    ScopedProfile profile("roi search");
+    if(!engine->find(gray(roi),cv::Size(cols,rows),corners))
+        return false;
+    const cv::Point2f offset(roi.x,roi.y);
+    std::vector<cv::Point2f>::iterator iter = corners.begin();
+    for(;iter != corners.end();++iter)
+        *iter += offset;
+    return true;
+}
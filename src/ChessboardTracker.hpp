@@ -0,0 +1,90 @@
+#ifndef QCAMCALIB_CHESSBOARD_TRACKER_HPP
+#define QCAMCALIB_CHESSBOARD_TRACKER_HPP
+
+#include <QImage>
+#include <QVector>
+#include <QPointF>
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+#include "Items.hpp"
+
+namespace qcam_calib
+{
+    /**
+     * \brief Configures how a chessboard is followed through a sequence
+     */
+    struct TrackingSettings
+    {
+        TrackingSettings();
+
+        bool optical_flow;          // track the corners of the last frame with pyramidal Lucas-Kanade
+        double max_flow_error;      // maximal forward-backward distance in pixel of a tracked corner
+        double roi_margin;          // margin around the last board relative to its size
+        int redetect_interval;      // frames after which the board is detected again instead of tracked, 0 for never
+    };
+
+    /**
+     * \brief Counts how the chessboard of each frame was found
+     */
+    struct TrackingStatistics
+    {
+        TrackingStatistics();
+
+        int frames;                 // frames given to track
+        int tracked;                // corners tracked by optical flow
+        int roi;                    // chessboard found inside the region of the last board
+        int full;                   // searched on the full frame
+        int lost;                   // frames without chessboard
+    };
+
+    /**
+     * \brief Finds a chessboard in consecutive frames of a sequence
+     *
+     * The board moves little between two frames. So the corners of the last
+     * frame are tracked by optical flow and refined to sub pixel accuracy.
+     * If tracking fails, the chessboard is searched inside the region of the
+     * last board and only if this fails as well, on the full frame with
+     * ImageItem::findChessboard.
+     *
+     * The tracker is not thread safe, frames have to be given in order.
+     */
+    class ChessboardTracker
+    {
+        public:
+            ChessboardTracker(int cols = 0,int rows = 0,const DetectorSettings &detector = DetectorSettings(),
+                              const TrackingSettings &settings = TrackingSettings());
+
+            /**
+             * \brief Returns the chessboard corners of the next frame of the sequence
+             *
+             * \return The corners or an empty vector if no chessboard was found
+             */
+            QVector<QPointF> track(const QImage &frame);
+
+            /**
+             * \brief Forgets the last frame, the next frame is searched on the full frame
+             */
+            void reset();
+
+            TrackingStatistics getStatistics()const;
+
+        private:
+            bool trackFlow(const cv::Mat &gray,const std::vector<cv::Mat> &pyramid,std::vector<cv::Point2f> &corners)const;
+            bool searchRoi(const cv::Mat &gray,std::vector<cv::Point2f> &corners)const;
+
+        private:
+            int cols;
+            int rows;
+            DetectorSettings detector;
+            ChessboardDetectorPtr engine;
+            TrackingSettings settings;
+            TrackingStatistics statistics;
+
+            std::vector<cv::Mat> last_pyramid;  // optical flow pyramid of the last frame
+            std::vector<cv::Point2f> last_corners;
+            int tracked_frames;         // frames tracked since the last detection
+    };
+}
+
+#endif
@@ -0,0 +1,97 @@
+#include "CornerCache.hpp"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QFileInfo>
+#include <QFile>
+#include <QDir>
+#include <QThread>
+
+#include <cstdio>
+
+using namespace qcam_calib;
+
+static const char *CACHE_DIR = ".qcam_calib";
+static const quint32 CACHE_MAGIC = 0x51434343;  // QCCC
+static const quint32 CACHE_VERSION = 1;
+
+QString CornerCache::createKey(const QByteArray &content,int cols,int rows,const DetectorSettings &detector)
+{
+    QByteArray hash = QCryptographicHash::hash(content,QCryptographicHash::Md5).toHex();
+    return QString("%1_%2x%3_%4").arg(QString(hash)).arg(cols).arg(rows).arg(detector.toString());
+}
+
+QString CornerCache::entryPath(const QString &image_path,const QString &key)
+{
+    QDir dir = QFileInfo(image_path).absoluteDir();
+    return dir.filePath(QString(CACHE_DIR) + "/" + key + ".corners");
+}
+
+bool CornerCache::load(const QString &image_path,const QString &key,QSize &size,QVector<QPointF> &corners)
+{
+    QFile file(entryPath(image_path,key));
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_6);
+    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    quint32 magic,version,count;
+    qint32 width,height;
+    stream >> magic >> version >> width >> height >> count;
+    if(stream.status() != QDataStream::Ok || magic != CACHE_MAGIC || version != CACHE_VERSION)
+        return false;
+
+    // reject corrupted counts before allocating memory for them
+    const qint64 header_size = 5*sizeof(quint32);
+    if(width < 0 || height < 0 || qint64(count) > (file.size()-header_size)/qint64(2*sizeof(float)))
+        return false;
+
+    QVector<QPointF> points;
+    points.reserve(count);
+    for(quint32 i=0;i < count && stream.status() == QDataStream::Ok;++i)
+    {
+        float x,y;
+        stream >> x >> y;
+        points.push_back(QPointF(x,y));
+    }
+    if(stream.status() != QDataStream::Ok)
+        return false;
+    size = QSize(width,height);
+    corners = points;
+    return true;
+}
+
+bool CornerCache::store(const QString &image_path,const QString &key,const QSize &size,const QVector<QPointF> &corners)
+{
+    QDir dir = QFileInfo(image_path).absoluteDir();
+    if(!dir.exists(CACHE_DIR) && !dir.mkdir(CACHE_DIR))
+        return false;
+
+    // write to a temporary file first so that concurrent readers never see partial entries
+    const QString path = entryPath(image_path,key);
+    QFile file(path + QString(".%1.tmp").arg(quintptr(QThread::currentThreadId())));
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_6);
+    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    stream << CACHE_MAGIC << CACHE_VERSION << qint32(size.width()) << qint32(size.height()) << quint32(corners.size());
+    QVector<QPointF>::const_iterator iter = corners.begin();
+    for(;iter != corners.end();++iter)
+        stream << float(iter->x()) << float(iter->y());
+    file.close();
+    if(stream.status() != QDataStream::Ok)
+    {
+        file.remove();
+        return false;
+    }
+
+    // POSIX rename replaces an existing entry atomically
+    if(std::rename(QFile::encodeName(file.fileName()).constData(),QFile::encodeName(path).constData()) != 0)
+    {
+        file.remove();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,55 @@
+#ifndef QCAMCALIB_CORNER_CACHE_HPP
+#define QCAMCALIB_CORNER_CACHE_HPP
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QPointF>
+#include <QSize>
+
+#include "Items.hpp"
+
+namespace qcam_calib
+{
+    /**
+     * \brief Persistent cache of chessboard detection results
+     *
+     * Results are stored in the hidden directory .qcam_calib next to the images.
+     * Each entry is keyed by the MD5 hash of the image file content together with
+     * the board size and the detector settings, so changed images or a different board
+     * configuration never hit a stale entry. The corners are stored as binary floats.
+     *
+     * All functions are thread safe.
+     */
+    class CornerCache
+    {
+        public:
+            /**
+             * \brief Returns the cache key of the given image content and detection setup
+             */
+            static QString createKey(const QByteArray &content,int cols,int rows,const DetectorSettings &detector);
+
+            /**
+             * \brief Looks up a detection result
+             *
+             * \param[in] image_path The path of the image, used to locate the cache directory
+             * \param[in] key The key returned by createKey
+             * \param[out] size The size of the image
+             * \param[out] corners The detected corners, empty if the image has no chessboard
+             * \return true if an entry was found
+             */
+            static bool load(const QString &image_path,const QString &key,QSize &size,QVector<QPointF> &corners);
+
+            /**
+             * \brief Stores a detection result
+             *
+             * \return false if the cache directory is not writable
+             */
+            static bool store(const QString &image_path,const QString &key,const QSize &size,const QVector<QPointF> &corners);
+
+        private:
+            static QString entryPath(const QString &image_path,const QString &key);
+    };
+}
+
+#endif
@@ -0,0 +1,226 @@
+#include "Dataset.hpp"
+
+#include <QMutexLocker>
+#include <stdexcept>
+
+using namespace qcam_calib;
+
+ImageData::ImageData():
+    id(-1),
+    detected(false)
+{
+}
+
+CameraData::CameraData():
+    id(-1),
+    solver(SOLVER_DENSE),
+    distortion(DISTORTION_RADIAL_TANGENTIAL)
+{
+}
+
+int CameraData::countChessboards()const
+{
+    int count = 0;
+    std::map<int,ImageDataPtr>::const_iterator iter = images.begin();
+    for(;iter != images.end();++iter)
+    {
+        if(!iter->second->corners.empty())
+            ++count;
+    }
+    return count;
+}
+
+CalibrationData qcam_calib::createCalibrationData(const CameraData &camera,int cols,int rows,float dx,float dy,int max_views)
+{
+    CalibrationData data;
+    data.distortion = camera.distortion;
+
+    //generate chessboard points
+    std::vector<cv::Point3f> points3f;
+    for(int row=0;row < rows; ++row)
+    {
+        for(int col=0;col < cols; ++col)
+            points3f.push_back(cv::Point3f(dx*col,dy*row,0));
+    }
+
+    //collect image points into one buffer
+    int views = 0;
+    std::map<int,ImageDataPtr>::const_iterator iter = camera.images.begin();
+    for(;iter != camera.images.end();++iter)
+    {
+        if(iter->second->corners.size() == points3f.size())
+            ++views;
+    }
+    data.reserve(points3f,views);
+    for(iter = camera.images.begin();iter != camera.images.end();++iter)
+    {
+        const ImageData &image = *iter->second;
+        if(image.corners.size() == points3f.size())
+        {
+            data.image_size = image.size;
+            data.addView(image.id,image.corners);
+        }
+    }
+    if(data.getViewCount() < 1)
+        throw std::runtime_error("not enough detected chessboards");
+    if(max_views > 0 && data.getViewCount() > max_views)
+        return data.selectViews(selectViewSubset(data,max_views));
+    return data;
+}
+
+Dataset::Dataset():
+    next_image_id(0)
+{
+}
+
+Dataset::~Dataset()
+{
+}
+
+CameraDataPtr Dataset::getCamera(int camera_id)const
+{
+    QMutexLocker locker(&mutex);
+    std::map<int,CameraDataPtr>::const_iterator iter = cameras.find(camera_id);
+    if(iter == cameras.end())
+        throw std::runtime_error("Dataset: cannot find camera");
+    return iter->second;
+}
+
+std::vector<CameraDataPtr> Dataset::getCameras()const
+{
+    QMutexLocker locker(&mutex);
+    std::vector<CameraDataPtr> result;
+    std::map<int,CameraDataPtr>::const_iterator iter = cameras.begin();
+    for(;iter != cameras.end();++iter)
+        result.push_back(iter->second);
+    return result;
+}
+
+ImageDataPtr Dataset::getImage(int camera_id,int image_id)const
+{
+    CameraDataPtr camera = getCamera(camera_id);
+    std::map<int,ImageDataPtr>::const_iterator iter = camera->images.find(image_id);
+    if(iter == camera->images.end())
+        throw std::runtime_error("Dataset: cannot find image");
+    return iter->second;
+}
+
+boost::shared_ptr<CameraData> Dataset::copyCamera(int camera_id)const
+{
+    std::map<int,CameraDataPtr>::const_iterator iter = cameras.find(camera_id);
+    if(iter == cameras.end())
+        throw std::runtime_error("Dataset: cannot find camera");
+    return boost::shared_ptr<CameraData>(new CameraData(*iter->second));
+}
+
+void Dataset::addCamera(int camera_id,const std::string &name)
+{
+    QMutexLocker locker(&mutex);
+    if(cameras.find(camera_id) != cameras.end())
+        throw std::runtime_error("Dataset: camera id is already in use");
+    boost::shared_ptr<CameraData> camera(new CameraData);
+    camera->id = camera_id;
+    camera->name = name;
+    cameras[camera_id] = camera;
+}
+
+void Dataset::removeCamera(int camera_id)
+{
+    QMutexLocker locker(&mutex);
+    cameras.erase(camera_id);
+}
+
+ImageDataPtr Dataset::addImage(int camera_id,const ImageData &image)
+{
+    QMutexLocker locker(&mutex);
+    boost::shared_ptr<CameraData> camera = copyCamera(camera_id);
+    boost::shared_ptr<ImageData> data(new ImageData(image));
+    data->id = next_image_id++;
+    camera->images[data->id] = data;
+    cameras[camera_id] = camera;
+    return data;
+}
+
+std::vector<ImageDataPtr> Dataset::addImages(int camera_id,const std::vector<ImageData> &images)
+{
+    QMutexLocker locker(&mutex);
+    boost::shared_ptr<CameraData> camera = copyCamera(camera_id);
+    std::vector<ImageDataPtr> result;
+    result.reserve(images.size());
+    std::vector<ImageData>::const_iterator iter = images.begin();
+    for(;iter != images.end();++iter)
+    {
+        boost::shared_ptr<ImageData> data(new ImageData(*iter));
+        data->id = next_image_id++;
+        camera->images.insert(camera->images.end(),std::make_pair(data->id,ImageDataPtr(data)));
+        result.push_back(data);
+    }
+    cameras[camera_id] = camera;
+    return result;
+}
+
+void Dataset::removeImage(int camera_id,int image_id)
+{
+    QMutexLocker locker(&mutex);
+    if(cameras.find(camera_id) == cameras.end())
+        return;
+    boost::shared_ptr<CameraData> camera = copyCamera(camera_id);
+    camera->images.erase(image_id);
+    cameras[camera_id] = camera;
+}
+
+ImageDataPtr Dataset::setChessboard(int camera_id,int image_id,const std::vector<cv::Point2f> &corners,const cv::Size &board_size)
+{
+    QMutexLocker locker(&mutex);
+    boost::shared_ptr<CameraData> camera = copyCamera(camera_id);
+    std::map<int,ImageDataPtr>::iterator iter = camera->images.find(image_id);
+    if(iter == camera->images.end())
+        throw std::runtime_error("Dataset: cannot find image");
+    boost::shared_ptr<ImageData> data(new ImageData(*iter->second));
+    data->corners = corners;
+    data->board_size = board_size;
+    data->detected = true;
+    iter->second = data;
+    cameras[camera_id] = camera;
+    return data;
+}
+
+void Dataset::setCalibration(int camera_id,const CalibrationResult &result)
+{
+    QMutexLocker locker(&mutex);
+    boost::shared_ptr<CameraData> camera = copyCamera(camera_id);
+    camera->calibration.reset(new CalibrationResult(result));
+    cameras[camera_id] = camera;
+}
+
+void Dataset::clearCalibration(int camera_id)
+{
+    QMutexLocker locker(&mutex);
+    boost::shared_ptr<CameraData> camera = copyCamera(camera_id);
+    camera->calibration.reset();
+    cameras[camera_id] = camera;
+}
+
+void Dataset::setDetector(int camera_id,const DetectorSettings &detector)
+{
+    QMutexLocker locker(&mutex);
+    boost::shared_ptr<CameraData> camera = copyCamera(camera_id);
+    camera->detector = detector;
+    cameras[camera_id] = camera;
+}
+
+void Dataset::setSolver(int camera_id,CalibrationSolver solver)
+{
+    QMutexLocker locker(&mutex);
+    boost::shared_ptr<CameraData> camera = copyCamera(camera_id);
+    camera->solver = solver;
+    cameras[camera_id] = camera;
+}
+
+void Dataset::setDistortionModel(int camera_id,DistortionModel distortion)
+{
+    QMutexLocker locker(&mutex);
+    boost::shared_ptr<CameraData> camera = copyCamera(camera_id);
+    camera->distortion = distortion;
+    cameras[camera_id] = camera;
+}
@@ -0,0 +1,121 @@
+#ifndef QCAMCALIB_DATASET_HPP
+#define QCAMCALIB_DATASET_HPP
+
+#include <opencv2/core/core.hpp>
+#include <boost/shared_ptr.hpp>
+#include <QMutex>
+#include <QImage>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "Calibration.hpp"
+#include "ChessboardDetector.hpp"
+
+namespace qcam_calib
+{
+    /**
+     * \brief Image of a camera together with its detected chessboard corners
+     */
+    struct ImageData
+    {
+        ImageData();
+
+        int id;                                 // unique id assigned by the Dataset
+        std::string name;
+        std::string path;                       // empty if the image is held in memory
+        QImage image;                           // only valid if path is empty
+        cv::Size size;
+        cv::Size board_size;                    // cols, rows of the detected chessboard
+        std::vector<cv::Point2f> corners;       // empty if no chessboard was found
+        bool detected;                          // true if the chessboard detection was run
+    };
+    typedef boost::shared_ptr<const ImageData> ImageDataPtr;
+
+    /**
+     * \brief Images and calibration of a single camera
+     */
+    struct CameraData
+    {
+        CameraData();
+
+        int id;
+        std::string name;
+        std::map<int,ImageDataPtr> images;                    // ordered by image id
+        boost::shared_ptr<const CalibrationResult> calibration; // NULL if not calibrated
+        DetectorSettings detector;                            // used to search missing chessboards
+        CalibrationSolver solver;                             // used to calibrate the camera
+        DistortionModel distortion;                           // estimated by the calibration
+
+        int countChessboards()const;
+    };
+    typedef boost::shared_ptr<const CameraData> CameraDataPtr;
+
+    /**
+     * \brief Collects the detected chessboards of a camera for calibration
+     *
+     * Only chessboards with cols*rows corners are used. If max_views is
+     * greater than zero at most max_views views are selected with
+     * selectViewSubset.
+     */
+    CalibrationData createCalibrationData(const CameraData &camera,int cols,int rows,float dx,float dy,int max_views = 0);
+
+    /**
+     * \brief Thread safe store of all cameras, images, corners and calibration results
+     *
+     * All data handed out by the store are immutable snapshots. Modifications
+     * copy the affected camera and swap it in, so readers never see partial
+     * updates and can keep working on a snapshot without holding any lock.
+     * The Qt item model is only a view on top of this store.
+     */
+    class Dataset
+    {
+        public:
+            Dataset();
+            virtual ~Dataset();
+
+            CameraDataPtr getCamera(int camera_id)const;
+            std::vector<CameraDataPtr> getCameras()const;
+            ImageDataPtr getImage(int camera_id,int image_id)const;
+
+            void addCamera(int camera_id,const std::string &name);
+            void removeCamera(int camera_id);
+
+            /**
+             * \brief Adds an image to a camera
+             *
+             * \return The stored image with its assigned id
+             */
+            ImageDataPtr addImage(int camera_id,const ImageData &image);
+
+            /**
+             * \brief Adds several images to a camera with a single copy of the camera
+             *
+             * Each modification copies the image map of the camera, so bulk loads
+             * should add their images in batches instead of one by one.
+             *
+             * \return The stored images with their assigned ids in the given order
+             */
+            std::vector<ImageDataPtr> addImages(int camera_id,const std::vector<ImageData> &images);
+            void removeImage(int camera_id,int image_id);
+            ImageDataPtr setChessboard(int camera_id,int image_id,const std::vector<cv::Point2f> &corners,const cv::Size &board_size);
+
+            void setCalibration(int camera_id,const CalibrationResult &result);
+            void clearCalibration(int camera_id);
+            void setDetector(int camera_id,const DetectorSettings &detector);
+            void setSolver(int camera_id,CalibrationSolver solver);
+            void setDistortionModel(int camera_id,DistortionModel distortion);
+
+        private:
+            // returns a modifiable copy of the camera, must be called with the lock held
+            boost::shared_ptr<CameraData> copyCamera(int camera_id)const;
+
+        private:
+            mutable QMutex mutex;
+            std::map<int,CameraDataPtr> cameras;
+            int next_image_id;
+    };
+    typedef boost::shared_ptr<Dataset> DatasetPtr;
+}
+
+#endif
@@ -0,0 +1,151 @@
+#include "ImageBuffer.hpp"
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <stdexcept>
+
+using namespace qcam_calib;
+
+// the linear gray color table shared by all gray buffers
+static QVector<QRgb> createGrayTable()
+{
+    QVector<QRgb> table(256);
+    for(int i=0;i < 256;++i)
+        table[i] = qRgb(i,i,i);
+    return table;
+}
+
+static const QVector<QRgb> GRAY_TABLE = createGrayTable();
+
+static int matType(const QImage &image)
+{
+    switch(image.format())
+    {
+    case QImage::Format_Indexed8:
+        return CV_8UC1;
+    case QImage::Format_RGB888:
+        return CV_8UC3;
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+        return CV_8UC4;
+    default:
+        return -1;
+    }
+}
+
+ImageBuffer::ImageBuffer()
+{
+}
+
+ImageBuffer::ImageBuffer(const QImage &image):
+    image(image)
+{
+    if(image.isNull())
+        return;
+    if(image.format() == QImage::Format_Indexed8 && !isLinearGray(image))
+        this->image = image.convertToFormat(QImage::Format_RGB32);
+    else if(matType(image) < 0)
+        this->image = image.convertToFormat(QImage::Format_RGB32);
+    updateMat();
+}
+
+ImageBuffer::ImageBuffer(int width,int height,int type)
+{
+    switch(type)
+    {
+    case CV_8UC1:
+        image = QImage(width,height,QImage::Format_Indexed8);
+        image.setColorTable(GRAY_TABLE);
+        break;
+    case CV_8UC3:
+        image = QImage(width,height,QImage::Format_RGB888);
+        break;
+    case CV_8UC4:
+        image = QImage(width,height,QImage::Format_RGB32);
+        break;
+    default:
+        throw std::runtime_error("ImageBuffer: unsupported cv::Mat type");
+    }
+    if(image.isNull())
+        throw std::runtime_error("ImageBuffer: cannot allocate image");
+    updateMat();
+}
+
+bool ImageBuffer::isLinearGray(const QImage &image)
+{
+    if(image.format() != QImage::Format_Indexed8)
+        return false;
+    const QVector<QRgb> table = image.colorTable();
+    if(table.size() != 256)
+        return false;
+    for(int i=0;i < 256;++i)
+    {
+        if(qRed(table[i]) != i || qGreen(table[i]) != i || qBlue(table[i]) != i)
+            return false;
+    }
+    return true;
+}
+
+void ImageBuffer::updateMat()
+{
+    // does not detach the image
+    uchar *bits = const_cast<uchar*>(image.constBits());
+    mat = cv::Mat(image.height(),image.width(),matType(image),bits,image.bytesPerLine());
+}
+
+bool ImageBuffer::isNull()const
+{
+    return image.isNull();
+}
+
+int ImageBuffer::width()const
+{
+    return image.width();
+}
+
+int ImageBuffer::height()const
+{
+    return image.height();
+}
+
+int ImageBuffer::type()const
+{
+    return mat.type();
+}
+
+bool ImageBuffer::isGray()const
+{
+    return !mat.empty() && mat.type() == CV_8UC1;
+}
+
+const QImage &ImageBuffer::getImage()const
+{
+    return image;
+}
+
+const cv::Mat &ImageBuffer::getConstMat()const
+{
+    return mat;
+}
+
+cv::Mat &ImageBuffer::getMat()
+{
+    // bits() copies the pixels if they are shared with another QImage
+    if(!image.isNull() && image.bits() != mat.data)
+        updateMat();
+    return mat;
+}
+
+ImageBuffer ImageBuffer::toGray()const
+{
+    if(isNull() || isGray())
+        return *this;
+
+    ImageBuffer gray(width(),height(),CV_8UC1);
+    cv::Mat &dst = gray.getMat();
+    if(mat.type() == CV_8UC3)
+        cv::cvtColor(mat,dst,cv::COLOR_RGB2GRAY);
+    else
+        cv::cvtColor(mat,dst,cv::COLOR_BGRA2GRAY);
+    return gray;
+}
@@ -0,0 +1,80 @@
+#ifndef QCAMCALIB_IMAGE_BUFFER_HPP
+#define QCAMCALIB_IMAGE_BUFFER_HPP
+
+#include <QImage>
+#include <opencv2/core/core.hpp>
+
+namespace qcam_calib
+{
+    /**
+     * \brief Image memory which can be viewed as QImage and cv::Mat without copying
+     *
+     * The pixels are always owned by the QImage. The cv::Mat is a header on
+     * the same memory, therefore copies of an ImageBuffer share the reference
+     * count of the QImage and no pixel is copied when switching between Qt
+     * and OpenCV. Buffers which are allocated by ImageBuffer for OpenCV results
+     * are QImages as well, which can be displayed directly.
+     *
+     * The layouts are mapped as follows:
+     *  * Indexed8 with a linear gray color table <-> CV_8UC1
+     *  * RGB888 <-> CV_8UC3 (RGB channel order)
+     *  * RGB32, ARGB32, ARGB32_Premultiplied <-> CV_8UC4 (BGRA channel order on little endian machines)
+     *
+     * Other formats are converted to RGB32 once when the buffer is created.
+     *
+     * Like QImage the buffer is copy on write. getMat() detaches the buffer
+     * before it is written to, getConstMat() never copies.
+     */
+    class ImageBuffer
+    {
+        public:
+            ImageBuffer();
+
+            /**
+             * \brief Views the given image, only unsupported formats are converted
+             */
+            explicit ImageBuffer(const QImage &image);
+
+            /**
+             * \brief Allocates an uninitialized buffer
+             *
+             * \param[in] type CV_8UC1, CV_8UC3 or CV_8UC4
+             */
+            ImageBuffer(int width,int height,int type);
+
+            bool isNull()const;
+            int width()const;
+            int height()const;
+            int type()const;
+
+            /**
+             * \brief Returns true if the image is an 8 bit gray image
+             */
+            bool isGray()const;
+
+            const QImage &getImage()const;
+            const cv::Mat &getConstMat()const;
+            cv::Mat &getMat();
+
+            /**
+             * \brief Returns an 8 bit gray view of the buffer
+             *
+             * Gray images are shared, all other images are converted into a new buffer.
+             */
+            ImageBuffer toGray()const;
+
+            /**
+             * \brief Returns true if the image is an Indexed8 image whose color table maps i to gray value i
+             */
+            static bool isLinearGray(const QImage &image);
+
+        private:
+            void updateMat();
+
+        private:
+            QImage image;
+            cv::Mat mat;
+    };
+}
+
+#endif
@@ -0,0 +1,167 @@
+#include "ImageLoader.hpp"
+#include "Items.hpp"
+#include "ImageView.hpp"
+#include "CornerCache.hpp"
+#include "Profiler.hpp"
+
+#include <QThread>
+#include <QImage>
+#include <QFile>
+#include <stdexcept>
+#include <QtConcurrentRun>
+
+using namespace qcam_calib;
+
+LoadedImage ImageLoader::loadImage(const QString &path,int cols,int rows,const DetectorSettings &detector,bool use_cache)
+{
+    LoadedImage result;
+    result.path = path;
+    Profiler::setCurrentItem(path);
+
+    QByteArray content;
+    {
+        ScopedProfile profile("read file");
+        QFile file(path);
+        if(!file.open(QIODevice::ReadOnly))
+            return result;
+        content = file.readAll();
+        profile.addAllocation(content.size());
+    }
+
+    QString key;
+    if(use_cache)
+    {
+        ScopedProfile profile("corner cache lookup");
+        key = CornerCache::createKey(content,cols,rows,detector);
+        if(CornerCache::load(path,key,result.size,result.chessboard))
+            return result;
+    }
+
+    QImage image;
+    {
+        ScopedProfile profile("decode");
+        image = QImage::fromData(content);
+        profile.addAllocation(image.byteCount());
+    }
+    content.clear();
+    if(image.isNull())
+        return result;
+    result.size = image.size();
+    result.chessboard = ImageItem::findChessboard(image,cols,rows,detector);
+    ImageItem::cacheImage(path,image);
+    ImageView::cacheThumbnail(path,image);
+    if(use_cache)
+    {
+        ScopedProfile profile("corner cache store");
+        CornerCache::store(path,key,result.size,result.chessboard);
+    }
+    return result;
+}
+
+ImageLoader::ImageLoader(QObject *parent):
+    QObject(parent),
+    next_path(0),
+    finished_count(0),
+    cols(0),
+    rows(0),
+    max_in_flight(0),
+    use_corner_cache(true),
+    canceled(false)
+{
+    setMaxInFlight(0);
+}
+
+ImageLoader::~ImageLoader()
+{
+    cancel();
+    QList<QFutureWatcher<LoadedImage>*>::iterator iter = jobs.begin();
+    for(;iter != jobs.end();++iter)
+        (*iter)->waitForFinished();
+}
+
+void ImageLoader::setMaxInFlight(int count)
+{
+    if(count < 1)
+        count = 2*QThread::idealThreadCount();
+    max_in_flight = count < 1 ? 1 : count;
+}
+
+int ImageLoader::getMaxInFlight()const
+{
+    return max_in_flight;
+}
+
+void ImageLoader::setUseCornerCache(bool use)
+{
+    use_corner_cache = use;
+}
+
+bool ImageLoader::getUseCornerCache()const
+{
+    return use_corner_cache;
+}
+
+bool ImageLoader::isRunning()const
+{
+    return !jobs.empty();
+}
+
+void ImageLoader::start(const QStringList &paths,int cols,int rows,const DetectorSettings &detector)
+{
+    if(isRunning())
+        throw std::runtime_error("ImageLoader: loading is already in progress");
+
+    this->paths = paths;
+    this->cols = cols;
+    this->rows = rows;
+    this->detector = detector;
+    next_path = 0;
+    finished_count = 0;
+    canceled = false;
+
+    emit progressRangeChanged(0,paths.size());
+    emit progressValueChanged(0);
+    if(paths.empty())
+    {
+        emit finished();
+        return;
+    }
+    startJobs();
+}
+
+void ImageLoader::cancel()
+{
+    canceled = true;
+}
+
+void ImageLoader::startJobs()
+{
+    while(!canceled && jobs.size() < max_in_flight && next_path < paths.size())
+    {
+        QFutureWatcher<LoadedImage> *watcher = new QFutureWatcher<LoadedImage>(this);
+        connect(watcher,SIGNAL(finished()),SLOT(jobFinished()));
+        jobs.push_back(watcher);
+        watcher->setFuture(QtConcurrent::run(ImageLoader::loadImage,paths[next_path],cols,rows,detector,use_corner_cache));
+        ++next_path;
+    }
+}
+
+void ImageLoader::jobFinished()
+{
+    QFutureWatcher<LoadedImage> *watcher = dynamic_cast<QFutureWatcher<LoadedImage>*>(sender());
+    if(!watcher)
+        return;
+    jobs.removeOne(watcher);
+    LoadedImage result = watcher->result();
+    watcher->deleteLater();
+
+    ++finished_count;
+    if(!canceled)
+    {
+        startJobs();
+        emit imageLoaded(result.path,result.size,result.chessboard);
+        emit progressValueChanged(finished_count);
+    }
+    if(jobs.empty() && (canceled || next_path >= paths.size()))
+        emit finished();
+}
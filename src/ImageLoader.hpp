@@ -0,0 +1,102 @@
+#ifndef QCAMCALIB_IMAGE_LOADER_HPP
+#define QCAMCALIB_IMAGE_LOADER_HPP
+
+#include <QObject>
+#include <QSize>
+#include <QStringList>
+#include <QVector>
+#include <QPointF>
+#include <QList>
+#include <QFutureWatcher>
+
+#include "Items.hpp"
+
+namespace qcam_calib
+{
+    /**
+     * \brief Result of loading a single image and searching for its chessboard
+     */
+    struct LoadedImage
+    {
+        QString path;
+        QSize size;     // invalid if the image could not be loaded
+        QVector<QPointF> chessboard;
+    };
+
+    /**
+     * \brief Loads images and detects chessboards in one streaming pass
+     *
+     * Each image is decoded, converted and searched for chessboard corners by
+     * the same task so that no stage has to wait for all images of the previous
+     * stage. Results are reported as soon as they are available. At most
+     * maxInFlight images are processed or waiting to be consumed at any time,
+     * which bounds the memory needed for large image sets. Decoded images are
+     * handed over to the image cache of ImageItem and are not kept otherwise.
+     */
+    class ImageLoader : public QObject
+    {
+        Q_OBJECT
+        public:
+            /**
+             * \brief Loads a single image and searches its chessboard
+             *
+             * If use_cache is set the result is taken from the CornerCache if
+             * possible, in this case the image is not decoded at all.
+             */
+            static LoadedImage loadImage(const QString &path,int cols,int rows,const DetectorSettings &detector,bool use_cache);
+
+            ImageLoader(QObject *parent = 0);
+            virtual ~ImageLoader();
+
+            /**
+             * \brief Sets the maximal number of images which are loaded at the same time
+             *
+             * \param[in] count The window size. Values smaller than 1 select twice the ideal thread count.
+             */
+            void setMaxInFlight(int count);
+            int getMaxInFlight()const;
+
+            /**
+             * \brief Enables the persistent CornerCache (enabled by default)
+             */
+            void setUseCornerCache(bool use);
+            bool getUseCornerCache()const;
+            bool isRunning()const;
+
+            /**
+             * \brief Starts loading the given images in the background
+             *
+             * For each image imageLoaded is emitted in the order the results become available.
+             */
+            void start(const QStringList &paths,int cols,int rows,const DetectorSettings &detector=DetectorSettings());
+
+        public slots:
+            void cancel();
+
+        signals:
+            void imageLoaded(const QString &path,const QSize &size,const QVector<QPointF> &chessboard);
+            void progressRangeChanged(int minimum,int maximum);
+            void progressValueChanged(int value);
+            void finished();
+
+        private slots:
+            void jobFinished();
+
+        private:
+            void startJobs();
+
+        private:
+            QStringList paths;
+            int next_path;
+            int finished_count;
+            int cols;
+            int rows;
+            DetectorSettings detector;
+            int max_in_flight;
+            bool use_corner_cache;
+            bool canceled;
+            QList<QFutureWatcher<LoadedImage>*> jobs;
+    };
+}
+
+#endif
@@ -1,18 +1,207 @@
 #include "ImageView.hpp"
+#include "Items.hpp"
+#include "Profiler.hpp"
+#include "ImageBuffer.hpp"
 
 #include<QGraphicsPixmapItem>
+#include<QPainter>
+#include<QPixmapCache>
+#include<QWheelEvent>
+#include<QFutureWatcher>
+#include<QtConcurrentRun>
+#include<QMutex>
+#include<QMutexLocker>
+#include<QCache>
+
+#include <opencv2/imgproc/imgproc.hpp>
 
 using namespace qcam_calib;
 
+ChessboardItem::ChessboardItem(QGraphicsItem *parent):
+    QGraphicsItem(parent),
+    cols(0),
+    rows(0),
+    radius(0)
+{
+}
+
+ChessboardItem::~ChessboardItem()
+{
+}
+
+void ChessboardItem::setChessboard(const QVector<QPointF> &corners,int cols,int rows)
+{
+    prepareGeometryChange();
+    if(corners.size() != cols*rows)
+        this->corners.clear();
+    else
+        this->corners = corners;
+    this->cols = cols;
+    this->rows = rows;
+
+    bounding_rect = QRectF();
+    if(this->corners.empty())
+        return;
+    QPointF min = this->corners.front();
+    QPointF max = min;
+    QVector<QPointF>::const_iterator iter = this->corners.begin();
+    for(;iter != this->corners.end();++iter)
+    {
+        min.setX(qMin(min.x(),iter->x()));
+        min.setY(qMin(min.y(),iter->y()));
+        max.setX(qMax(max.x(),iter->x()));
+        max.setY(qMax(max.y(),iter->y()));
+    }
+    // scale the markers with the size of the board
+    radius = qMax(qreal(2.0),qMax(max.x()-min.x(),max.y()-min.y())/(4*qMax(cols,rows)));
+    bounding_rect = QRectF(min,max).adjusted(-radius-1,-radius-1,radius+1,radius+1);
+}
+
+QRectF ChessboardItem::boundingRect()const
+{
+    return bounding_rect;
+}
+
+void ChessboardItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+    static const QColor colors[] = {QColor(255,0,0),QColor(255,128,0),QColor(200,200,0),
+                                    QColor(0,255,0),QColor(0,200,200),QColor(0,0,255),
+                                    QColor(255,0,255)};
+    static const int color_count = sizeof(colors)/sizeof(QColor);
+
+    if(corners.empty())
+        return;
+    painter->setRenderHint(QPainter::Antialiasing);
+    painter->setBrush(Qt::NoBrush);
+    for(int row=0;row < rows;++row)
+    {
+        QPen pen(colors[row%color_count]);
+        pen.setCosmetic(true);
+        pen.setWidth(2);
+        painter->setPen(pen);
+        const QPointF *points = corners.constData()+row*cols;
+        for(int col=0;col < cols;++col)
+        {
+            painter->drawEllipse(points[col],radius,radius);
+            if(col > 0)
+                painter->drawLine(points[col-1],points[col]);
+        }
+        // connect the rows
+        if(row+1 < rows)
+            painter->drawLine(points[cols-1],points[cols]);
+    }
+}
+
+// maximal edge length of the scaled preview levels
+static const int PREVIEW_SIZES[] = {256,1024};
+
+// size of the image and pixmap caches in kbytes
+static const int CACHE_LIMIT = 64*1024;
+
+// scaled previews, cost is given in kbytes
+static QCache<QString,QImage> preview_cache(CACHE_LIMIT);
+static QMutex preview_cache_mutex;
+
+QString previewKey(const QString &key,int level)
+{
+    return QString::number(level) + ":" + key;
+}
+
+QString undistortedKey(const QString &key,const UndistortMaps &maps)
+{
+    return QString("undistorted%1:").arg(maps.id) + key;
+}
+
+// scales the image to fit into size x size pixels keeping its format
+// area interpolation runs directly on the image memory via ImageBuffer
+static QImage scaleImage(const QImage &image,int size)
+{
+    const QSize scaled_size = image.size().scaled(size,size,Qt::KeepAspectRatio).expandedTo(QSize(1,1));
+    if(image.hasAlphaChannel())
+        return image.scaled(scaled_size,Qt::IgnoreAspectRatio,Qt::SmoothTransformation);
+
+    ImageBuffer source(image);
+    ImageBuffer scaled(scaled_size.width(),scaled_size.height(),source.type());
+    cv::resize(source.getConstMat(),scaled.getMat(),scaled.getConstMat().size(),0,0,cv::INTER_AREA);
+    return scaled.getImage();
+}
+
+QImage ImageView::createPreview(const QString &key,const QImage &image,PreviewLevel level)
+{
+    if(level >= PREVIEW_FULL)
+        return image.isNull() ? ImageItem::loadImage(key) : image;
+
+    const QString preview_key = previewKey(key,level);
+    {
+        QMutexLocker locker(&preview_cache_mutex);
+        QImage *preview = preview_cache.object(preview_key);
+        if(preview)
+            return *preview;
+    }
+
+    // scale down from the next higher level which is cheaper than scaling the full image
+    QImage source = createPreview(key,image,static_cast<PreviewLevel>(level+1));
+    if(source.isNull())
+        return source;
+    QImage preview = source;
+    if(source.width() > PREVIEW_SIZES[level] || source.height() > PREVIEW_SIZES[level])
+    {
+        ScopedProfile profile("preview scaling",key);
+        preview = scaleImage(source,PREVIEW_SIZES[level]);
+        profile.addAllocation(preview.byteCount());
+    }
+
+    QMutexLocker locker(&preview_cache_mutex);
+    preview_cache.insert(preview_key,new QImage(preview),preview.byteCount()/1024+1);
+    return preview;
+}
+
+void ImageView::cacheThumbnail(const QString &key,const QImage &image)
+{
+    createPreview(key,image,PREVIEW_THUMBNAIL);
+}
+
+QImage ImageView::undistortImage(const QString &key,const QImage &image,const UndistortMaps &maps)
+{
+    QImage source = createPreview(key,image,PREVIEW_FULL);
+    if(source.isNull() || maps.empty() || source.width() != maps.image_size.width || source.height() != maps.image_size.height)
+        return QImage();
+
+    ScopedProfile profile("undistortion",key);
+    ImageBuffer distorted(source);
+    ImageBuffer undistorted(distorted.width(),distorted.height(),distorted.type());
+    cv::remap(distorted.getConstMat(),undistorted.getMat(),maps.map1,maps.map2,cv::INTER_LINEAR);
+    profile.addAllocation(undistorted.getImage().byteCount());
+    return undistorted.getImage();
+}
+
 ImageView::ImageView(QWidget *parent):
     QGraphicsView(parent),
-    welcome(NULL)
+    welcome(NULL),
+    current_level(-1),
+    undistortion_running(false),
+    undistortion_queued(false)
 {
     QGraphicsScene *scene = new QGraphicsScene(this);
     pixmap_item = new QGraphicsPixmapItem();
+    pixmap_item->setTransformationMode(Qt::SmoothTransformation);
     scene->addItem(pixmap_item);
+    heatmap_item = new QGraphicsPixmapItem();
+    heatmap_item->setTransformationMode(Qt::FastTransformation);
+    heatmap_item->setOpacity(0.6);
+    heatmap_item->setZValue(0.5);
+    heatmap_item->setVisible(false);
+    scene->addItem(heatmap_item);
+    chessboard_item = new ChessboardItem();
+    chessboard_item->setZValue(1);
+    scene->addItem(chessboard_item);
     scene->setBackgroundBrush(QColor(120,120,120));
     setScene(scene);
+    setTransformationAnchor(QGraphicsView::AnchorUnderMouse);
+
+    // full resolution and undistorted pixmaps would not fit into the default limit
+    if(QPixmapCache::cacheLimit() < CACHE_LIMIT)
+        QPixmapCache::setCacheLimit(CACHE_LIMIT);
 
     welcome = new QGraphicsTextItem("Camera calibration:\n\n1.) load images\n2.) find chessboard corners\n3.) calibrate camera\n4.) save parameter");
     scene->addItem(welcome);
@@ -22,24 +211,252 @@ ImageView::~ImageView()
 {
 }
 
-void ImageView::displayImage(const QImage &image)
+void ImageView::removeWelcome()
 {
     if(welcome)
     {
         scene()->removeItem(welcome);
-        welcome = NULL; //deleted by scene
+        delete welcome;
+        welcome = NULL;
     }
-    QPixmap pixmap = QPixmap::fromImage(image);
-    pixmap_item->setPixmap(pixmap);
+}
+
+void ImageView::displayImage(const QImage &image)
+{
+    displayImage(QString("image:%1").arg(image.cacheKey()),image.size(),image);
+}
+
+void ImageView::displayImage(const QString &key,const QSize &size,const QImage &image)
+{
+    displayUndistortedImage(key,size,image,UndistortMaps());
+}
+
+void ImageView::displayUndistortedImage(const QString &key,const QSize &size,const QImage &image,const UndistortMaps &maps)
+{
+    removeWelcome();
+    current_key = key;
+    current_image = image;
+    current_size = size;
+    current_level = -1;
+    current_maps = maps;
+    chessboard_item->setChessboard(QVector<QPointF>(),0,0);
+    scene()->setSceneRect(QRectF(QPointF(0,0),size));
+
+    QPixmap pixmap;
+    if(!maps.empty())
+    {
+        if(QPixmapCache::find(undistortedKey(key,maps),&pixmap))
+            showPreview(pixmap,PREVIEW_FULL);
+        else
+            startUndistortion();
+    }
+
+    // show the best level which is already available
+    for(int level=PREVIEW_FULL;level >= PREVIEW_THUMBNAIL && current_level < 0;--level)
+    {
+        if(QPixmapCache::find(previewKey(key,level),&pixmap))
+            showPreview(pixmap,static_cast<PreviewLevel>(level));
+    }
+    if(current_level < 0)
+        pixmap_item->setPixmap(QPixmap());
     fitImage();
 }
 
+void ImageView::startUndistortion()
+{
+    // only the latest request waits for the running remap
+    if(undistortion_running)
+    {
+        undistortion_queued = true;
+        return;
+    }
+    undistortion_running = true;
+    undistortion_queued = false;
+    QFutureWatcher<QImage> *watcher = new QFutureWatcher<QImage>(this);
+    watcher->setProperty("key",undistortedKey(current_key,current_maps));
+    connect(watcher,SIGNAL(finished()),SLOT(undistortionFinished()));
+    watcher->setFuture(QtConcurrent::run(ImageView::undistortImage,current_key,current_image,current_maps));
+}
+
+void ImageView::undistortionFinished()
+{
+    QFutureWatcher<QImage> *watcher = dynamic_cast<QFutureWatcher<QImage>*>(sender());
+    if(!watcher)
+        return;
+    const QString key = watcher->property("key").toString();
+    QImage image = watcher->result();
+    watcher->deleteLater();
+    undistortion_running = false;
+
+    const bool current = !current_maps.empty() && key == undistortedKey(current_key,current_maps);
+    QPixmap pixmap;
+    if(!image.isNull())
+    {
+        ScopedProfile profile("pixmap conversion",key);
+        pixmap = QPixmap::fromImage(image);
+        profile.addAllocation(image.byteCount());
+        QPixmapCache::insert(key,pixmap);
+        if(current)
+            showPreview(pixmap,PREVIEW_FULL);
+    }
+    else if(current)
+    {
+        // the maps do not fit the image, fall back to the distorted previews
+        current_maps = UndistortMaps();
+        updatePreview();
+    }
+
+    const bool queued = undistortion_queued;
+    undistortion_queued = false;
+    if(queued && !current_maps.empty() && !QPixmapCache::find(undistortedKey(current_key,current_maps),&pixmap))
+        startUndistortion();
+}
+
+void ImageView::displayLiveFrame(const QImage &frame)
+{
+    removeWelcome();
+    current_maps = UndistortMaps();
+    const bool resized = !current_key.isEmpty() || current_size != frame.size();
+    current_key.clear();
+    current_image = QImage();
+    current_size = frame.size();
+    current_level = PREVIEW_FULL;
+    {
+        ScopedProfile profile("live frame display");
+        pixmap_item->setPixmap(QPixmap::fromImage(frame));
+    }
+    pixmap_item->setScale(1);
+    if(resized)
+    {
+        scene()->setSceneRect(QRectF(QPointF(0,0),current_size));
+        fitImage();
+    }
+}
+
+void ImageView::showPreview(const QPixmap &pixmap,PreviewLevel level)
+{
+    pixmap_item->setPixmap(pixmap);
+    if(pixmap.width() > 0)
+        pixmap_item->setScale(qreal(current_size.width())/pixmap.width());
+    current_level = level;
+}
+
+void ImageView::updatePreview()
+{
+    // undistorted images are always shown in full resolution
+    if(current_key.isEmpty() || !current_maps.empty())
+        return;
+
+    // select the level which matches the displayed size of the image
+    const qreal extent = qMax(current_size.width()*transform().m11(),current_size.height()*transform().m22());
+    PreviewLevel level = PREVIEW_FULL;
+    if(extent <= PREVIEW_SIZES[PREVIEW_THUMBNAIL])
+        level = PREVIEW_THUMBNAIL;
+    else if(extent <= PREVIEW_SIZES[PREVIEW_SCREEN])
+        level = PREVIEW_SCREEN;
+    if(level <= current_level)
+        return;
+
+    QPixmap pixmap;
+    if(QPixmapCache::find(previewKey(current_key,level),&pixmap))
+    {
+        showPreview(pixmap,level);
+        return;
+    }
+
+    // generate all missing levels up to the required one, lower levels first
+    for(int i=PREVIEW_THUMBNAIL;i <= level;++i)
+    {
+        const QString preview_key = previewKey(current_key,i);
+        if(i <= current_level || pending_previews.contains(preview_key))
+            continue;
+        pending_previews.insert(preview_key);
+        QFutureWatcher<QImage> *watcher = new QFutureWatcher<QImage>(this);
+        watcher->setProperty("key",current_key);
+        watcher->setProperty("level",i);
+        connect(watcher,SIGNAL(finished()),SLOT(previewFinished()));
+        watcher->setFuture(QtConcurrent::run(ImageView::createPreview,current_key,current_image,static_cast<PreviewLevel>(i)));
+    }
+}
+
+void ImageView::previewFinished()
+{
+    QFutureWatcher<QImage> *watcher = dynamic_cast<QFutureWatcher<QImage>*>(sender());
+    if(!watcher)
+        return;
+    const QString key = watcher->property("key").toString();
+    const PreviewLevel level = static_cast<PreviewLevel>(watcher->property("level").toInt());
+    QImage image = watcher->result();
+    watcher->deleteLater();
+    pending_previews.remove(previewKey(key,level));
+    if(image.isNull())
+        return;
+
+    // pixmaps can only be created in the gui thread
+    ScopedProfile profile("pixmap conversion",key);
+    QPixmap pixmap = QPixmap::fromImage(image);
+    profile.addAllocation(image.byteCount());
+    QPixmapCache::insert(previewKey(key,level),pixmap);
+    if(key == current_key && level > current_level)
+        showPreview(pixmap,level);
+}
+
+void ImageView::displayChessboard(const QVector<QPointF> &corners,int cols,int rows)
+{
+    chessboard_item->setChessboard(corners,cols,rows);
+}
+
+void ImageView::displayHeatmap(const ResidualHeatmap &heatmap)
+{
+    if(heatmap.empty() || heatmap.max_error <= 0)
+    {
+        heatmap_item->setVisible(false);
+        heatmap_item->setPixmap(QPixmap());
+        return;
+    }
+
+    // one pixel per cell, empty cells are transparent
+    QImage image(heatmap.errors.cols,heatmap.errors.rows,QImage::Format_ARGB32);
+    for(int row=0;row < heatmap.errors.rows;++row)
+    {
+        QRgb *line = reinterpret_cast<QRgb*>(image.scanLine(row));
+        const float *errors = heatmap.errors.ptr<float>(row);
+        const int *counts = heatmap.counts.ptr<int>(row);
+        for(int col=0;col < heatmap.errors.cols;++col)
+        {
+            if(counts[col] == 0)
+            {
+                line[col] = qRgba(0,0,0,0);
+                continue;
+            }
+            const qreal value = qMin(qreal(1),errors[col]/heatmap.max_error);
+            line[col] = QColor::fromHsvF((1-value)*(2.0/3.0),1,1).rgba();
+        }
+    }
+    heatmap_item->setPixmap(QPixmap::fromImage(image));
+    heatmap_item->setScale(heatmap.cell_size);
+    heatmap_item->setToolTip(QString("rms residual per cell, max %1 px, %2 corners")
+                             .arg(heatmap.max_error,0,'f',3).arg(heatmap.corners));
+    heatmap_item->setVisible(true);
+}
+
 void ImageView::fitImage()
 {
     fitInView(scene()->sceneRect(),Qt::KeepAspectRatio);
+    updatePreview();
 }
 
 void ImageView::resizeEvent (QResizeEvent * event)
 {
     fitImage();
 }
+
+void ImageView::wheelEvent(QWheelEvent *event)
+{
+    if(current_key.isEmpty())
+        return;
+    const qreal factor = event->delta() > 0 ? 1.25 : 0.8;
+    scale(factor,factor);
+    updatePreview();
+    event->accept();
+}
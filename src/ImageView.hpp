@@ -2,23 +2,151 @@
 #define IMAGEVIEW_HPP
 
 #include <QGraphicsView>
+#include <QGraphicsItem>
+#include <QVector>
+#include <QPointF>
+#include <QSet>
+
+#include "Calibration.hpp"
 
 namespace qcam_calib
 {
+    /**
+     * \brief Draws detected chessboard corners as vector graphic on top of an image
+     *
+     * Corners of the same row share a color and consecutive corners are
+     * connected by lines, similar to cv::drawChessboardCorners.
+     */
+    class ChessboardItem : public QGraphicsItem
+    {
+        public:
+            ChessboardItem(QGraphicsItem *parent = 0);
+            virtual ~ChessboardItem();
+
+            void setChessboard(const QVector<QPointF> &corners,int cols,int rows);
+            virtual QRectF boundingRect()const;
+            virtual void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = 0);
+
+        private:
+            QVector<QPointF> corners;
+            int cols;
+            int rows;
+            qreal radius;
+            QRectF bounding_rect;
+    };
+
+    /**
+     * \brief Displays images through a multi-level preview cache
+     *
+     * Scaled down previews are generated on worker threads and the view shows the
+     * best level which is already available. Higher levels are requested in the
+     * background depending on the zoom factor, the full resolution image is only
+     * used if the view is zoomed in. The scene is always given in full
+     * resolution image coordinates.
+     */
     class ImageView : public QGraphicsView
     {
+        Q_OBJECT
         public:
+            enum PreviewLevel
+            {
+                PREVIEW_THUMBNAIL = 0,
+                PREVIEW_SCREEN = 1,
+                PREVIEW_FULL = 2
+            };
+
+            /**
+             * \brief Returns a preview of the image for the given level
+             *
+             * If image is null the image is loaded from the file key.
+             * Scaled previews are cached. This function is thread safe.
+             */
+            static QImage createPreview(const QString &key,const QImage &image,PreviewLevel level);
+
+            /**
+             * \brief Generates and caches the thumbnail of an already decoded image
+             */
+            static void cacheThumbnail(const QString &key,const QImage &image);
+
+            /**
+             * \brief Returns the undistorted full resolution image
+             *
+             * If image is null the image is loaded from the file key. Returns
+             * a null image if the size does not match the maps. This function
+             * is thread safe.
+             */
+            static QImage undistortImage(const QString &key,const QImage &image,const UndistortMaps &maps);
+
             ImageView(QWidget *parent = 0);
             virtual ~ImageView();
 
         public slots:
             void displayImage(const QImage &image);
+
+            /**
+             * \brief Displays an image through the preview cache
+             *
+             * \param[in] key The file of the image or a unique key for images held in memory
+             * \param[in] size The full resolution size of the image
+             * \param[in] image The image if it is not stored in the file key
+             */
+            void displayImage(const QString &key,const QSize &size,const QImage &image = QImage());
+
+            /**
+             * \brief Displays an image undistorted with the given maps
+             *
+             * Until the image is remapped on a worker thread the best available
+             * preview of the distorted image is shown. Undistorted images are
+             * cached like previews. While a remap is running only the latest
+             * request is queued, so flipping through images does not pile up work.
+             */
+            void displayUndistortedImage(const QString &key,const QSize &size,const QImage &image,const UndistortMaps &maps);
+            void displayChessboard(const QVector<QPointF> &corners,int cols,int rows);
+
+            /**
+             * \brief Displays the residual heatmap of a calibration on top of the image
+             *
+             * The cells are colored from blue (no residual) to red (largest
+             * residual of the heatmap). An empty heatmap hides the overlay.
+             */
+            void displayHeatmap(const ResidualHeatmap &heatmap);
+
+            /**
+             * \brief Displays a frame of a live stream
+             *
+             * The frame bypasses the preview cache and the zoom is kept as long
+             * as the frame size does not change. The chessboard is not cleared.
+             */
+            void displayLiveFrame(const QImage &frame);
             virtual void resizeEvent(QResizeEvent * event);
+            virtual void wheelEvent(QWheelEvent *event);
             void fitImage();
 
+        private slots:
+            void previewFinished();
+            void undistortionFinished();
+
+        private:
+            void removeWelcome();
+            void updatePreview();
+            void showPreview(const QPixmap &pixmap,PreviewLevel level);
+            void startUndistortion();
+
         private:
             QGraphicsPixmapItem *pixmap_item;
+            ChessboardItem *chessboard_item;
+            QGraphicsPixmapItem *heatmap_item;
             QGraphicsTextItem *welcome;
+
+            QString current_key;
+            QImage current_image;
+            QSize current_size;
+            int current_level;          // level which is displayed, -1 if none
+            QSet<QString> pending_previews;
+
+            UndistortMaps current_maps;         // empty if the image is shown distorted
+            bool undistortion_running;
+            bool undistortion_queued;
     };
 }
 
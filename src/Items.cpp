@@ -5,23 +5,29 @@
 #include <iostream>
 
 #include "Items.hpp"
+#include "Profiler.hpp"
+#include "ImageBuffer.hpp"
 #include <stdexcept>
 #include <QMutex>
+#include <QMutexLocker>
+#include <QCache>
 
 using namespace qcam_calib;
 
-QVector<QPointF> convertToQt(const std::vector<cv::Point2f>&points1)
+QVector<QPointF> qcam_calib::convertToQt(const std::vector<cv::Point2f>&points1)
 {
     QVector<QPointF> points2;
+    points2.reserve(points1.size());
     std::vector<cv::Point2f>::const_iterator iter = points1.begin();
     for(;iter != points1.end();++iter)
         points2.push_back(QPointF(iter->x,iter->y));
     return points2;
 }
 
-std::vector<cv::Point2f> convertFromQt(const QVector<QPointF>&points1)
+std::vector<cv::Point2f> qcam_calib::convertFromQt(const QVector<QPointF>&points1)
 {
     std::vector<cv::Point2f> points2;
+    points2.reserve(points1.size());
     QVector<QPointF>::const_iterator iter = points1.begin();
     for(;iter != points1.end();++iter)
         points2.push_back(cv::Point2f(iter->x(),iter->y()));
@@ -29,22 +35,40 @@ std::vector<cv::Point2f> convertFromQt(const QVector<QPointF>&points1)
 }
 
 CameraParameterItem::CameraParameterItem(const QString &string):
-    QCamCalibItem(string)
+    QCamCalibItem(string),
+    distortion(DISTORTION_RADIAL_TANGENTIAL)
 {
     setEditable(false);
     setColumnCount(2);
+    createRows();
+};
 
+void CameraParameterItem::createRows()
+{
     setParameter("fx",0);
     setParameter("fy",0);
     setParameter("cx",0);
     setParameter("cy",0);
-    setParameter("k1",0);
-    setParameter("k2",0);
-    setParameter("p1",0);
-    setParameter("p2",0);
+    for(int i=0;i < getDistortionCoeffCount(distortion);++i)
+        setParameter(getDistortionCoeffName(distortion,i),0);
     setParameter("projection error",0);
     setParameter("pixel error",0);
-};
+    setParameter("rejected views",0);
+}
+
+void CameraParameterItem::setDistortionModel(DistortionModel distortion)
+{
+    if(this->distortion == distortion)
+        return;
+    this->distortion = distortion;
+    removeRows(0,rowCount());
+    createRows();
+}
+
+DistortionModel CameraParameterItem::getDistortionModel()const
+{
+    return distortion;
+}
 
 
 void CameraParameterItem::setParameter(const QString &name,double val)
@@ -85,34 +109,15 @@ double CameraParameterItem::getParameter(const QString &name)const
     return 0;
 }
 
-void CameraParameterItem::save(const QString &path)const
-{
-    cv::Mat k = cv::Mat::zeros(3,3,CV_64FC1);
-    cv::Mat dist(4,1,CV_64FC1);
-    k.at<double>(0,0) = getParameter("fx");
-    k.at<double>(1,1) = getParameter("fy");
-    k.at<double>(0,2) = getParameter("cx");
-    k.at<double>(1,2) = getParameter("cy");
-    k.at<double>(2,2) = 1.0;
-    dist.at<double>(0) = getParameter("k1");
-    dist.at<double>(1) = getParameter("k2");
-    dist.at<double>(2) = getParameter("p1");
-    dist.at<double>(3) = getParameter("p2");
-    
-    cv::FileStorage fs(path.toStdString(), cv::FileStorage::WRITE);
-    time_t rawtime; time(&rawtime);
-    fs << "calibrationDate" << asctime(localtime(&rawtime));
-    fs << "cameraMatrix" << k << "distCoeffs" << dist;
-    fs.release();
-}
-
-CameraItem::CameraItem(int id, const QString &string):
+CameraItem::CameraItem(const DatasetPtr &dataset,int id, const QString &string):
     QCamCalibItem(string),
+    dataset(dataset),
     camera_id(id),
     camera_parameter(NULL),
     images(NULL)
 {
     setEditable(false);
+    dataset->addCamera(id,string.toStdString());
     camera_parameter = new CameraParameterItem("Parameter");
     appendRow(camera_parameter);
 
@@ -121,81 +126,155 @@ CameraItem::CameraItem(int id, const QString &string):
     appendRow(images);
 };
 
+CameraItem::~CameraItem()
+{
+    dataset->removeCamera(camera_id);
+}
+
 int CameraItem::getId()
 {
     return camera_id;
 }
 
+CameraDataPtr CameraItem::getData()const
+{
+    return dataset->getCamera(camera_id);
+}
+
 bool CameraItem::isCalibrated()
 {
-    return (camera_parameter->getParameter("fx") > 0);
+    return getData()->calibration.get() != NULL;
 }
 
 void CameraItem::saveParameter(const QString &path)const
 {
-    camera_parameter->save(path);
+    // the tree only shows rounded values, the calibration is saved with full precision
+    CameraDataPtr data = getData();
+    if(!data->calibration)
+        throw std::runtime_error("the camera is not calibrated");
+    saveCalibration(path.toStdString(),*data->calibration);
 }
 
 int CameraItem::countChessboards()
 {
-    int count = 0;
-    for(int row=0;row < images->rowCount(); ++row)
-    {
-        ImageItem *item = dynamic_cast<ImageItem*>(images->child(row,0));
-        if(item && !item->getChessboardCorners().empty())
-            ++count;
-    }
-    return count;
+    return getData()->countChessboards();
 }
 
 void CameraItem::calibrate(int cols,int rows,float dx,float dy)
 {
+    CameraDataPtr data = getData();
+    setCalibration(calibrateCamera(createCalibrationData(*data,cols,rows,dx,dy),NULL,30,data->calibration.get(),data->solver));
+}
 
-    std::vector<std::vector<cv::Point3f> > object_points;
-    std::vector<std::vector<cv::Point2f> > image_points;
-    cv::Size image_size;
+CalibrationData CameraItem::getCalibrationData(int cols,int rows,float dx,float dy)
+{
+    return createCalibrationData(*getData(),cols,rows,dx,dy);
+}
 
-    //generate chessboard points
-    std::vector<cv::Point3f> points3f;
-    for(int row=0;row < rows; ++row)
-    {
-        for(int col=0;col < cols; ++col)
-            points3f.push_back(cv::Point3f(dx*col,dy*row,0));
-    }
+UndistortMaps CameraItem::getUndistortMaps()
+{
+    boost::shared_ptr<const CalibrationResult> calibration = getData()->calibration;
+    if(calibration == undistort_calibration)
+        return undistort_maps;
+    undistort_maps = calibration ? createUndistortMaps(*calibration) : UndistortMaps();
+    undistort_calibration = calibration;
+    return undistort_maps;
+}
+
+ResidualHeatmap CameraItem::getResidualHeatmap(int cols,int rows,float dx,float dy)
+{
+    // each change of the camera creates a new snapshot in the Dataset
+    CameraDataPtr data = getData();
+    const QString board = QString("%1x%2x%3x%4").arg(cols).arg(rows).arg(dx).arg(dy);
+    if(data == heatmap_data && board == heatmap_board)
+        return heatmap;
+
+    heatmap = ResidualHeatmap();
+    if(data->calibration)
+        heatmap = computeResidualHeatmap(createCalibrationData(*data,cols,rows,dx,dy),*data->calibration);
+    heatmap_data = data;
+    heatmap_board = board;
+    return heatmap;
+}
+
+void CameraItem::setCalibration(const CalibrationResult &result)
+{
+    dataset->setCalibration(camera_id,result);
+    updateView();
+}
+
+void CameraItem::setDetector(const DetectorSettings &detector)
+{
+    dataset->setDetector(camera_id,detector);
+}
+
+DetectorSettings CameraItem::getDetector()const
+{
+    return getData()->detector;
+}
+
+void CameraItem::setSolver(CalibrationSolver solver)
+{
+    dataset->setSolver(camera_id,solver);
+}
+
+CalibrationSolver CameraItem::getSolver()const
+{
+    return getData()->solver;
+}
+
+void CameraItem::setDistortionModel(DistortionModel distortion)
+{
+    dataset->setDistortionModel(camera_id,distortion);
+    if(!getData()->calibration)
+        camera_parameter->setDistortionModel(distortion);
+}
 
-    //collect image points
+DistortionModel CameraItem::getDistortionModel()const
+{
+    return getData()->distortion;
+}
+
+void CameraItem::updateView()
+{
+    // the chessboards are shown even if the calibration failed
     for(int row=0;row < images->rowCount(); ++row)
     {
         ImageItem *item = dynamic_cast<ImageItem*>(images->child(row,0));
-        if(item && item->getChessboardCorners().size() ==(int) points3f.size())
-        {
-            image_size = cv::Size(item->getImage().width(),item->getImage().height());
-            image_points.push_back(convertFromQt(item->getChessboardCorners()));
-            object_points.push_back(points3f);
-        }
+        if(item)
+            item->updateView();
     }
-    if(object_points.size() < 1)
-        throw std::runtime_error("not enough detected chessboards");
-
-    cv::Mat k(3,3,CV_64FC1);
-    cv::Mat dist(4,1,CV_64FC1);
-    std::vector<cv::Mat> rvecs;
-    std::vector<cv::Mat> tvecs;
-    double error = cv::calibrateCamera(object_points,image_points,
-                                       image_size,k,dist,rvecs,tvecs,0);
-                                       //cv::TermCriteria(cv::TermCriteria::COUNT+cv::TermCriteria::EPS, 50, DBL_EPSILON));
-
-    //store parameters
+
+    CameraDataPtr data = getData();
+    if(!data->calibration)
+        return;
+
+    //display parameters
+    const CalibrationResult &result = *data->calibration;
+    const cv::Mat &k = result.camera_matrix;
+    const cv::Mat &dist = result.dist_coeffs;
+    camera_parameter->setDistortionModel(result.distortion);
     camera_parameter->setParameter("fx",k.at<double>(0,0));
     camera_parameter->setParameter("fy",k.at<double>(1,1));
     camera_parameter->setParameter("cx",k.at<double>(0,2));
     camera_parameter->setParameter("cy",k.at<double>(1,2));
-    camera_parameter->setParameter("k1",dist.at<double>(0));
-    camera_parameter->setParameter("k2",dist.at<double>(1));
-    camera_parameter->setParameter("p1",dist.at<double>(2));
-    camera_parameter->setParameter("p2",dist.at<double>(3));
-    camera_parameter->setParameter("projection error",error);
-    camera_parameter->setParameter("pixel error",sqrt(error/points3f.size()));
+    for(int i=0;i < dist.rows;++i)
+        camera_parameter->setParameter(getDistortionCoeffName(result.distortion,i),dist.at<double>(i));
+    camera_parameter->setParameter("projection error",result.error);
+    camera_parameter->setParameter("pixel error",result.pixel_error);
+    camera_parameter->setParameter("rejected views",result.rejected_ids.size());
+}
+
+ImageItem *CameraItem::appendImage(const ImageDataPtr &data)
+{
+    ImageItem *item = new ImageItem(dataset,camera_id,data);
+    QList<QStandardItem*> items;
+    items.append(item);
+    items.back()->setEditable(false);
+    items.append(new QCamCalibItem("no chessboard"));
+    items.back()->setEditable(false);
+    images->appendRow(items);
+    return item;
 }
 
 ImageItem* CameraItem::getImageItem(const QString &name)
@@ -211,91 +290,237 @@ ImageItem* CameraItem::getImageItem(const QString &name)
 
 ImageItem *CameraItem::addImage(const QString &name,const QImage &image)
 {
-    ImageItem *item = new ImageItem(name,image);
-    QList<QStandardItem*> items;
-    items.append(item);
-    items.back()->setEditable(false);
-    items.append(new QCamCalibItem("no chessboard"));
-    items.back()->setEditable(false);
-    images->appendRow(items);
-    return item;
+    ImageData data;
+    data.name = name.toStdString();
+    data.image = image;
+    data.size = cv::Size(image.width(),image.height());
+    return appendImage(dataset->addImage(camera_id,data));
+}
+
+ImageItem *CameraItem::addImage(const QString &name,const QString &path,const QSize &size)
+{
+    ImageData data;
+    data.name = name.toStdString();
+    data.path = path.toStdString();
+    data.size = cv::Size(size.width(),size.height());
+    return appendImage(dataset->addImage(camera_id,data));
+}
+
+QList<ImageItem*> CameraItem::addImages(const std::vector<ImageData> &images)
+{
+    ScopedProfile profile("add images",text());
+    const std::vector<ImageDataPtr> stored = dataset->addImages(camera_id,images);
+    QList<ImageItem*> items;
+    std::vector<ImageDataPtr>::const_iterator iter = stored.begin();
+    for(;iter != stored.end();++iter)
+    {
+        ImageItem *item = appendImage(*iter);
+        item->updateView();
+        items << item;
+    }
+    return items;
 }
 
-ImageItem::ImageItem(const QString &name, const QImage &image):
-    QCamCalibItem(name),
-    raw_image(image.copy()),
-    image(raw_image)
+// decoded images of file backed image items, cost is given in kbytes
+static QCache<QString,QImage> image_cache(512*1024);
+static QMutex image_cache_mutex;
+
+QImage ImageItem::loadImage(const QString &path)
 {
+    {
+        QMutexLocker locker(&image_cache_mutex);
+        QImage *image = image_cache.object(path);
+        if(image)
+            return *image;
+    }
+    QImage image(path);
+    if(!image.isNull())
+        cacheImage(path,image);
+    return image;
 }
+
+void ImageItem::cacheImage(const QString &path,const QImage &image)
+{
+    QMutexLocker locker(&image_cache_mutex);
+    image_cache.insert(path,new QImage(image),image.byteCount()/1024+1);
+}
+
+void ImageItem::setImageCacheSize(int kbytes)
+{
+    QMutexLocker locker(&image_cache_mutex);
+    image_cache.setMaxCost(kbytes);
+}
+
+int ImageItem::getImageCacheSize()
+{
+    QMutexLocker locker(&image_cache_mutex);
+    return image_cache.maxCost();
+}
+
+QImage ImageItem::getImage(const ImageData &data)
+{
+    if(data.path.empty())
+        return data.image;
+    return loadImage(QString::fromStdString(data.path));
+}
+
+ImageItem::ImageItem(const DatasetPtr &dataset,int camera_id,const ImageDataPtr &data):
+    QCamCalibItem(QString::fromStdString(data->name)),
+    dataset(dataset),
+    camera_id(camera_id),
+    image_id(data->id)
+{
+}
+
 ImageItem::~ImageItem()
 {
+    dataset->removeImage(camera_id,image_id);
 }
 
-const QVector<QPointF> &ImageItem::getChessboardCorners()const
+int ImageItem::getId()const
 {
-    return chessboard;
+    return image_id;
 }
 
-QVector<QPointF> ImageItem::findChessboard(const QImage &image,int cols ,int rows)
+int ImageItem::getCameraId()const
+{
+    return camera_id;
+}
+
+ImageDataPtr ImageItem::getData()const
+{
+    return dataset->getImage(camera_id,image_id);
+}
+
+QVector<QPointF> ImageItem::getChessboardCorners()const
+{
+    return convertToQt(getData()->corners);
+}
+
+// images wider than this are downscaled before searching in DETECTION_PYRAMID mode
+static const int MAX_PYRAMID_DETECTION_WIDTH = 1024;
+
+QVector<QPointF> ImageItem::findChessboard(const QImage &image,int cols ,int rows,const DetectorSettings &detector)
 {
     std::vector<cv::Point2f> points;
-    QImage img = image.convertToFormat(QImage::Format_RGB888);
-    cv::Mat mat(img.height(), img.width(), CV_8UC3, img.bits(), img.bytesPerLine());
-    cv::Mat gray;
+    const cv::Size board_size(cols,rows);
+    ChessboardDetectorPtr engine = ChessboardDetector::create(detector);
+
+    // gray images are searched in place, the buffer keeps the pixels alive
+    ImageBuffer gray_buffer;
+    {
+        ScopedProfile profile("gray conversion");
+        gray_buffer = ImageBuffer(image).toGray();
+        if(gray_buffer.getConstMat().data != image.constBits())
+            profile.addAllocation(gray_buffer.getImage().byteCount());
+    }
+    const cv::Mat &gray = gray_buffer.getConstMat();
 
     //opencv is not thread save here
  //   static QMutex mutex;
  //   mutex.lock();
-    cv::cvtColor(mat,gray,cv::COLOR_RGB2GRAY);
-    cv::findChessboardCorners(gray,cv::Size(cols,rows),points,cv::CALIB_CB_ADAPTIVE_THRESH + cv::CALIB_CB_NORMALIZE_IMAGE + cv::CALIB_CB_FAST_CHECK);
+    if(detector.mode == DETECTION_PYRAMID && gray.cols > MAX_PYRAMID_DETECTION_WIDTH)
+    {
+        cv::Mat small = gray;
+        int scale = 1;
+        {
+            ScopedProfile profile("pyramid");
+            while(small.cols > MAX_PYRAMID_DETECTION_WIDTH)
+            {
+                cv::Mat temp;
+                cv::pyrDown(small,temp);
+                profile.addAllocation(temp.total());
+                small = temp;
+                scale *= 2;
+            }
+        }
+        bool found = false;
+        {
+            ScopedProfile profile("downscaled search");
+            found = engine->find(small,board_size,points);
+        }
+        if(found)
+        {
+            // map pixel centers back to full resolution and refine there
+            std::vector<cv::Point2f>::iterator iter = points.begin();
+            for(;iter != points.end();++iter)
+            {
+                iter->x = (iter->x+0.5f)*scale-0.5f;
+                iter->y = (iter->y+0.5f)*scale-0.5f;
+            }
+            ScopedProfile profile("cornerSubPix");
+            cv::cornerSubPix(gray,points,cv::Size(scale+2,scale+2),cv::Size(-1,-1),
+                             cv::TermCriteria(cv::TermCriteria::COUNT+cv::TermCriteria::EPS,30,0.01));
+            return convertToQt(points);
+        }
+        points.clear();
+    }
+    engine->find(gray,board_size,points);
  //   mutex.unlock();
 
     return convertToQt(points);
 }
 
-bool ImageItem::findChessboard(int cols ,int rows)
+bool ImageItem::findChessboard(int cols ,int rows,const DetectorSettings &detector)
 {
-    setChessboard(ImageItem::findChessboard(raw_image,cols,rows),cols,rows);
-    if(chessboard.empty())
+    setChessboard(ImageItem::findChessboard(getImage(),cols,rows,detector),cols,rows);
+    if(getData()->corners.empty())
         return false;
     return true;
 }
 
 void ImageItem::setChessboard(const QVector<QPointF> &chessboard,int cols,int rows)
 {
-    this->chessboard = chessboard;
-    if(chessboard.empty())
-        image = raw_image;
-    else
-    {
-        QImage img = raw_image.convertToFormat(QImage::Format_RGB888);
-        cv::Mat mat(img.height(), img.width(), CV_8UC3, img.bits(), img.bytesPerLine());
-        std::vector<cv::Point2f> points = convertFromQt(chessboard);
-        cv::drawChessboardCorners(mat,cv::Size(cols,rows),points,true);
-        image = QImage(mat.data, mat.cols, mat.rows,mat.step,QImage::Format_RGB888).copy();
-    }
+    ScopedProfile profile("setChessboard",text());
+    dataset->setChessboard(camera_id,image_id,convertFromQt(chessboard),cv::Size(cols,rows));
+    updateView();
+}
+
+void ImageItem::updateView()
+{
     if(parent())
     {
         QStandardItem *item = parent()->child(row(),1);
         if(item)
         {
-            if(!chessboard.empty())
+            // show the reprojection error of the view once the camera is calibrated
+            CameraDataPtr camera = dataset->getCamera(camera_id);
+            const double error = camera->calibration ? camera->calibration->getViewError(image_id) : -1;
+            const bool rejected = camera->calibration && camera->calibration->isRejected(image_id);
+            if(getData()->corners.empty())
+                item->setText("no chessboard");
+            else if(error < 0 && camera->calibration)
+                item->setText("not used");
+            else if(error < 0)
                 item->setText("ok");
+            else if(rejected)
+                item->setText(QString("rejected (%1 px)").arg(error,0,'f',3));
             else
-                item->setText("no chessboard");
+                item->setText(QString("%1 px").arg(error,0,'f',3));
+            item->setForeground(rejected ? QBrush(Qt::red) : QBrush());
+            setForeground(rejected ? QBrush(Qt::red) : QBrush());
         }
     }
 }
 
-
-QImage &ImageItem::getImage()
+QImage ImageItem::getImage()const
 {
-    return image;
+    return getImage(*getData());
 }
 
-QImage &ImageItem::getRawImage()
+QSize ImageItem::getImageSize()const
 {
-    return raw_image;
+    ImageDataPtr data = getData();
+    return QSize(data->size.width,data->size.height);
 }
 
+QString ImageItem::getPath()const
+{
+    return QString::fromStdString(getData()->path);
+}
 
+QSize ImageItem::getChessboardSize()const
+{
+    ImageDataPtr data = getData();
+    return QSize(data->board_size.width,data->board_size.height);
+}
@@ -5,14 +5,21 @@
 #include <QMenu>
 #include <QVector>
 
+#include "Calibration.hpp"
+#include "Dataset.hpp"
+#include "ChessboardDetector.hpp"
+
 namespace qcam_calib
 {
+    QVector<QPointF> convertToQt(const std::vector<cv::Point2f>&points);
+    std::vector<cv::Point2f> convertFromQt(const QVector<QPointF>&points);
+
     class QCamCalibItem: public QStandardItem
     {
         public:
             QCamCalibItem():QStandardItem(){};
             QCamCalibItem(const QString &string):QStandardItem(string){};
-            QCamCalibItem(float val):QStandardItem(val){};
+            QCamCalibItem(float val):QStandardItem(){setText(QString::number(val));};
     };
 
     class CameraParameterItem: public QCamCalibItem
@@ -20,46 +27,147 @@ namespace qcam_calib
         public:
             CameraParameterItem(const QString &string);
             void setParameter(const QString &name,double val=0);
-            void save(const QString &path)const;
             double getParameter(const QString &name)const;
+
+            /**
+             * \brief Replaces the coefficient rows with the ones of the given model
+             */
+            void setDistortionModel(DistortionModel distortion);
+            DistortionModel getDistortionModel()const;
+
+        private:
+            void createRows();
+
+            DistortionModel distortion;
     };
 
+    /**
+     * \brief View of an image stored in the Dataset
+     *
+     * Images loaded from disk only keep a reference to their file. The decoded
+     * pixels are shared through a bounded LRU cache and are decoded again on
+     * demand. Images added from memory share the given QImage without copying it.
+     */
     class ImageItem : public QCamCalibItem
     {
         public:
-            static QVector<QPointF> findChessboard(const QImage &image,int cols ,int rows);
+            static QVector<QPointF> findChessboard(const QImage &image,int cols ,int rows,const DetectorSettings &detector=DetectorSettings());
+
+            /**
+             * \brief Returns the decoded image of the given file
+             *
+             * The image is taken from the image cache if possible. This function is thread safe.
+             */
+            static QImage loadImage(const QString &path);
+            static void cacheImage(const QString &path,const QImage &image);
+            static void setImageCacheSize(int kbytes);
+            static int getImageCacheSize();
+
+            /**
+             * \brief Returns the pixels of a stored image. This function is thread safe.
+             */
+            static QImage getImage(const ImageData &data);
 
-            ImageItem(const QString &name, const QImage &image);
+            ImageItem(const DatasetPtr &dataset,int camera_id,const ImageDataPtr &data);
             virtual ~ImageItem();
-            QImage &getImage();
-            QImage &getRawImage();
-            const QVector<QPointF> &getChessboardCorners()const;
+            int getId()const;
+            int getCameraId()const;
+            ImageDataPtr getData()const;
+            QImage getImage()const;
+            QSize getImageSize()const;
+            QString getPath()const;
+            QVector<QPointF> getChessboardCorners()const;
+            QSize getChessboardSize()const;
 
-            bool findChessboard(int cols ,int rows);
+            bool findChessboard(int cols ,int rows,const DetectorSettings &detector=DetectorSettings());
             void setChessboard(const QVector<QPointF> &chessboard,int cols,int rows);
 
+            /**
+             * \brief Updates the displayed state from the Dataset
+             */
+            void updateView();
+
         private:
-            QImage raw_image;
-            QImage image;     // image with chessboard overlay
-            QVector<QPointF> chessboard;
+            DatasetPtr dataset;
+            int camera_id;
+            int image_id;
     };
 
+    /**
+     * \brief View of a camera stored in the Dataset
+     */
     class CameraItem: public QCamCalibItem
     {
         public:
-            CameraItem(int id, const QString &string);
+            CameraItem(const DatasetPtr &dataset,int id, const QString &string);
+            virtual ~CameraItem();
             int getId();
+            CameraDataPtr getData()const;
             ImageItem* addImage(const QString &name,const QImage &image);
+            ImageItem* addImage(const QString &name,const QString &path,const QSize &size);
+
+            /**
+             * \brief Adds several images with one modification of the Dataset
+             *
+             * Meant for bulk loading, the images might already carry their chessboards.
+             */
+            QList<ImageItem*> addImages(const std::vector<ImageData> &images);
             ImageItem* getImageItem(const QString &name);
             void calibrate(int cols,int rows,float dx,float dy);
+
+            /**
+             * \brief Collects the detected chessboards for calibrating the camera
+             *
+             * The returned data can be passed to qcam_calib::calibrateCamera on any thread.
+             */
+            CalibrationData getCalibrationData(int cols,int rows,float dx,float dy);
+            void setCalibration(const CalibrationResult &result);
+            void setDetector(const DetectorSettings &detector);
+            DetectorSettings getDetector()const;
+            void setSolver(CalibrationSolver solver);
+            CalibrationSolver getSolver()const;
+            void setDistortionModel(DistortionModel distortion);
+            DistortionModel getDistortionModel()const;
+
+            /**
+             * \brief Updates the displayed parameters from the Dataset
+             */
+            void updateView();
             void saveParameter(const QString &path)const;
             bool isCalibrated();
             int countChessboards();
 
+            /**
+             * \brief Returns the residual heatmap of the current calibration
+             *
+             * The heatmap is cached until the camera data or the chessboard
+             * config changes. It is empty if the camera is not calibrated.
+             */
+            ResidualHeatmap getResidualHeatmap(int cols,int rows,float dx,float dy);
+
+            /**
+             * \brief Returns the undistortion maps of the current calibration
+             *
+             * The maps are built once per calibration. They are empty if the
+             * camera is not calibrated.
+             */
+            UndistortMaps getUndistortMaps();
+
         private:
+            ImageItem* appendImage(const ImageDataPtr &data);
+
+        private:
+            DatasetPtr dataset;
             int camera_id;
             CameraParameterItem* camera_parameter;
             QStandardItem *images;
+
+            ResidualHeatmap heatmap;
+            CameraDataPtr heatmap_data;         // snapshot the heatmap was computed from
+            QString heatmap_board;
+
+            UndistortMaps undistort_maps;
+            boost::shared_ptr<const CalibrationResult> undistort_calibration;
     };
 
 }
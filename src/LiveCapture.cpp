@@ -0,0 +1,379 @@
+#include "LiveCapture.hpp"
+#include "ImageBuffer.hpp"
+#include "Profiler.hpp"
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <QMetaType>
+#include <QMutexLocker>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+
+#if CV_MAJOR_VERSION >= 3
+static const int PROP_FPS = cv::CAP_PROP_FPS;
+#else
+static const int PROP_FPS = CV_CAP_PROP_FPS;
+#endif
+
+using namespace qcam_calib;
+
+// runs a loop of the LiveCapture on its own thread
+// long running loops would block the global thread pool otherwise
+class LiveThread : public QThread
+{
+    public:
+        LiveThread(void (*function)(LiveCapture*),LiveCapture *capture):
+            function(function),
+            capture(capture)
+        {
+        }
+
+    protected:
+        virtual void run()
+        {
+            function(capture);
+        }
+
+    private:
+        void (*function)(LiveCapture*);
+        LiveCapture *capture;
+};
+
+OpenCVFrameSource::OpenCVFrameSource(int device):
+    period(0),
+    next_frame(0)
+{
+    capture.open(device);
+    timer.start();
+}
+
+OpenCVFrameSource::OpenCVFrameSource(const QString &path):
+    period(0),
+    next_frame(0)
+{
+    if(capture.open(path.toStdString()))
+    {
+        double fps = capture.get(PROP_FPS);
+        if(fps <= 0 || fps > 1000)
+            fps = 30;
+        period = qint64(1e9/fps);
+    }
+    timer.start();
+}
+
+OpenCVFrameSource::~OpenCVFrameSource()
+{
+}
+
+bool OpenCVFrameSource::isOpened()const
+{
+    return capture.isOpened();
+}
+
+bool OpenCVFrameSource::grab(QImage &image)
+{
+    {
+        ScopedProfile profile("live grab");
+        if(!capture.read(frame) || frame.empty())
+            return false;
+    }
+
+    // replay files with their frame rate
+    if(period > 0)
+    {
+        const qint64 now = timer.nsecsElapsed();
+        if(next_frame > now)
+        {
+            // QThread::msleep is not public in Qt4
+            QMutex mutex;
+            QWaitCondition condition;
+            QMutexLocker locker(&mutex);
+            condition.wait(&mutex,(unsigned long)((next_frame-now)/1000000));
+        }
+        next_frame = std::max(next_frame,now)+period;
+    }
+
+    ScopedProfile profile("live frame conversion");
+    if(frame.type() == CV_8UC3)
+    {
+        ImageBuffer buffer(frame.cols,frame.rows,CV_8UC3);
+        cv::cvtColor(frame,buffer.getMat(),cv::COLOR_BGR2RGB);
+        image = buffer.getImage();
+    }
+    else if(frame.type() == CV_8UC1)
+    {
+        ImageBuffer buffer(frame.cols,frame.rows,CV_8UC1);
+        frame.copyTo(buffer.getMat());
+        image = buffer.getImage();
+    }
+    else
+        return false;
+    return true;
+}
+
+CaptureQuality::CaptureQuality():
+    max_detection_rate(5),
+    detector(DETECTION_PYRAMID),
+    tracking(false),
+    min_sharpness(20),
+    max_motion(2),
+    min_novelty(40),
+    min_interval(1)
+{
+}
+
+LiveStatistics::LiveStatistics():
+    frames(0),
+    dropped(0),
+    detections(0),
+    chessboards(0),
+    tracked(0),
+    accepted(0)
+{
+}
+
+LiveCapture::LiveCapture(QObject *parent):
+    QObject(parent),
+    source(NULL),
+    cols(0),
+    rows(0),
+    producer(NULL),
+    detector(NULL),
+    running(false),
+    latest_id(0),
+    last_detection(0),
+    last_accept(0)
+{
+    // detections are reported from the worker thread
+    qRegisterMetaType<QVector<QPointF> >("QVector<QPointF>");
+}
+
+LiveCapture::~LiveCapture()
+{
+    stop();
+}
+
+void LiveCapture::setQuality(const CaptureQuality &quality)
+{
+    if(isRunning())
+        throw std::runtime_error("LiveCapture: cannot change the quality gates while running");
+    this->quality = quality;
+}
+
+CaptureQuality LiveCapture::getQuality()const
+{
+    return quality;
+}
+
+void LiveCapture::start(FrameSource *source,int cols,int rows)
+{
+    if(isRunning())
+    {
+        delete source;
+        throw std::runtime_error("LiveCapture: capture is already running");
+    }
+    this->source = source;
+    this->cols = cols;
+    this->rows = rows;
+    tracker = ChessboardTracker(cols,rows,quality.detector);
+    last_corners.clear();
+    accepted.clear();
+    timer.start();
+    last_detection = -1;
+    last_accept = -1;
+    {
+        QMutexLocker locker(&mutex);
+        running = true;
+        latest_frame = QImage();
+        latest_id = 0;
+        statistics = LiveStatistics();
+    }
+    detector = new LiveThread(LiveCapture::detect,this);
+    detector->start();
+    if(source)
+    {
+        producer = new LiveThread(LiveCapture::produce,this);
+        producer->start();
+    }
+}
+
+bool LiveCapture::isRunning()const
+{
+    QMutexLocker locker(&mutex);
+    return running;
+}
+
+void LiveCapture::stop()
+{
+    {
+        QMutexLocker locker(&mutex);
+        running = false;
+        frame_available.wakeAll();
+    }
+    if(producer)
+    {
+        producer->wait();
+        delete producer;
+        producer = NULL;
+    }
+    if(detector)
+    {
+        detector->wait();
+        delete detector;
+        detector = NULL;
+    }
+    delete source;
+    source = NULL;
+}
+
+QImage LiveCapture::getLatestFrame(int *frame_id)const
+{
+    QMutexLocker locker(&mutex);
+    if(frame_id)
+        *frame_id = latest_id;
+    return latest_frame;
+}
+
+LiveStatistics LiveCapture::getStatistics()const
+{
+    QMutexLocker locker(&mutex);
+    return statistics;
+}
+
+void LiveCapture::pushFrame(const QImage &frame)
+{
+    QMutexLocker locker(&mutex);
+    if(!running || frame.isNull())
+        return;
+    latest_frame = frame;
+    ++latest_id;
+    ++statistics.frames;
+    frame_available.wakeAll();
+}
+
+void LiveCapture::produce(LiveCapture *capture)
+{
+    Profiler::setCurrentItem("live capture");
+    while(capture->isRunning())
+    {
+        QImage frame;
+        if(!capture->source->grab(frame))
+        {
+            emit capture->finished();
+            break;
+        }
+        capture->pushFrame(frame);
+    }
+}
+
+void LiveCapture::detect(LiveCapture *capture)
+{
+    Profiler::setCurrentItem("live capture");
+    const qint64 period = qint64(1e9/std::max(capture->quality.max_detection_rate,0.1));
+    int last_id = 0;
+    while(true)
+    {
+        QImage frame;
+        {
+            // wait for a new frame, newer frames replace the waiting one until the rate allows the next detection
+            QMutexLocker locker(&capture->mutex);
+            while(capture->running)
+            {
+                const qint64 remaining = capture->last_detection < 0 ? 0 : capture->last_detection+period-capture->timer.nsecsElapsed();
+                if(capture->latest_id != last_id && remaining <= 0)
+                    break;
+                const qint64 wait = capture->latest_id != last_id ? remaining : period;
+                capture->frame_available.wait(&capture->mutex,(unsigned long)std::max(wait/1000000,qint64(1)));
+            }
+            if(!capture->running)
+                break;
+            frame = capture->latest_frame;
+            capture->statistics.dropped += capture->latest_id-last_id-1;
+            ++capture->statistics.detections;
+            last_id = capture->latest_id;
+        }
+        capture->last_detection = capture->timer.nsecsElapsed();
+
+        QVector<QPointF> chessboard;
+        if(capture->quality.tracking)
+            chessboard = capture->tracker.track(frame);
+        else
+            chessboard = ImageItem::findChessboard(frame,capture->cols,capture->rows,capture->quality.detector);
+        std::vector<cv::Point2f> corners = convertFromQt(chessboard);
+        const bool accept = capture->checkQuality(frame,corners);
+        capture->last_corners = corners;
+        {
+            QMutexLocker locker(&capture->mutex);
+            if(!corners.empty())
+                ++capture->statistics.chessboards;
+            const TrackingStatistics tracking = capture->tracker.getStatistics();
+            capture->statistics.tracked = tracking.tracked+tracking.roi;
+            if(accept)
+                ++capture->statistics.accepted;
+        }
+        emit capture->detectionFinished(frame,chessboard);
+        if(accept)
+            emit capture->frameAccepted(frame,chessboard);
+    }
+}
+
+// mean distance between two sets of corners, the detector might return them in reversed order
+static double meanDistance(const std::vector<cv::Point2f> &corners1,const std::vector<cv::Point2f> &corners2)
+{
+    if(corners1.size() != corners2.size() || corners1.empty())
+        return -1;
+    const size_t count = corners1.size();
+    double sum = 0;
+    double sum_reversed = 0;
+    for(size_t i=0;i < count;++i)
+    {
+        const cv::Point2f d1 = corners1[i]-corners2[i];
+        const cv::Point2f d2 = corners1[i]-corners2[count-1-i];
+        sum += std::sqrt(d1.x*d1.x+d1.y*d1.y);
+        sum_reversed += std::sqrt(d2.x*d2.x+d2.y*d2.y);
+    }
+    return std::min(sum,sum_reversed)/count;
+}
+
+bool LiveCapture::checkQuality(const QImage &frame,const std::vector<cv::Point2f> &corners)
+{
+    if(corners.empty())
+        return false;
+    const qint64 now = timer.nsecsElapsed();
+    if(last_accept >= 0 && (now-last_accept)*1e-9 < quality.min_interval)
+        return false;
+
+    // the board must be still, otherwise it is blurred or distorted by a rolling shutter
+    const double motion = meanDistance(corners,last_corners);
+    if(motion < 0 || motion > quality.max_motion)
+        return false;
+
+    // the view must differ from all accepted views
+    std::vector<std::vector<cv::Point2f> >::const_iterator iter = accepted.begin();
+    for(;iter != accepted.end();++iter)
+    {
+        const double distance = meanDistance(corners,*iter);
+        if(distance >= 0 && distance < quality.min_novelty)
+            return false;
+    }
+
+    // sharpness inside the board
+    if(quality.min_sharpness > 0)
+    {
+        ScopedProfile profile("live sharpness");
+        ImageBuffer gray = ImageBuffer(frame).toGray();
+        const cv::Rect roi = cv::boundingRect(corners) & cv::Rect(0,0,gray.width(),gray.height());
+        if(roi.area() <= 0)
+            return false;
+        cv::Mat laplacian;
+        cv::Scalar mean,stddev;
+        cv::Laplacian(gray.getConstMat()(roi),laplacian,CV_16S);
+        cv::meanStdDev(laplacian,mean,stddev);
+        if(stddev[0]*stddev[0] < quality.min_sharpness)
+            return false;
+    }
+
+    last_accept = now;
+    accepted.push_back(corners);
+    return true;
+}
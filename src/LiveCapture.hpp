@@ -0,0 +1,179 @@
+#ifndef QCAMCALIB_LIVE_CAPTURE_HPP
+#define QCAMCALIB_LIVE_CAPTURE_HPP
+
+#include <QObject>
+#include <QImage>
+#include <QVector>
+#include <QPointF>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QThread>
+#include <opencv2/core/core.hpp>
+#include <opencv2/core/version.hpp>
+#if CV_MAJOR_VERSION >= 3
+#include <opencv2/videoio/videoio.hpp>
+#else
+#include <opencv2/highgui/highgui.hpp>
+#endif
+#include <vector>
+
+#include "Items.hpp"
+#include "ChessboardTracker.hpp"
+
+namespace qcam_calib
+{
+    /**
+     * \brief Produces the frames of a live stream
+     */
+    class FrameSource
+    {
+        public:
+            virtual ~FrameSource(){};
+
+            /**
+             * \brief Blocks until the next frame is available
+             *
+             * \return false if the stream ended
+             */
+            virtual bool grab(QImage &frame) = 0;
+    };
+
+    /**
+     * \brief Frame source backed by cv::VideoCapture
+     *
+     * Reads from a camera device (V4L2 on Linux) or replays a video file in
+     * real time, which allows testing the live mode without a camera.
+     */
+    class OpenCVFrameSource : public FrameSource
+    {
+        public:
+            OpenCVFrameSource(int device);
+            OpenCVFrameSource(const QString &path);
+            virtual ~OpenCVFrameSource();
+
+            bool isOpened()const;
+            virtual bool grab(QImage &frame);
+
+        private:
+            cv::VideoCapture capture;
+            cv::Mat frame;
+            qint64 period;              // ns between two frames of a replayed file, 0 for devices
+            qint64 next_frame;
+            QElapsedTimer timer;
+    };
+
+    /**
+     * \brief Quality gates a live frame has to pass to be added to the camera
+     */
+    struct CaptureQuality
+    {
+        CaptureQuality();
+
+        double max_detection_rate;  // Hz
+        DetectorSettings detector;
+        bool tracking;              // follow the board with a ChessboardTracker instead of searching each frame
+        double min_sharpness;       // variance of the Laplacian inside the board
+        double max_motion;          // mean corner motion in pixel since the last detection
+        double min_novelty;         // mean corner distance in pixel to all accepted views
+        double min_interval;        // seconds between two accepted views
+    };
+
+    /**
+     * \brief Counts what happened to the frames of a live stream
+     */
+    struct LiveStatistics
+    {
+        LiveStatistics();
+
+        int frames;                 // frames received from the source or pushFrame
+        int dropped;                // frames replaced by a newer one before they were searched
+        int detections;             // frames searched for a chessboard
+        int chessboards;            // frames with a chessboard
+        int tracked;                // chessboards found from the last board without a full frame search
+        int accepted;               // frames which passed all quality gates
+    };
+
+    /**
+     * \brief Detects chessboards in a live stream and accepts good views
+     *
+     * Frames are produced by a FrameSource on a separate thread or pushed with
+     * pushFrame. Only the latest frame is kept, a worker thread searches it
+     * for a chessboard at a bounded rate and older frames which were not
+     * searched yet are dropped. So neither the source nor the gui is blocked
+     * by the detection. Frames are never copied, the source, the worker and
+     * the gui share the same image.
+     *
+     * Each detection is reported by detectionFinished for the overlay. Frames
+     * which pass all quality gates are reported by frameAccepted.
+     */
+    class LiveCapture : public QObject
+    {
+        Q_OBJECT
+        public:
+            LiveCapture(QObject *parent = 0);
+            virtual ~LiveCapture();
+
+            void setQuality(const CaptureQuality &quality);
+            CaptureQuality getQuality()const;
+
+            /**
+             * \brief Starts the capture
+             *
+             * \param[in] source The source of the frames, the capture takes the ownership. If NULL frames have to be pushed.
+             * \param[in] cols The number of inner chessboard corners per row
+             * \param[in] rows The number of inner chessboard corners per column
+             */
+            void start(FrameSource *source,int cols,int rows);
+            bool isRunning()const;
+
+            /**
+             * \brief Returns the latest frame and its number
+             */
+            QImage getLatestFrame(int *frame_id = NULL)const;
+            LiveStatistics getStatistics()const;
+
+        public slots:
+            void pushFrame(const QImage &frame);
+            void stop();
+
+        signals:
+            void detectionFinished(const QImage &frame,const QVector<QPointF> &chessboard);
+            void frameAccepted(const QImage &frame,const QVector<QPointF> &chessboard);
+
+            /**
+             * \brief Is emitted if the source ended
+             */
+            void finished();
+
+        private:
+            static void produce(LiveCapture *capture);
+            static void detect(LiveCapture *capture);
+            bool checkQuality(const QImage &frame,const std::vector<cv::Point2f> &corners);
+
+        private:
+            CaptureQuality quality;
+            FrameSource *source;
+            int cols;
+            int rows;
+            QThread *producer;
+            QThread *detector;
+
+            mutable QMutex mutex;       // guards all members below
+            QWaitCondition frame_available;
+            bool running;
+            QImage latest_frame;
+            int latest_id;
+            LiveStatistics statistics;
+
+            // only used by the detector thread
+            QElapsedTimer timer;
+            ChessboardTracker tracker;
+            std::vector<cv::Point2f> last_corners;
+            qint64 last_detection;
+            qint64 last_accept;
+            std::vector<std::vector<cv::Point2f> > accepted;
+    };
+}
+
+#endif
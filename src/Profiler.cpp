@@ -0,0 +1,193 @@
+#include "Profiler.hpp"
+
+#include <QMutexLocker>
+#include <QThreadStorage>
+#include <QThread>
+#include <QFile>
+#include <QTextStream>
+#include <algorithm>
+
+using namespace qcam_calib;
+
+// the events are kept in a ring buffer which overwrites the oldest events
+// once it is full, the statistics cover all events
+static const size_t MAX_EVENTS = 1000000;
+
+static QThreadStorage<QString*> current_item;
+
+StageStatistics::StageStatistics():
+    count(0),
+    total(0),
+    max(0),
+    allocations(0),
+    allocated_bytes(0)
+{
+}
+
+Profiler &Profiler::instance()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler():
+    enabled(true),
+    oldest_event(0)
+{
+    timer.start();
+}
+
+void Profiler::setEnabled(bool enabled)
+{
+    QMutexLocker locker(&mutex);
+    this->enabled = enabled;
+}
+
+bool Profiler::isEnabled()const
+{
+    QMutexLocker locker(&mutex);
+    return enabled;
+}
+
+void Profiler::setCurrentItem(const QString &item)
+{
+    if(!current_item.hasLocalData())
+        current_item.setLocalData(new QString(item));
+    else
+        *current_item.localData() = item;
+}
+
+QString Profiler::getCurrentItem()
+{
+    if(!current_item.hasLocalData())
+        return QString();
+    return *current_item.localData();
+}
+
+qint64 Profiler::now()const
+{
+    return timer.nsecsElapsed();
+}
+
+void Profiler::record(const ProfileEvent &event)
+{
+    QMutexLocker locker(&mutex);
+    if(!enabled)
+        return;
+    StageStatistics &stats = statistics[event.stage];
+    stats.stage = event.stage;
+    ++stats.count;
+    stats.total += event.duration;
+    stats.max = std::max(stats.max,event.duration);
+    stats.allocations += event.allocations;
+    stats.allocated_bytes += event.allocated_bytes;
+    if(events.size() < MAX_EVENTS)
+    {
+        events.push_back(event);
+        return;
+    }
+    events[oldest_event] = event;
+    oldest_event = (oldest_event+1)%MAX_EVENTS;
+}
+
+void Profiler::clear()
+{
+    QMutexLocker locker(&mutex);
+    statistics.clear();
+    events.clear();
+    oldest_event = 0;
+}
+
+std::vector<StageStatistics> Profiler::getStatistics()const
+{
+    QMutexLocker locker(&mutex);
+    std::vector<StageStatistics> result;
+    std::map<std::string,StageStatistics>::const_iterator iter = statistics.begin();
+    for(;iter != statistics.end();++iter)
+        result.push_back(iter->second);
+    return result;
+}
+
+std::vector<ProfileEvent> Profiler::getEvents()const
+{
+    QMutexLocker locker(&mutex);
+    std::vector<ProfileEvent> result;
+    result.reserve(events.size());
+    result.insert(result.end(),events.begin()+oldest_event,events.end());
+    result.insert(result.end(),events.begin(),events.begin()+oldest_event);
+    return result;
+}
+
+static QString escapeJson(const QString &string)
+{
+    QString result;
+    for(int i=0;i < string.size();++i)
+    {
+        const QChar c = string[i];
+        if(c == '"' || c == '\\')
+            result += QString("\\") + c;
+        else if(c.unicode() < 0x20)
+            result += QString("\\u%1").arg(c.unicode(),4,16,QChar('0'));
+        else
+            result += c;
+    }
+    return result;
+}
+
+bool Profiler::saveChromeTrace(const QString &path)const
+{
+    std::vector<ProfileEvent> events = getEvents();
+    QFile file(path);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return false;
+
+    // threads are numbered in the order they appear
+    std::map<quint64,int> thread_ids;
+    QTextStream stream(&file);
+    stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    std::vector<ProfileEvent>::const_iterator iter = events.begin();
+    for(;iter != events.end();++iter)
+    {
+        if(thread_ids.find(iter->thread) == thread_ids.end())
+        {
+            const int id = int(thread_ids.size());
+            thread_ids[iter->thread] = id;
+        }
+        if(iter != events.begin())
+            stream << ",\n";
+        stream << "{\"name\":\"" << iter->stage << "\",\"cat\":\"qcam_calib\",\"ph\":\"X\""
+               << ",\"ts\":" << QString::number(iter->start*1e-3,'f',3)
+               << ",\"dur\":" << QString::number(iter->duration*1e-3,'f',3)
+               << ",\"pid\":1,\"tid\":" << thread_ids[iter->thread]
+               << ",\"args\":{\"item\":\"" << escapeJson(iter->item) << "\""
+               << ",\"allocations\":" << iter->allocations
+               << ",\"allocated_bytes\":" << iter->allocated_bytes << "}}";
+    }
+    stream << "\n]}\n";
+    stream.flush();
+    return file.error() == QFile::NoError;
+}
+
+ScopedProfile::ScopedProfile(const char *stage,const QString &item)
+{
+    event.stage = stage;
+    event.item = item.isNull() ? Profiler::getCurrentItem() : item;
+    event.thread = quint64(quintptr(QThread::currentThreadId()));
+    event.allocations = 0;
+    event.allocated_bytes = 0;
+    event.duration = 0;
+    event.start = Profiler::instance().now();
+}
+
+ScopedProfile::~ScopedProfile()
+{
+    Profiler &profiler = Profiler::instance();
+    event.duration = profiler.now()-event.start;
+    profiler.record(event);
+}
+
+void ScopedProfile::addAllocation(qint64 bytes)
+{
+    ++event.allocations;
+    event.allocated_bytes += bytes;
+}
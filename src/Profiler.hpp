@@ -0,0 +1,113 @@
+#ifndef QCAMCALIB_PROFILER_HPP
+#define QCAMCALIB_PROFILER_HPP
+
+#include <QMutex>
+#include <QString>
+#include <QElapsedTimer>
+#include <map>
+#include <vector>
+#include <string>
+
+namespace qcam_calib
+{
+    /**
+     * \brief A single timed section of a processing stage
+     */
+    struct ProfileEvent
+    {
+        const char *stage;
+        QString item;               // image or camera the stage was working on
+        qint64 start;               // ns since the profiler was created
+        qint64 duration;            // ns
+        quint64 thread;
+        qint64 allocations;         // number of image buffers allocated by the stage
+        qint64 allocated_bytes;
+    };
+
+    /**
+     * \brief Accumulated statistics of one stage
+     */
+    struct StageStatistics
+    {
+        StageStatistics();
+
+        std::string stage;
+        qint64 count;
+        qint64 total;               // ns
+        qint64 max;                 // ns
+        qint64 allocations;
+        qint64 allocated_bytes;
+    };
+
+    /**
+     * \brief Records the timing of the processing stages of all threads
+     *
+     * Stages are timed with ScopedProfile. The profiler keeps per stage
+     * statistics and the individual events, which can be exported as Chrome
+     * trace (chrome://tracing, Perfetto). Only the latest events are kept
+     * to bound the memory. Only image buffer allocations are counted; they
+     * are reported by the stages themselves. All functions are thread safe.
+     */
+    class Profiler
+    {
+        public:
+            static Profiler &instance();
+
+            void setEnabled(bool enabled);
+            bool isEnabled()const;
+
+            /**
+             * \brief Sets the item the calling thread is working on
+             *
+             * It is used for all events of the thread which do not name their item.
+             */
+            static void setCurrentItem(const QString &item);
+            static QString getCurrentItem();
+
+            qint64 now()const;
+            void record(const ProfileEvent &event);
+            void clear();
+
+            std::vector<StageStatistics> getStatistics()const;
+            /**
+             * \brief Returns the recorded events in the order they were recorded
+             */
+            std::vector<ProfileEvent> getEvents()const;
+
+            /**
+             * \brief Writes all recorded events in the Chrome trace event format
+             */
+            bool saveChromeTrace(const QString &path)const;
+
+        private:
+            Profiler();
+
+        private:
+            mutable QMutex mutex;
+            QElapsedTimer timer;
+            bool enabled;
+            std::map<std::string,StageStatistics> statistics;
+            std::vector<ProfileEvent> events;
+            size_t oldest_event;        // next event which is overwritten once events is full
+    };
+
+    /**
+     * \brief Times the enclosing scope as one event of the given stage
+     */
+    class ScopedProfile
+    {
+        public:
+            ScopedProfile(const char *stage,const QString &item = QString());
+            ~ScopedProfile();
+
+            /**
+             * \brief Reports an image buffer allocated inside the scope
+             */
+            void addAllocation(qint64 bytes);
+
+        private:
+            ProfileEvent event;
+    };
+}
+
+#endif
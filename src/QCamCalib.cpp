@@ -1,6 +1,13 @@
 #include "QCamCalib.hpp"
 #include "Items.hpp"
 #include "ImageView.hpp"
+#include "ImageLoader.hpp"
+#include "VideoLoader.hpp"
+#include "LiveCapture.hpp"
+#include "CalibrationJob.hpp"
+#include "BatchCalibration.hpp"
+#include "RigCalibrationJob.hpp"
+#include "Profiler.hpp"
 
 #include "ui_main_gui.h"
 #include <iostream>
@@ -9,25 +16,235 @@
 
 #include <QAction>
 #include <QFileDialog>
+#include <QMessageBox>
+#include <opencv2/core/version.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
 
 #include <boost/bind.hpp>
 
 using namespace qcam_calib;
 const char* CAMERA_BASE_NAME = "camera_";
 
+// number of files listed in load error messages
+static const int MAX_REPORTED_PATHS = 20;
+
+// interval in ms in which loaded images are added to the dataset
+static const int PENDING_IMAGES_INTERVAL = 100;
+
+// check boxes of the detector flags and the engines they apply to
+struct DetectorFlag
+{
+    const char *name;
+    int flag;
+    bool classic;
+    bool sector_based;
+};
+
+static const DetectorFlag DETECTOR_FLAGS[] =
+{
+    {"checkBoxAdaptiveThreshold",cv::CALIB_CB_ADAPTIVE_THRESH,true,false},
+    {"checkBoxNormalizeImage",cv::CALIB_CB_NORMALIZE_IMAGE,true,true},
+    {"checkBoxFastCheck",cv::CALIB_CB_FAST_CHECK,true,false},
+    {"checkBoxFilterQuads",cv::CALIB_CB_FILTER_QUADS,true,false},
+#if CV_MAJOR_VERSION >= 4
+    {"checkBoxExhaustive",cv::CALIB_CB_EXHAUSTIVE,false,true},
+    {"checkBoxAccuracy",cv::CALIB_CB_ACCURACY,false,true},
+#endif
+};
+static const int DETECTOR_FLAG_COUNT = sizeof(DETECTOR_FLAGS)/sizeof(DetectorFlag);
+
+DetectorSettings getDetectorSettings(const QWidget *widget)
+{
+    QComboBox *detection = widget->findChild<QComboBox*>("comboBoxDetection");
+    QComboBox *engine = widget->findChild<QComboBox*>("comboBoxDetector");
+    if(!detection || !engine)
+        throw std::runtime_error("cannot find detection config");
+    DetectorSettings settings(static_cast<DetectorEngine>(engine->currentIndex()),0,
+                              static_cast<DetectionMode>(detection->currentIndex()));
+    for(int i=0;i < DETECTOR_FLAG_COUNT;++i)
+    {
+        const DetectorFlag &flag = DETECTOR_FLAGS[i];
+        QCheckBox *box = widget->findChild<QCheckBox*>(flag.name);
+        if(!box)
+            throw std::runtime_error("cannot find detection config");
+        const bool used = settings.engine == DETECTOR_CLASSIC ? flag.classic : flag.sector_based;
+        if(used && box->isChecked())
+            settings.flags |= flag.flag;
+    }
+    return settings;
+}
+
+void setDetectorSettings(QWidget *widget,const DetectorSettings &settings)
+{
+    QComboBox *detection = widget->findChild<QComboBox*>("comboBoxDetection");
+    QComboBox *engine = widget->findChild<QComboBox*>("comboBoxDetector");
+    if(!detection || !engine)
+        throw std::runtime_error("cannot find detection config");
+
+    // the widgets are only updated, this must not be reported as a change
+    bool blocked = detection->blockSignals(true);
+    detection->setCurrentIndex(settings.mode);
+    detection->blockSignals(blocked);
+    blocked = engine->blockSignals(true);
+    engine->setCurrentIndex(settings.engine);
+    engine->blockSignals(blocked);
+    for(int i=0;i < DETECTOR_FLAG_COUNT;++i)
+    {
+        const DetectorFlag &flag = DETECTOR_FLAGS[i];
+        QCheckBox *box = widget->findChild<QCheckBox*>(flag.name);
+        if(!box)
+            throw std::runtime_error("cannot find detection config");
+        const bool used = settings.engine == DETECTOR_CLASSIC ? flag.classic : flag.sector_based;
+        blocked = box->blockSignals(true);
+        box->setEnabled(used);
+        box->setChecked(used && (settings.flags & flag.flag) != 0);
+        box->blockSignals(blocked);
+    }
+}
+
+bool getTracking(const QWidget *widget)
+{
+    QCheckBox *tracking = widget->findChild<QCheckBox*>("checkBoxTracking");
+    if(!tracking)
+        throw std::runtime_error("cannot find detection config");
+    return tracking->isChecked();
+}
+
+int getMaxVideoFrames(const QWidget *widget)
+{
+    QSpinBox *max_frames = widget->findChild<QSpinBox*>("spinBoxMaxVideoFrames");
+    if(!max_frames)
+        throw std::runtime_error("cannot find detection config");
+    return max_frames->value();
+}
+
+OutlierRejection getOutlierRejection(const QWidget *widget)
+{
+    QCheckBox *enabled = widget->findChild<QCheckBox*>("checkBoxRejectOutliers");
+    QDoubleSpinBox *threshold = widget->findChild<QDoubleSpinBox*>("spinBoxOutlierThreshold");
+    if(!enabled || !threshold)
+        throw std::runtime_error("cannot find calibration config");
+    OutlierRejection rejection;
+    rejection.enabled = enabled->isChecked();
+    rejection.threshold = threshold->value();
+    return rejection;
+}
+
+int getMaxViews(const QWidget *widget)
+{
+    QSpinBox *max_views = widget->findChild<QSpinBox*>("spinBoxMaxViews");
+    if(!max_views)
+        throw std::runtime_error("cannot find calibration config");
+    return max_views->value();
+}
+
+CalibrationSolver getSolver(const QWidget *widget)
+{
+    QComboBox *solver = widget->findChild<QComboBox*>("comboBoxSolver");
+    if(!solver)
+        throw std::runtime_error("cannot find calibration config");
+    return static_cast<CalibrationSolver>(solver->currentIndex());
+}
+
+void setSolver(QWidget *widget,CalibrationSolver value)
+{
+    QComboBox *solver = widget->findChild<QComboBox*>("comboBoxSolver");
+    if(!solver)
+        throw std::runtime_error("cannot find calibration config");
+
+    // the widget is only updated, this must not be reported as a change
+    const bool blocked = solver->blockSignals(true);
+    solver->setCurrentIndex(value);
+    solver->blockSignals(blocked);
+}
+
+DistortionModel getDistortionModel(const QWidget *widget)
+{
+    QComboBox *distortion = widget->findChild<QComboBox*>("comboBoxDistortion");
+    if(!distortion)
+        throw std::runtime_error("cannot find calibration config");
+    return static_cast<DistortionModel>(distortion->currentIndex());
+}
+
+void setDistortionModel(QWidget *widget,DistortionModel value)
+{
+    QComboBox *distortion = widget->findChild<QComboBox*>("comboBoxDistortion");
+    if(!distortion)
+        throw std::runtime_error("cannot find calibration config");
+
+    const bool blocked = distortion->blockSignals(true);
+    distortion->setCurrentIndex(value);
+    distortion->blockSignals(blocked);
+}
+
+bool getUndistortion(const QWidget *widget)
+{
+    QCheckBox *undistort = widget->findChild<QCheckBox*>("checkBoxUndistort");
+    if(!undistort)
+        throw std::runtime_error("cannot find calibration config");
+    return undistort->isChecked();
+}
+
+// maps detected corners into the undistorted image which keeps the camera matrix
+QVector<QPointF> undistortCorners(const CalibrationResult &result,const QVector<QPointF> &corners)
+{
+    if(corners.empty())
+        return corners;
+    const CameraModel model(result.distortion,result.camera_matrix,result.dist_coeffs);
+    std::vector<cv::Point2f> points = convertFromQt(corners);
+    std::vector<cv::Point2f> normalized;
+    model.normalize(cv::Mat(points),normalized);
+    const cv::Mat &k = result.camera_matrix;
+    for(size_t i=0;i < normalized.size();++i)
+        points[i] = cv::Point2f(k.at<double>(0,0)*normalized[i].x+k.at<double>(0,2),
+                                k.at<double>(1,1)*normalized[i].y+k.at<double>(1,2));
+    return convertToQt(points);
+}
+
+RigSettings getRigSettings(const QWidget *widget)
+{
+    QComboBox *matching = widget->findChild<QComboBox*>("comboBoxRigMatching");
+    QDoubleSpinBox *tolerance = widget->findChild<QDoubleSpinBox*>("spinBoxRigTolerance");
+    if(!matching || !tolerance)
+        throw std::runtime_error("cannot find calibration config");
+    RigSettings settings;
+    settings.matching = static_cast<RigMatching>(matching->currentIndex());
+    settings.max_time_difference = tolerance->value();
+    return settings;
+}
+
 QCamCalib::QCamCalib(QWidget *parent) :
     QWidget(parent),
     current_load_path("."),
+    dataset(new Dataset),
     tree_model(NULL),
     camera_item_menu(NULL),
     tree_view_menu(NULL),
     image_item_menu(NULL),
+    image_view(NULL),
+    stats_view(NULL),
+    stats_timer(NULL),
+    image_loader(NULL),
+    video_loader(NULL),
+    live_capture(NULL),
+    live_timer(NULL),
+    progress_dialog_live(NULL),
+    live_camera_id(-1),
+    live_frame_id(0),
+    last_loaded_item(NULL),
+    load_camera_id(-1),
+    pending_timer(NULL),
     progress_dialog_images(NULL),
+    progress_dialog_video(NULL),
     progress_dialog_chessboard(NULL),
     progress_dialog_calibrate(NULL),
-    future_watcher_images(NULL),
     future_watcher_chessboard(NULL),
-    future_watcher_calibrate(NULL)
+    calibration_job(NULL),
+    progress_dialog_batch(NULL),
+    batch_calibration(NULL),
+    progress_dialog_rig(NULL),
+    rig_job(NULL),
+    save_after_calibration(false)
 {
     Ui::MainGui gui;
     gui.setupUi(this);
@@ -47,10 +264,22 @@ QCamCalib::QCamCalib(QWidget *parent) :
     connect(act,SIGNAL(triggered()),this,SLOT(loadImages()));
     camera_item_menu->addAction(act);
 
+    act = new QAction("load video",this);
+    connect(act,SIGNAL(triggered()),this,SLOT(loadVideo()));
+    camera_item_menu->addAction(act);
+
+    act = new QAction("live capture",this);
+    connect(act,SIGNAL(triggered()),this,SLOT(selectLiveCaptureSource()));
+    camera_item_menu->addAction(act);
+
     act = new QAction("calibrate",this);
     connect(act,SIGNAL(triggered()),this,SLOT(calibrateCamera()));
     camera_item_menu->addAction(act);
 
+    act = new QAction("calibrate from scratch",this);
+    connect(act,SIGNAL(triggered()),this,SLOT(calibrateCameraFromScratch()));
+    camera_item_menu->addAction(act);
+
     act = new QAction("save parameter",this);
     connect(act,SIGNAL(triggered()),this,SLOT(saveCameraParameter()));
     camera_item_menu->addAction(act);
@@ -64,6 +293,18 @@ QCamCalib::QCamCalib(QWidget *parent) :
     act = new QAction("add Camera",this);
     connect(act,SIGNAL(triggered()),this,SLOT(addCamera()));
     tree_view_menu->addAction(act);
+    act = new QAction("calibrate all cameras",this);
+    connect(act,SIGNAL(triggered()),this,SLOT(calibrateAllCameras()));
+    tree_view_menu->addAction(act);
+    act = new QAction("calibrate rig",this);
+    connect(act,SIGNAL(triggered()),this,SLOT(calibrateRig()));
+    tree_view_menu->addAction(act);
+    act = new QAction("export timing trace",this);
+    connect(act,SIGNAL(triggered()),this,SLOT(exportTimingTrace()));
+    tree_view_menu->addAction(act);
+    act = new QAction("reset timing statistics",this);
+    connect(act,SIGNAL(triggered()),this,SLOT(resetTimingStatistics()));
+    tree_view_menu->addAction(act);
 
     // image item menu
     image_item_menu = new QMenu(this);
@@ -75,15 +316,75 @@ QCamCalib::QCamCalib(QWidget *parent) :
     //graphics view
     image_view = gui.imageView;
 
+    // stage timing
+    stats_view = gui.statsView;
+    stats_view->sortByColumn(2,Qt::DescendingOrder);
+    stats_timer = new QTimer(this);
+    connect(stats_timer,SIGNAL(timeout()),this,SLOT(updateTimingStatistics()));
+    stats_timer->start(500);
+
+    // detector settings, engines not supported by the OpenCV version cannot be selected
+    // the flags of those engines are not part of DETECTOR_FLAGS and must be disabled here
+    setDetectorSettings(this,DetectorSettings());
+    if(!ChessboardDetector::isAvailable(DETECTOR_SECTOR_BASED))
+    {
+        QStandardItemModel *engines = qobject_cast<QStandardItemModel*>(gui.comboBoxDetector->model());
+        if(engines)
+            engines->item(DETECTOR_SECTOR_BASED)->setEnabled(false);
+        gui.checkBoxExhaustive->setEnabled(false);
+        gui.checkBoxAccuracy->setEnabled(false);
+    }
+    connect(gui.comboBoxDetection,SIGNAL(currentIndexChanged(int)),this,SLOT(detectorSettingsChanged()));
+    connect(gui.comboBoxDetector,SIGNAL(currentIndexChanged(int)),this,SLOT(detectorSettingsChanged()));
+    connect(gui.comboBoxSolver,SIGNAL(currentIndexChanged(int)),this,SLOT(solverChanged()));
+    connect(gui.comboBoxDistortion,SIGNAL(currentIndexChanged(int)),this,SLOT(distortionModelChanged()));
+    connect(gui.checkBoxResidualHeatmap,SIGNAL(toggled(bool)),this,SLOT(updateResidualHeatmap()));
+    connect(gui.checkBoxUndistort,SIGNAL(toggled(bool)),this,SLOT(updateUndistortion()));
+    for(int i=0;i < DETECTOR_FLAG_COUNT;++i)
+        connect(findChild<QCheckBox*>(DETECTOR_FLAGS[i].name),SIGNAL(toggled(bool)),this,SLOT(detectorSettingsChanged()));
+
     // add initial camera
     addCamera();
 
+    // loaded images are collected and added in batches
+    pending_timer = new QTimer(this);
+    pending_timer->setSingleShot(true);
+    pending_timer->setInterval(PENDING_IMAGES_INTERVAL);
+    connect(pending_timer,SIGNAL(timeout()),this,SLOT(addPendingImages()));
+
     // progress dialog
     progress_dialog_images = new QProgressDialog("loading images","cancel",0,0,this);
-    future_watcher_images = new QFutureWatcher<QImage>(this);
-    connect(future_watcher_images, SIGNAL(progressValueChanged(int)), progress_dialog_images, SLOT(setValue(int)));
-    connect(future_watcher_images, SIGNAL(progressRangeChanged(int, int)), progress_dialog_images, SLOT(setRange(int, int)));
-    connect(future_watcher_images, SIGNAL(finished()), progress_dialog_images, SLOT(accept()));
+    image_loader = new ImageLoader(this);
+    connect(image_loader, SIGNAL(progressValueChanged(int)), progress_dialog_images, SLOT(setValue(int)));
+    connect(image_loader, SIGNAL(progressRangeChanged(int, int)), progress_dialog_images, SLOT(setRange(int, int)));
+    connect(image_loader, SIGNAL(finished()), progress_dialog_images, SLOT(accept()));
+    connect(image_loader, SIGNAL(imageLoaded(const QString&,const QSize&,const QVector<QPointF>&)),
+            this, SLOT(imageLoaded(const QString&,const QSize&,const QVector<QPointF>&)));
+    connect(progress_dialog_images, SIGNAL(canceled()), image_loader, SLOT(cancel()));
+
+    progress_dialog_video = new QProgressDialog("loading video","cancel",0,0,this);
+    video_loader = new VideoLoader(this);
+    connect(video_loader, SIGNAL(progressValueChanged(int)), progress_dialog_video, SLOT(setValue(int)));
+    connect(video_loader, SIGNAL(progressRangeChanged(int, int)), progress_dialog_video, SLOT(setRange(int, int)));
+    connect(video_loader, SIGNAL(finished()), progress_dialog_video, SLOT(accept()));
+    connect(video_loader, SIGNAL(frameLoaded(const QString&,const QImage&,const QVector<QPointF>&)),
+            this, SLOT(videoFrameLoaded(const QString&,const QImage&,const QVector<QPointF>&)));
+    connect(progress_dialog_video, SIGNAL(canceled()), video_loader, SLOT(cancel()));
+
+    progress_dialog_live = new QProgressDialog("live capture","stop",0,0,this);
+    progress_dialog_live->setModal(false);
+    progress_dialog_live->setAutoClose(false);
+    progress_dialog_live->setAutoReset(false);
+    progress_dialog_live->reset();
+    live_capture = new LiveCapture(this);
+    live_timer = new QTimer(this);
+    connect(live_timer, SIGNAL(timeout()), this, SLOT(showLiveFrame()));
+    connect(live_capture, SIGNAL(detectionFinished(const QImage&,const QVector<QPointF>&)),
+            this, SLOT(liveDetectionFinished(const QImage&,const QVector<QPointF>&)));
+    connect(live_capture, SIGNAL(frameAccepted(const QImage&,const QVector<QPointF>&)),
+            this, SLOT(liveFrameAccepted(const QImage&,const QVector<QPointF>&)));
+    connect(live_capture, SIGNAL(finished()), this, SLOT(stopLiveCapture()));
+    connect(progress_dialog_live, SIGNAL(canceled()), this, SLOT(stopLiveCapture()));
 
     progress_dialog_chessboard = new QProgressDialog("searching for chessboards","cancel",0,0,this);
     future_watcher_chessboard= new QFutureWatcher<QVector<QPointF> >(this);
@@ -92,14 +393,41 @@ QCamCalib::QCamCalib(QWidget *parent) :
   //  connect(future_watcher_chessboard, SIGNAL(progressRangeChanged(int, int)), progress_dialog_chessboard, SLOT(setRange(int, int)));
 
     progress_dialog_calibrate = new QProgressDialog("calibrate camera","cancel",0,0,this);
-    progress_dialog_calibrate->setCancelButton(NULL);
-    future_watcher_calibrate = new QFutureWatcher<void>(this);
-    connect(future_watcher_calibrate, SIGNAL(progressValueChanged(int)), progress_dialog_calibrate, SLOT(setValue(int)));
-    connect(future_watcher_calibrate, SIGNAL(finished()), progress_dialog_calibrate, SLOT(accept()));
+    progress_dialog_calibrate->setModal(false);
+    progress_dialog_calibrate->setAutoClose(false);
+    progress_dialog_calibrate->setAutoReset(false);
+    progress_dialog_calibrate->reset();
+    calibration_job = new CalibrationJob(this);
+    connect(calibration_job, SIGNAL(progress(int,double,double)), this, SLOT(calibrationProgress(int,double,double)));
+    connect(calibration_job, SIGNAL(finished(int)), this, SLOT(calibrationFinished(int)));
+    connect(progress_dialog_calibrate, SIGNAL(canceled()), calibration_job, SLOT(cancel()));
+
+    progress_dialog_batch = new QProgressDialog("calibrate all cameras","cancel",0,0,this);
+    progress_dialog_batch->setModal(false);
+    progress_dialog_batch->setAutoClose(false);
+    progress_dialog_batch->setAutoReset(false);
+    progress_dialog_batch->reset();
+    batch_calibration = new BatchCalibration(this);
+    connect(batch_calibration, SIGNAL(progressValueChanged(int)), progress_dialog_batch, SLOT(setValue(int)));
+    connect(batch_calibration, SIGNAL(progressRangeChanged(int, int)), progress_dialog_batch, SLOT(setRange(int, int)));
+    connect(batch_calibration, SIGNAL(cameraFinished(int)), this, SLOT(batchCameraFinished(int)));
+    connect(batch_calibration, SIGNAL(finished()), this, SLOT(batchFinished()));
+    connect(progress_dialog_batch, SIGNAL(canceled()), batch_calibration, SLOT(cancel()));
+
+    progress_dialog_rig = new QProgressDialog("calibrate rig","cancel",0,0,this);
+    progress_dialog_rig->setModal(false);
+    progress_dialog_rig->setAutoClose(false);
+    progress_dialog_rig->setAutoReset(false);
+    progress_dialog_rig->reset();
+    rig_job = new RigCalibrationJob(this);
+    connect(rig_job, SIGNAL(progress(int,double,double)), this, SLOT(rigCalibrationProgress(int,double,double)));
+    connect(rig_job, SIGNAL(finished()), this, SLOT(rigCalibrationFinished()));
+    connect(progress_dialog_rig, SIGNAL(canceled()), rig_job, SLOT(cancel()));
 }
 
 QCamCalib::~QCamCalib()
 {
+    live_capture->stop();
 }
 
 void QCamCalib::contextMenuTreeView(const QPoint &point)
@@ -135,7 +463,11 @@ void QCamCalib::addCamera(int camera_id)
         QModelIndexList list = tree_model->match(tree_model->index(0,0),Qt::DisplayRole,QVariant(strstr.str().c_str()),1,Qt::MatchExactly);
         if(list.empty())
         {
-            tree_model->appendRow(new qcam_calib::CameraItem(camera_id+i,QString(strstr.str().c_str())));
+            qcam_calib::CameraItem *item = new qcam_calib::CameraItem(dataset,camera_id+i,QString(strstr.str().c_str()));
+            item->setDetector(getDetectorSettings(this));
+            item->setSolver(getSolver(this));
+            item->setDistortionModel(getDistortionModel(this));
+            tree_model->appendRow(item);
             break;
         }
     }
@@ -146,24 +478,37 @@ void QCamCalib::saveCameraParameter(int camera_id)
     CameraItem *item = getCameraItem(camera_id);
     if(!item->isCalibrated())
     {
-        calibrateCamera(camera_id);
-        if(!item->isCalibrated())
-            return;
+        // save the parameters as soon as the calibration is finished
+        calibrateCamera(item->getId());
+        save_after_calibration = calibration_job->isRunning() && calibration_job->getCameraId() == item->getId();
+        return;
     }
     QString path = QFileDialog::getSaveFileName(this, "Save Parameter",current_load_path, "config (*.yml *.xml)");
-    if(path.size() != 0)
+    if(path.size() == 0)
+        return;
+    try
+    {
         item->saveParameter(path);
+    }
+    catch(const std::runtime_error &e)
+    {
+        QErrorMessage box;
+        box.showMessage(QString("Cannot save parameter: ") + e.what());
+        box.exec();
+    }
 }
 
 void QCamCalib::removeCamera(int camera_id)
 {
     CameraItem *item = getCameraItem(camera_id);
+    if(item->getId() == live_camera_id)
+        stopLiveCapture();
     tree_model->removeRow(item->row());
 }
 
-QImage loadImage(const QString &path)
+void QCamCalib::setMaxImagesInFlight(int count)
 {
-    return QImage(path);
+    image_loader->setMaxInFlight(count);
 }
 
 void QCamCalib::loadImages(int camera_id)
@@ -172,48 +517,306 @@ void QCamCalib::loadImages(int camera_id)
     QSpinBox *rows = findChild<QSpinBox*>("spinBoxRows");
     if(!cols || !rows)
         throw std::runtime_error("cannot find chessboard config");
+    if(image_loader->isRunning())
+    {
+        QErrorMessage box;
+        box.showMessage("Images are still being loaded. Wait until the canceled jobs are finished." );
+        box.exec();
+        return;
+    }
+
+    // resolve the camera now because the selection might change while loading
+    load_camera_id = getCameraItem(camera_id)->getId();
+    last_loaded_item = NULL;
+    failed_paths.clear();
 
     //select images
     QStringList paths = QFileDialog::getOpenFileNames(this, "Open images",current_load_path, "Images (*.png *.jpg)");
+    if(paths.empty())
+        return;
+
+    QCheckBox *cache = findChild<QCheckBox*>("checkBoxDetectionCache");
+    image_loader->setUseCornerCache(cache && cache->isChecked());
+
+    //load images and find chess boards in parallel
+    //items are added as soon as their results arrive
+    image_loader->start(paths,cols->value(),rows->value(),getCameraItem(load_camera_id)->getDetector());
+    if(QDialog::Accepted != progress_dialog_images->exec())
+        image_loader->cancel();
+    progress_dialog_images->close();
+    addPendingImages();
+
+    if(!failed_paths.empty())
+    {
+        QErrorMessage box;
+        QStringList shown = failed_paths.mid(0,MAX_REPORTED_PATHS);
+        if(failed_paths.size() > shown.size())
+            shown << "...";
+        box.showMessage(QString("Cannot load %1 images:\n%2").arg(failed_paths.size()).arg(shown.join("\n")));
+        box.exec();
+    }
+    if(last_loaded_item)
+        displayImageItem(last_loaded_item);
+}
+
+void QCamCalib::loadVideo(int camera_id)
+{
+    QSpinBox *cols = findChild<QSpinBox*>("spinBoxCols");
+    QSpinBox *rows = findChild<QSpinBox*>("spinBoxRows");
+    if(!cols || !rows)
+        throw std::runtime_error("cannot find chessboard config");
+    if(video_loader->isRunning())
+    {
+        QErrorMessage box;
+        box.showMessage("A video is still being loaded. Wait until the canceled jobs are finished." );
+        box.exec();
+        return;
+    }
+
+    // resolve the camera now because the selection might change while loading
+    load_camera_id = getCameraItem(camera_id)->getId();
+    last_loaded_item = NULL;
 
-    //load images in parallel
-    QFuture<QImage> images = QtConcurrent::mapped(paths,loadImage);
-    future_watcher_images->setFuture(images);
-    if(QDialog::Accepted != progress_dialog_images->exec() && future_watcher_images->isCanceled())
+    QString path = QFileDialog::getOpenFileName(this, "Open video",current_load_path, "Videos (*.avi *.mp4 *.mkv *.mov *.mpg)");
+    if(path.size() == 0)
         return;
-    future_watcher_images->waitForFinished();
-    //progress_dialog_images->close();
+    current_load_path = QFileInfo(path).absolutePath();
 
-    //find chess boards in parallel
-    QFuture<QVector<QPointF> > chessboards;
-    chessboards = QtConcurrent::mapped(images,
-                                       boost::bind(static_cast<QVector<QPointF>(*)(const QImage&,int,int)>(ImageItem::findChessboard),_1,cols->value(),rows->value()));
-    future_watcher_chessboard->setFuture(chessboards);
-    progress_dialog_chessboard->setRange(progress_dialog_images->minimum(),progress_dialog_images->maximum());
-    if(QDialog::Accepted != progress_dialog_chessboard->exec() && future_watcher_chessboard->isCanceled())
+    //decode the video and find chess boards in the remaining frames
+    //frames with chessboard are added as soon as their results arrive
+    FrameDecimation decimation = video_loader->getDecimation();
+    decimation.tracking = getTracking(this);
+    decimation.max_frames = getMaxVideoFrames(this);
+    video_loader->setDecimation(decimation);
+    video_loader->start(path,cols->value(),rows->value(),getCameraItem(load_camera_id)->getDetector());
+    if(QDialog::Accepted != progress_dialog_video->exec())
+        video_loader->cancel();
+    progress_dialog_video->close();
+    addPendingImages();
+
+    if(!video_loader->getError().isEmpty())
+    {
+        QErrorMessage box;
+        box.showMessage(video_loader->getError());
+        box.exec();
+        return;
+    }
+    const VideoStatistics statistics = video_loader->getStatistics();
+    QMessageBox::information(this,"Video loaded",
+                             QString("%1\n\n%2 frames decoded\n%3 frames with unsupported format skipped\n"
+                                     "%4 near duplicates skipped\n%5 blurry frames skipped\n"
+                                     "%6 frames searched\n%7 chessboards added (%8 tracked)")
+                             .arg(QFileInfo(path).fileName()).arg(statistics.frames).arg(statistics.unsupported)
+                             .arg(statistics.duplicates).arg(statistics.blurry).arg(statistics.candidates)
+                             .arg(statistics.chessboards).arg(statistics.tracked));
+    if(last_loaded_item)
+        displayImageItem(last_loaded_item);
+}
+
+void QCamCalib::videoFrameLoaded(const QString &name,const QImage &image,const QVector<QPointF> &chessboard)
+{
+    PendingImage pending;
+    pending.name = name;
+    pending.size = image.size();
+    pending.image = image;
+    pending.chessboard = chessboard;
+    pending_images << pending;
+    if(!pending_timer->isActive())
+        pending_timer->start();
+}
+
+void QCamCalib::addPendingImages()
+{
+    pending_timer->stop();
+    if(pending_images.isEmpty())
+        return;
+
+    QSpinBox *cols = findChild<QSpinBox*>("spinBoxCols");
+    QSpinBox *rows = findChild<QSpinBox*>("spinBoxRows");
+    if(!cols || !rows)
+        throw std::runtime_error("cannot find chessboard config");
+
+    // the camera might have been removed while loading
+    CameraItem *item = NULL;
+    try
+    {
+        item = getCameraItem(load_camera_id);
+    }
+    catch(const std::runtime_error &)
+    {
+        pending_images.clear();
+        image_loader->cancel();
+        video_loader->cancel();
+        return;
+    }
+
+    std::vector<ImageData> images;
+    images.reserve(pending_images.size());
+    QList<PendingImage>::const_iterator iter = pending_images.begin();
+    for(;iter != pending_images.end();++iter)
+    {
+        ImageData data;
+        data.name = iter->name.toStdString();
+        data.path = iter->path.toStdString();
+        data.image = iter->image;
+        data.size = cv::Size(iter->size.width(),iter->size.height());
+        data.board_size = cv::Size(cols->value(),rows->value());
+        data.corners = convertFromQt(iter->chessboard);
+        data.detected = true;
+        images.push_back(data);
+    }
+    pending_images.clear();
+
+    QList<ImageItem*> items = item->addImages(images);
+    if(!items.isEmpty())
+        last_loaded_item = items.back();
+}
+
+void QCamCalib::selectLiveCaptureSource()
+{
+    bool ok = false;
+    QString source = QInputDialog::getText(this,"Live capture","camera device number or video file",QLineEdit::Normal,"0",&ok);
+    if(!ok || source.isEmpty())
+        return;
+    startLiveCapture(source);
+}
+
+void QCamCalib::startLiveCapture(const QString &source,int camera_id)
+{
+    QSpinBox *cols = findChild<QSpinBox*>("spinBoxCols");
+    QSpinBox *rows = findChild<QSpinBox*>("spinBoxRows");
+    if(!cols || !rows)
+        throw std::runtime_error("cannot find chessboard config");
+
+    stopLiveCapture();
+    live_camera_id = getCameraItem(camera_id)->getId();
+
+    // numbers select a camera device, everything else is replayed as video file
+    OpenCVFrameSource *frame_source = NULL;
+    if(!source.isEmpty())
+    {
+        bool is_device = false;
+        int device = source.toInt(&is_device);
+        frame_source = is_device ? new OpenCVFrameSource(device) : new OpenCVFrameSource(source);
+        if(!frame_source->isOpened())
+        {
+            delete frame_source;
+            live_camera_id = -1;
+            QErrorMessage box;
+            box.showMessage(QString("cannot open live capture source %1").arg(source));
+            box.exec();
+            return;
+        }
+    }
+
+    CaptureQuality quality = live_capture->getQuality();
+    quality.detector = getCameraItem(live_camera_id)->getDetector();
+    quality.tracking = getTracking(this);
+    live_capture->setQuality(quality);
+    live_capture->start(frame_source,cols->value(),rows->value());
+
+    live_frame_id = 0;
+    live_chessboard.clear();
+    image_view->displayChessboard(live_chessboard,cols->value(),rows->value());
+    progress_dialog_live->setLabelText("live capture");
+    progress_dialog_live->show();
+    live_timer->start(33);
+}
+
+void QCamCalib::stopLiveCapture()
+{
+    // frames which are already queued are ignored
+    live_camera_id = -1;
+    live_capture->stop();
+    live_timer->stop();
+    progress_dialog_live->reset();
+    progress_dialog_live->close();
+}
+
+void QCamCalib::pushLiveFrame(const QImage &frame)
+{
+    live_capture->pushFrame(frame);
+}
+
+void QCamCalib::showLiveFrame()
+{
+    QSpinBox *cols = findChild<QSpinBox*>("spinBoxCols");
+    QSpinBox *rows = findChild<QSpinBox*>("spinBoxRows");
+    if(!cols || !rows)
+        throw std::runtime_error("cannot find chessboard config");
+
+    // the gui only shows the latest frame, frames between two timer events are never drawn
+    int frame_id = 0;
+    QImage frame = live_capture->getLatestFrame(&frame_id);
+    if(frame_id == live_frame_id || frame.isNull())
         return;
-    future_watcher_chessboard->waitForFinished();
-    progress_dialog_chessboard->close();
+    live_frame_id = frame_id;
+    image_view->displayLiveFrame(frame);
+    image_view->displayChessboard(live_chessboard,cols->value(),rows->value());
+
+    const LiveStatistics statistics = live_capture->getStatistics();
+    progress_dialog_live->setLabelText(QString("%1 frames\n%2 searched, %3 dropped\n%4 chessboards, %5 tracked\n%6 views accepted")
+                                       .arg(statistics.frames).arg(statistics.detections).arg(statistics.dropped)
+                                       .arg(statistics.chessboards).arg(statistics.tracked).arg(statistics.accepted));
+}
 
-    //add items
-    QStringList::const_iterator iter_path = paths.begin();
-    QFuture<QImage>::const_iterator iter_image = images.begin();
-    QFuture<QVector<QPointF> >::const_iterator iter_chessboard = chessboards.begin();
-    ImageItem *last_image_item = NULL;
-    for(;iter_path!=paths.end() && iter_image!=images.end() && iter_chessboard!=chessboards.end();++iter_path,++iter_image,++iter_chessboard)
+void QCamCalib::liveDetectionFinished(const QImage &frame,const QVector<QPointF> &chessboard)
+{
+    if(live_camera_id < 0)
+        return;
+    live_chessboard = chessboard;
+}
+
+void QCamCalib::liveFrameAccepted(const QImage &frame,const QVector<QPointF> &chessboard)
+{
+    QSpinBox *cols = findChild<QSpinBox*>("spinBoxCols");
+    QSpinBox *rows = findChild<QSpinBox*>("spinBoxRows");
+    if(!cols || !rows)
+        throw std::runtime_error("cannot find chessboard config");
+
+    // the capture might have been stopped or the camera removed in the meantime
+    if(live_camera_id < 0)
+        return;
+    CameraItem *item = NULL;
+    try
     {
-        QFileInfo info(*iter_path);
-        current_load_path = info.absolutePath();
+        item = getCameraItem(live_camera_id);
+    }
+    catch(const std::runtime_error &)
+    {
+        stopLiveCapture();
+        return;
+    }
+    ImageItem *image = item->addImage("live_"+QDateTime::currentDateTime().toString("hhmmss_zzz"),frame);
+    image->setChessboard(chessboard,cols->value(),rows->value());
+}
 
-        CameraItem *item = getCameraItem(camera_id);
-        last_image_item = item->addImage(info.fileName(),*iter_image);
-        last_image_item->setChessboard(*iter_chessboard,cols->value(),rows->value());
+void QCamCalib::imageLoaded(const QString &path,const QSize &size,const QVector<QPointF> &chessboard)
+{
+    QFileInfo info(path);
+    current_load_path = info.absolutePath();
+    if(!size.isValid())
+    {
+        failed_paths << path;
+        return;
     }
-    if(last_image_item)
-        displayImage(last_image_item->getImage());
+
+    PendingImage pending;
+    pending.name = info.fileName();
+    pending.path = path;
+    pending.size = size;
+    pending.chessboard = chessboard;
+    pending_images << pending;
+    if(!pending_timer->isActive())
+        pending_timer->start();
 }
 
-void QCamCalib::calibrateCamera(int camera_id)
+void QCamCalib::calibrateCameraFromScratch()
+{
+    calibrateCamera(-1,false);
+}
+
+void QCamCalib::calibrateCamera(int camera_id,bool warm_start)
 {
     QSpinBox *cols = findChild<QSpinBox*>("spinBoxCols");
     QSpinBox *rows = findChild<QSpinBox*>("spinBoxRows");
@@ -224,7 +827,7 @@ void QCamCalib::calibrateCamera(int camera_id)
 
     //select images
     CameraItem *item = getCameraItem(camera_id);
-    if(item->countChessboards() < 5)
+    if(item->countChessboards() < MIN_CALIBRATION_CHESSBOARDS)
     {
         QErrorMessage box;
         box.showMessage("Not enough chessboards for calibration. Add more images." );
@@ -232,10 +835,273 @@ void QCamCalib::calibrateCamera(int camera_id)
         return;
     }
 
-    future_watcher_calibrate->setFuture(QtConcurrent::run(item,&CameraItem::calibrate,cols->value(),rows->value(),dx->value(),dy->value()));
+    if(calibration_job->isRunning())
+    {
+        QErrorMessage box;
+        box.showMessage("A calibration is already running. Wait until it is finished or cancel it." );
+        box.exec();
+        return;
+    }
+
+    calibration_job->setOutlierRejection(getOutlierRejection(this));
+    calibration_job->setMaxViews(getMaxViews(this));
+    calibration_job->start(dataset,item->getId(),cols->value(),rows->value(),dx->value(),dy->value(),warm_start);
+    progress_dialog_calibrate->setLabelText(QString("calibrate %1").arg(item->text()));
     progress_dialog_calibrate->setRange(0,0);
-    if(QDialog::Accepted != progress_dialog_calibrate->exec() && future_watcher_calibrate->isCanceled())
+    progress_dialog_calibrate->setValue(0);
+    progress_dialog_calibrate->show();
+}
+
+void QCamCalib::calibrationProgress(int iteration,double error,double elapsed)
+{
+    progress_dialog_calibrate->setLabelText(QString("iteration %1\nrms error %2 px\nelapsed %3 s")
+                                            .arg(iteration).arg(error,0,'f',4).arg(elapsed,0,'f',1));
+}
+
+void QCamCalib::calibrationFinished(int camera_id)
+{
+    const bool canceled = progress_dialog_calibrate->wasCanceled();
+    const bool save = save_after_calibration;
+    save_after_calibration = false;
+    progress_dialog_calibrate->reset();
+    progress_dialog_calibrate->hide();
+    if(!calibration_job->getError().isEmpty())
+    {
+        QErrorMessage box;
+        box.showMessage(QString("Calibration failed: ") + calibration_job->getError());
+        box.exec();
+        return;
+    }
+    if(canceled || calibration_job->getResult().canceled)
+        return;
+
+    // the camera might have been removed in the meantime
+    CameraItem *item = NULL;
+    try
+    {
+        item = getCameraItem(camera_id);
+    }
+    catch(const std::runtime_error &)
+    {
+        return;
+    }
+    item->updateView();
+    updateUndistortion();
+    if(save)
+        saveCameraParameter(camera_id);
+}
+
+void QCamCalib::calibrateAllCameras()
+{
+    QSpinBox *cols = findChild<QSpinBox*>("spinBoxCols");
+    QSpinBox *rows = findChild<QSpinBox*>("spinBoxRows");
+    QDoubleSpinBox *dx = findChild<QDoubleSpinBox*>("spinBoxDx");
+    QDoubleSpinBox *dy = findChild<QDoubleSpinBox*>("spinBoxDy");
+    if(!cols || !rows || !dx || !dy)
+        throw std::runtime_error("cannot find chessboard config");
+    if(batch_calibration->isRunning())
+    {
+        QErrorMessage box;
+        box.showMessage("A batch calibration is already running. Wait until it is finished or cancel it." );
+        box.exec();
+        return;
+    }
+
+    QList<int> camera_ids;
+    for(int i=0;i<tree_model->rowCount();++i)
+    {
+        CameraItem *item = dynamic_cast<CameraItem*>(tree_model->item(i,0));
+        if(item)
+            camera_ids.push_back(item->getId());
+    }
+    if(camera_ids.empty())
+        return;
+
+    batch_calibration->setOutlierRejection(getOutlierRejection(this));
+    batch_calibration->setMaxViews(getMaxViews(this));
+    batch_calibration->start(dataset,camera_ids,cols->value(),rows->value(),dx->value(),dy->value());
+    progress_dialog_batch->setRange(0,camera_ids.size());
+    progress_dialog_batch->setValue(0);
+    progress_dialog_batch->show();
+}
+
+void QCamCalib::batchCameraFinished(int camera_id)
+{
+    // the camera might have been removed in the meantime
+    try
+    {
+        getCameraItem(camera_id)->updateView();
+    }
+    catch(const std::runtime_error &)
+    {
+    }
+    updateUndistortion();
+}
+
+void QCamCalib::batchFinished()
+{
+    progress_dialog_batch->reset();
+    progress_dialog_batch->hide();
+
+    QList<BatchResult> results = batch_calibration->getResults();
+    if(results.empty())
         return;
+
+    QStringList header;
+    header << "camera" << "images" << "chessboards" << "fx" << "fy" << "cx" << "cy"
+           << "distortion" << "rms error" << "rejected" << "detection [s]" << "solve [s]" << "status";
+    QDialog dialog(this);
+    dialog.setWindowTitle("Calibration results");
+    QTableWidget *table = new QTableWidget(results.size(),header.size(),&dialog);
+    table->setHorizontalHeaderLabels(header);
+    table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    for(int row=0;row < results.size();++row)
+    {
+        const BatchResult &result = results[row];
+        QStringList values;
+        values << QString::fromStdString(result.camera_name) << QString::number(result.images) << QString::number(result.chessboards);
+        if(result.error.empty())
+        {
+            const cv::Mat &k = result.calibration.camera_matrix;
+            const cv::Mat &dist = result.calibration.dist_coeffs;
+            QStringList coeffs;
+            for(int i=0;i < dist.rows;++i)
+                coeffs << QString::number(dist.at<double>(i));
+            values << QString::number(k.at<double>(0,0)) << QString::number(k.at<double>(1,1))
+                   << QString::number(k.at<double>(0,2)) << QString::number(k.at<double>(1,2))
+                   << QString("%1 (%2)").arg(getDistortionModelName(result.calibration.distortion)).arg(coeffs.join(", "))
+                   << QString::number(result.calibration.error)
+                   << QString::number(result.calibration.rejected_ids.size());
+        }
+        else
+        {
+            for(int i=0;i<7;++i)
+                values << "";
+        }
+        values << QString::number(result.detection_time,'f',2) << QString::number(result.solve_time,'f',2)
+               << (result.error.empty() ? QString("ok") : QString::fromStdString(result.error));
+        for(int col=0;col < values.size();++col)
+            table->setItem(row,col,new QTableWidgetItem(values[col]));
+    }
+    table->resizeColumnsToContents();
+    QVBoxLayout *layout = new QVBoxLayout(&dialog);
+    layout->addWidget(table);
+    dialog.resize(800,300);
+    dialog.exec();
+}
+
+void QCamCalib::calibrateRig()
+{
+    QSpinBox *cols = findChild<QSpinBox*>("spinBoxCols");
+    QSpinBox *rows = findChild<QSpinBox*>("spinBoxRows");
+    QDoubleSpinBox *dx = findChild<QDoubleSpinBox*>("spinBoxDx");
+    QDoubleSpinBox *dy = findChild<QDoubleSpinBox*>("spinBoxDy");
+    if(!cols || !rows || !dx || !dy)
+        throw std::runtime_error("cannot find chessboard config");
+    if(rig_job->isRunning())
+    {
+        QErrorMessage box;
+        box.showMessage("A rig calibration is already running. Wait until it is finished or cancel it." );
+        box.exec();
+        return;
+    }
+
+    // the first camera is the reference of the rig
+    QList<int> camera_ids;
+    for(int i=0;i<tree_model->rowCount();++i)
+    {
+        CameraItem *item = dynamic_cast<CameraItem*>(tree_model->item(i,0));
+        if(!item)
+            continue;
+        if(!item->isCalibrated())
+        {
+            QErrorMessage box;
+            box.showMessage(QString("Camera %1 is not calibrated. Calibrate all cameras before the rig.").arg(item->text()));
+            box.exec();
+            return;
+        }
+        camera_ids.push_back(item->getId());
+    }
+    if(camera_ids.size() < 2)
+    {
+        QErrorMessage box;
+        box.showMessage("A rig needs at least two cameras." );
+        box.exec();
+        return;
+    }
+
+    rig_job->setSettings(getRigSettings(this));
+    rig_job->start(dataset,camera_ids,cols->value(),rows->value(),dx->value(),dy->value());
+    progress_dialog_rig->setLabelText(QString("calibrate rig of %1 cameras").arg(camera_ids.size()));
+    progress_dialog_rig->setRange(0,0);
+    progress_dialog_rig->setValue(0);
+    progress_dialog_rig->show();
+}
+
+void QCamCalib::rigCalibrationProgress(int iteration,double error,double elapsed)
+{
+    progress_dialog_rig->setLabelText(QString("iteration %1\nrms error %2 px\nelapsed %3 s")
+                                      .arg(iteration).arg(error,0,'f',4).arg(elapsed,0,'f',1));
+}
+
+void QCamCalib::rigCalibrationFinished()
+{
+    const bool canceled = progress_dialog_rig->wasCanceled();
+    progress_dialog_rig->reset();
+    progress_dialog_rig->hide();
+    if(!rig_job->getError().isEmpty())
+    {
+        QErrorMessage box;
+        box.showMessage(QString("Rig calibration failed: ") + rig_job->getError());
+        box.exec();
+        return;
+    }
+    const RigResult result = rig_job->getResult();
+    if(canceled || result.canceled)
+        return;
+
+    QStringList header;
+    header << "camera" << "rvec" << "tvec" << "rms error" << "views";
+    QDialog dialog(this);
+    dialog.setWindowTitle("Rig calibration results");
+    QLabel *summary = new QLabel(QString("%1 frames, %2 views, %3 dropped, rms error %4 px")
+                                 .arg(result.frames).arg(result.observations).arg(result.dropped).arg(result.error),&dialog);
+    QTableWidget *table = new QTableWidget(int(result.camera_names.size()),header.size(),&dialog);
+    table->setHorizontalHeaderLabels(header);
+    table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    for(int row=0;row < int(result.camera_names.size());++row)
+    {
+        const cv::Mat &rvec = result.rvecs[row];
+        const cv::Mat &tvec = result.tvecs[row];
+        QStringList values;
+        values << QString::fromStdString(result.camera_names[row])
+               << QString("%1, %2, %3").arg(rvec.at<double>(0)).arg(rvec.at<double>(1)).arg(rvec.at<double>(2))
+               << QString("%1, %2, %3").arg(tvec.at<double>(0)).arg(tvec.at<double>(1)).arg(tvec.at<double>(2))
+               << QString::number(result.camera_errors[row])
+               << QString::number(result.camera_views[row]);
+        for(int col=0;col < values.size();++col)
+            table->setItem(row,col,new QTableWidgetItem(values[col]));
+    }
+    table->resizeColumnsToContents();
+    QVBoxLayout *layout = new QVBoxLayout(&dialog);
+    layout->addWidget(summary);
+    layout->addWidget(table);
+    dialog.resize(600,250);
+    dialog.exec();
+
+    QString path = QFileDialog::getSaveFileName(this, "Save Rig",current_load_path, "config (*.yml *.xml)");
+    if(path.size() == 0)
+        return;
+    try
+    {
+        saveRig(path.toStdString(),result);
+    }
+    catch(const std::runtime_error &e)
+    {
+        QErrorMessage box;
+        box.showMessage(QString("Cannot save rig: ") + e.what());
+        box.exec();
+    }
 }
 
 CameraItem *QCamCalib::getCameraItem(int camera_id)
@@ -266,6 +1132,17 @@ CameraItem *QCamCalib::getCameraItem(int camera_id)
     return item;
 }
 
+CameraItem *QCamCalib::getCurrentCameraItem()
+{
+    QTreeView *tree_view = findChild<QTreeView*>("treeView");
+    if(!tree_view)
+        throw std::runtime_error("Cannot find treeView object");
+    QStandardItem *item = tree_model->itemFromIndex(tree_view->currentIndex());
+    while(item && item->parent())
+        item = item->parent();
+    return dynamic_cast<CameraItem*>(item);
+}
+
 ImageItem *QCamCalib::getImageItem(int camera_id,const QString &name)
 {
     ImageItem *item = NULL;
@@ -307,16 +1184,17 @@ void QCamCalib::findChessBoard(int camera_id,const QString &name)
 
     ImageItem *item = getImageItem(camera_id,name);
     QList<QImage> images;
-    images.push_back(item->getRawImage());
+    images.push_back(item->getImage());
     QFuture<QVector<QPointF> > chessboards;
     chessboards = QtConcurrent::mapped(images,
-                                       boost::bind(static_cast<QVector<QPointF>(*)(const QImage&,int,int)>(ImageItem::findChessboard),_1,cols->value(),rows->value()));
+                                       boost::bind(static_cast<QVector<QPointF>(*)(const QImage&,int,int,const DetectorSettings&)>(ImageItem::findChessboard),
+                                                   _1,cols->value(),rows->value(),getCameraItem(item->getCameraId())->getDetector()));
     future_watcher_chessboard->setFuture(chessboards);
     progress_dialog_chessboard->setRange(0,1);
     if(QDialog::Accepted != progress_dialog_chessboard->exec() && future_watcher_chessboard->isCanceled())
         return;
     item->setChessboard(chessboards.results().front(),cols->value(),rows->value());
-    displayImage(item->getImage());
+    displayImageItem(item);
 }
 
 void QCamCalib::removeCurrentItem()
@@ -327,6 +1205,9 @@ void QCamCalib::removeCurrentItem()
     QModelIndex index = tree_view->currentIndex();
     if(index.isValid())
     {
+        CameraItem *camera = dynamic_cast<CameraItem*>(tree_model->itemFromIndex(index));
+        if(camera && camera->getId() == live_camera_id)
+            stopLiveCapture();
         if(index.parent().isValid())
             tree_model->itemFromIndex(index.parent())->removeRow(index.row());
         else
@@ -339,6 +1220,71 @@ void QCamCalib::displayImage(const QImage &image)
     image_view->displayImage(image);
 }
 
+void QCamCalib::displayImageItem(ImageItem *item)
+{
+    // the maps are built once per calibration and cached by the camera
+    CameraItem *camera = getCameraItem(item->getCameraId());
+    UndistortMaps maps;
+    if(getUndistortion(this) && camera->isCalibrated())
+        maps = camera->getUndistortMaps();
+
+    QVector<QPointF> corners = item->getChessboardCorners();
+    if(item->getPath().isEmpty())
+    {
+        const QImage image = item->getImage();
+        image_view->displayUndistortedImage(QString("image:%1").arg(image.cacheKey()),image.size(),image,maps);
+    }
+    else
+        image_view->displayUndistortedImage(item->getPath(),item->getImageSize(),QImage(),maps);
+    if(!maps.empty())
+        corners = undistortCorners(*camera->getData()->calibration,corners);
+    image_view->displayChessboard(corners,item->getChessboardSize().width(),item->getChessboardSize().height());
+    displayResidualHeatmap(camera);
+}
+
+void QCamCalib::updateUndistortion()
+{
+    QTreeView *tree_view = findChild<QTreeView*>("treeView");
+    if(!tree_view)
+        throw std::runtime_error("Cannot find treeView object");
+    ImageItem *image = dynamic_cast<ImageItem*>(tree_model->itemFromIndex(tree_view->currentIndex()));
+    if(image)
+        displayImageItem(image);
+    else
+        updateResidualHeatmap();
+}
+
+void QCamCalib::updateResidualHeatmap()
+{
+    displayResidualHeatmap(getCurrentCameraItem());
+}
+
+void QCamCalib::displayResidualHeatmap(CameraItem *camera)
+{
+    QCheckBox *enabled = findChild<QCheckBox*>("checkBoxResidualHeatmap");
+    QSpinBox *cols = findChild<QSpinBox*>("spinBoxCols");
+    QSpinBox *rows = findChild<QSpinBox*>("spinBoxRows");
+    QDoubleSpinBox *dx = findChild<QDoubleSpinBox*>("spinBoxDx");
+    QDoubleSpinBox *dy = findChild<QDoubleSpinBox*>("spinBoxDy");
+    if(!enabled || !cols || !rows || !dx || !dy)
+        throw std::runtime_error("cannot find chessboard config");
+
+    // the heatmap is given in distorted image coordinates
+    ResidualHeatmap heatmap;
+    if(enabled->isChecked() && !getUndistortion(this) && camera && camera->isCalibrated())
+    {
+        try
+        {
+            heatmap = camera->getResidualHeatmap(cols->value(),rows->value(),dx->value(),dy->value());
+        }
+        catch(const std::runtime_error &)
+        {
+            // no chessboard matches the current config
+        }
+    }
+    image_view->displayHeatmap(heatmap);
+}
+
 void QCamCalib::clickedTreeView(const QModelIndex& index)
 {
     if(!index.isValid())
@@ -349,9 +1295,141 @@ void QCamCalib::clickedTreeView(const QModelIndex& index)
     QStandardItem *item = model->itemFromIndex(index);
     if(!item)
         return;
+
+    // show the detector and calibration settings of the selected camera
+    CameraItem *camera = getCurrentCameraItem();
+    if(camera)
+    {
+        setDetectorSettings(this,camera->getDetector());
+        setSolver(this,camera->getSolver());
+        setDistortionModel(this,camera->getDistortionModel());
+    }
+
     ImageItem *image = dynamic_cast<ImageItem*>(item);
     if(image)
-        image_view->displayImage(image->getImage());
+        displayImageItem(image);
+}
+
+void QCamCalib::detectorSettingsChanged()
+{
+    DetectorSettings settings = getDetectorSettings(this);
+
+    // a new engine starts with its default flags
+    if(sender() == findChild<QComboBox*>("comboBoxDetector"))
+        settings.flags = DetectorSettings::getDefaultFlags(settings.engine);
+    setDetectorSettings(this,settings);
+
+    // the settings belong to the selected camera or to all cameras if none is selected
+    CameraItem *camera = getCurrentCameraItem();
+    if(camera)
+    {
+        camera->setDetector(settings);
+        return;
+    }
+    for(int i=0;i<tree_model->rowCount();++i)
+    {
+        CameraItem *item = dynamic_cast<CameraItem*>(tree_model->item(i,0));
+        if(item)
+            item->setDetector(settings);
+    }
+}
+
+void QCamCalib::solverChanged()
+{
+    // the solver belongs to the selected camera or to all cameras if none is selected
+    const CalibrationSolver solver = getSolver(this);
+    CameraItem *camera = getCurrentCameraItem();
+    if(camera)
+    {
+        camera->setSolver(solver);
+        return;
+    }
+    for(int i=0;i<tree_model->rowCount();++i)
+    {
+        CameraItem *item = dynamic_cast<CameraItem*>(tree_model->item(i,0));
+        if(item)
+            item->setSolver(solver);
+    }
+}
+
+void QCamCalib::distortionModelChanged()
+{
+    // the model is used by the next calibration of the selected camera or of all cameras
+    const DistortionModel distortion = getDistortionModel(this);
+    CameraItem *camera = getCurrentCameraItem();
+    if(camera)
+    {
+        camera->setDistortionModel(distortion);
+        return;
+    }
+    for(int i=0;i<tree_model->rowCount();++i)
+    {
+        CameraItem *item = dynamic_cast<CameraItem*>(tree_model->item(i,0));
+        if(item)
+            item->setDistortionModel(distortion);
+    }
 }
 
 
+
+void QCamCalib::updateTimingStatistics()
+{
+    if(!stats_view->isVisible())
+        return;
+
+    // update rows in place to keep the selection and sort order of the user
+    std::vector<StageStatistics> statistics = Profiler::instance().getStatistics();
+    stats_view->setSortingEnabled(false);
+    std::vector<StageStatistics>::const_iterator iter = statistics.begin();
+    for(;iter != statistics.end();++iter)
+    {
+        const QString stage = QString::fromStdString(iter->stage);
+        QList<QTreeWidgetItem*> items = stats_view->findItems(stage,Qt::MatchExactly,0);
+        QTreeWidgetItem *item = NULL;
+        if(items.empty())
+        {
+            item = new QTreeWidgetItem(stats_view);
+            item->setText(0,stage);
+            for(int i=1;i<stats_view->columnCount();++i)
+                item->setTextAlignment(i,Qt::AlignRight);
+        }
+        else
+            item = items.front();
+        item->setData(1,Qt::DisplayRole,qlonglong(iter->count));
+        item->setData(2,Qt::DisplayRole,QString::number(iter->total*1e-6,'f',1).toDouble());
+        item->setData(3,Qt::DisplayRole,QString::number(iter->count > 0 ? iter->total*1e-6/iter->count : 0.0,'f',3).toDouble());
+        item->setData(4,Qt::DisplayRole,QString::number(iter->max*1e-6,'f',3).toDouble());
+        item->setData(5,Qt::DisplayRole,qlonglong(iter->allocations));
+        item->setData(6,Qt::DisplayRole,QString::number(iter->allocated_bytes/(1024.0*1024.0),'f',1).toDouble());
+    }
+    // stages which were reset
+    for(int i=stats_view->topLevelItemCount()-1;i>=0;--i)
+    {
+        const std::string stage = stats_view->topLevelItem(i)->text(0).toStdString();
+        bool found = false;
+        for(iter = statistics.begin();iter != statistics.end() && !found;++iter)
+            found = iter->stage == stage;
+        if(!found)
+            delete stats_view->takeTopLevelItem(i);
+    }
+    stats_view->setSortingEnabled(true);
+}
+
+void QCamCalib::exportTimingTrace()
+{
+    QString path = QFileDialog::getSaveFileName(this, "Export Timing Trace",current_load_path, "Chrome trace (*.json)");
+    if(path.size() == 0)
+        return;
+    if(!Profiler::instance().saveChromeTrace(path))
+    {
+        QErrorMessage box;
+        box.showMessage(QString("Cannot write timing trace ") + path);
+        box.exec();
+    }
+}
+
+void QCamCalib::resetTimingStatistics()
+{
+    Profiler::instance().clear();
+    updateTimingStatistics();
+}
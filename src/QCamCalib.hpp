@@ -4,12 +4,20 @@
 #include <QtGui>
 #include <QFuture>
 #include <QFutureWatcher>
+#include <boost/shared_ptr.hpp>
 
 namespace qcam_calib
 {
     class CameraItem;
     class ImageItem;
     class ImageView;
+    class ImageLoader;
+    class VideoLoader;
+    class LiveCapture;
+    class CalibrationJob;
+    class RigCalibrationJob;
+    class Dataset;
+    class BatchCalibration;
 }
 
 
@@ -18,6 +26,7 @@ namespace qcam_calib
  *
  * As underlying Back-End OpenCV is used:
  *  * cv::findChessboardCorners
+ *  * cv::cornerSubPix (pyramid detection mode)
  *  * cv::calibrateCamera
  *
  * \author Alexander.Duda@dfki.de
@@ -60,6 +69,56 @@ public slots:
      */
     void loadImages(int camera_id = -1);
 
+    /**
+     * \brief Opens a dialog to select a video whose frames are added to the camera.
+     *
+     * The video is streamed, near duplicate and blurry frames are skipped and
+     * only frames with a detected chessboard are added as images.
+     *
+     * \note If no camera id is given it is assumed that a camera item is selected in the TreeView.
+     *
+     * \param[in] camera_id The id of the camera.
+     */
+    void loadVideo(int camera_id = -1);
+
+    /**
+     * \brief Starts the live capture mode for a camera
+     *
+     * Frames are shown with the detected chessboard as overlay. Views with a
+     * still, sharp and new chessboard are added to the camera automatically.
+     *
+     * \note If no camera id is given it is assumed that a camera item is selected in the TreeView.
+     *
+     * \param[in] source A camera device number, a video file which is replayed in real time or an empty string if frames are pushed with pushLiveFrame
+     * \param[in] camera_id The id of the camera.
+     */
+    void startLiveCapture(const QString &source = QString(),int camera_id = -1);
+
+    /**
+     * \brief Stops the live capture mode
+     */
+    void stopLiveCapture();
+
+    /**
+     * \brief Hands a frame of an external stream to the live capture mode
+     *
+     * The frame is shared and not copied. If the detection is busy, older
+     * frames which were not searched yet are dropped, so this call never blocks.
+     *
+     * \param[in] frame The frame
+     */
+    void pushLiveFrame(const QImage &frame);
+
+    /**
+     * \brief Sets the maximal number of images which are decoded and searched at the same time
+     *
+     * Bounds the memory needed by loadImages. Values smaller than 1 select a
+     * window based on the number of available cores.
+     *
+     * \param[in] count The number of images in flight
+     */
+    void setMaxImagesInFlight(int count);
+
     /**
      * \brief Adds an image to a camera
      *
@@ -85,12 +144,36 @@ public slots:
     /**
      * \brief Calibrates a camera
      *
+     * The calibration runs in the background and can be canceled. Its progress is
+     * reported in a non-modal dialog, the results are stored once it is finished.
+     * If the camera is already calibrated the solver starts from the previous
+     * result, which makes recalibrating after adding or removing a few images fast.
+     *
      * \note If no camera id is given it is assumed that a camera item is selected in the TreeView.
      *
      * \param[in] camera_id The id of the camera.
+     * \param[in] warm_start Set to false to ignore the previous result
      * \author Alexander.Duda@dfki.de
      */
-    void calibrateCamera(int camera_id = -1);
+    void calibrateCamera(int camera_id = -1,bool warm_start = true);
+
+    /**
+     * \brief Calibrates all cameras in parallel
+     *
+     * Chessboards which were not searched yet are detected first. The cameras are
+     * processed on a thread pool in the background and a table with the results of
+     * all cameras is shown when the batch is finished.
+     */
+    void calibrateAllCameras();
+
+    /**
+     * \brief Calibrates the relative poses of all cameras as a rig
+     *
+     * All cameras must be calibrated. The first camera in the TreeView is the
+     * reference of the rig. The calibration runs in the background and the
+     * result is saved to a file selected by the user once it is finished.
+     */
+    void calibrateRig();
 
     /**
      * \brief Finds chessboard corners in an image
@@ -103,21 +186,59 @@ public slots:
      */
     void findChessBoard(int camera_id=-1,const QString &name=QString(""));
 
+    /**
+     * \brief Opens a file dialog and saves all recorded stage timings as Chrome trace
+     *
+     * The file can be inspected with chrome://tracing or Perfetto.
+     */
+    void exportTimingTrace();
+
+    /**
+     * \brief Clears all recorded stage timings
+     */
+    void resetTimingStatistics();
+
 private slots:
     void contextMenuTreeView(const QPoint &point);
     void clickedTreeView(const QModelIndex& index);
     void displayImage(const QImage &image);
+    void displayImageItem(qcam_calib::ImageItem *item);
     void removeCurrentItem();
+    void calibrateCameraFromScratch();
+    void calibrationProgress(int iteration,double error,double elapsed);
+    void calibrationFinished(int camera_id);
+    void batchCameraFinished(int camera_id);
+    void batchFinished();
+    void rigCalibrationProgress(int iteration,double error,double elapsed);
+    void rigCalibrationFinished();
+    void imageLoaded(const QString &path,const QSize &size,const QVector<QPointF> &chessboard);
+    void videoFrameLoaded(const QString &name,const QImage &image,const QVector<QPointF> &chessboard);
+    void addPendingImages();
+    void selectLiveCaptureSource();
+    void showLiveFrame();
+    void liveDetectionFinished(const QImage &frame,const QVector<QPointF> &chessboard);
+    void liveFrameAccepted(const QImage &frame,const QVector<QPointF> &chessboard);
+    void updateTimingStatistics();
+    void detectorSettingsChanged();
+    void solverChanged();
+    void distortionModelChanged();
+    void updateResidualHeatmap();
+    void updateUndistortion();
 
 private:
+    void displayResidualHeatmap(qcam_calib::CameraItem *camera);
     qcam_calib::CameraItem *getCameraItem(int camera_id);
+    qcam_calib::CameraItem *getCurrentCameraItem();
     qcam_calib::ImageItem *getImageItem(int camera_id,const QString &name);
 
 private:
     // file paths
     QString current_load_path;
 
-    // tree model
+    // cameras, images and calibration results shared with the worker threads
+    boost::shared_ptr<qcam_calib::Dataset> dataset;
+
+    // tree model, a view on the dataset
     QStandardItemModel *tree_model;
 
     // menues
@@ -128,13 +249,49 @@ private:
     // image dispay
     qcam_calib::ImageView *image_view;
 
+    // stage timing
+    QTreeWidget *stats_view;
+    QTimer *stats_timer;
+
+    // image loading
+    qcam_calib::ImageLoader *image_loader;
+    qcam_calib::VideoLoader *video_loader;
+
+    // live capture
+    qcam_calib::LiveCapture *live_capture;
+    QTimer *live_timer;
+    QProgressDialog *progress_dialog_live;
+    int live_camera_id;
+    int live_frame_id;
+    QVector<QPointF> live_chessboard;
+    qcam_calib::ImageItem *last_loaded_item;
+    int load_camera_id;
+    QStringList failed_paths;
+
+    // loaded images are added to the dataset in batches, each addition copies the camera
+    struct PendingImage
+    {
+        QString name;
+        QString path;               // empty for video frames
+        QSize size;
+        QImage image;
+        QVector<QPointF> chessboard;
+    };
+    QList<PendingImage> pending_images;
+    QTimer *pending_timer;
+
     // progress stuff
     QProgressDialog *progress_dialog_images;
+    QProgressDialog *progress_dialog_video;
     QProgressDialog *progress_dialog_chessboard;
     QProgressDialog *progress_dialog_calibrate;
-    QFutureWatcher<QImage> *future_watcher_images;
     QFutureWatcher<QVector<QPointF> > *future_watcher_chessboard;
-    QFutureWatcher<void> *future_watcher_calibrate;
+    qcam_calib::CalibrationJob *calibration_job;
+    QProgressDialog *progress_dialog_batch;
+    qcam_calib::BatchCalibration *batch_calibration;
+    QProgressDialog *progress_dialog_rig;
+    qcam_calib::RigCalibrationJob *rig_job;
+    bool save_after_calibration;
 };
 
 #endif /* QCAMCALIB_HPP */
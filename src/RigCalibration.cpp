@@ -0,0 +1,696 @@
+#include "RigCalibration.hpp"
+#include "Profiler.hpp"
+
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <map>
+#include <stdexcept>
+#include <QFileInfo>
+#include <QRegExp>
+#include <QTime>
+#include <QList>
+#include <QtConcurrentMap>
+#include <boost/bind.hpp>
+
+using namespace qcam_calib;
+
+typedef cv::Matx<double,6,6> Matx66;
+typedef cv::Vec<double,6> Vec6;
+
+RigSettings::RigSettings():
+    matching(RIG_MATCH_NAME),
+    max_time_difference(0),
+    max_iterations(50),
+    max_initial_error(10)
+{
+}
+
+RigResult::RigResult():
+    frames(0),
+    observations(0),
+    dropped(0),
+    error(-1),
+    iterations(0),
+    canceled(false)
+{
+}
+
+// a chessboard seen by one camera of the rig
+struct RigObservation
+{
+    int camera;                             // index into the rig, 0 is the reference camera
+    int frame;
+    std::vector<cv::Point2f> corners;
+    Vec6 pose;                              // initial pose of the board in the camera
+};
+
+// everything which does not change while solving
+struct RigProblem
+{
+    std::vector<cv::Point3f> board;
+    std::vector<CameraModel> models;        // intrinsics of each camera
+    std::vector<RigObservation> observations;
+    std::vector<std::vector<int> > frames;  // observations of each frame
+};
+
+// the unknowns, poses are stored as (rvec,tvec)
+struct RigParameters
+{
+    std::vector<Vec6> cameras;              // reference camera to camera, cameras[0] is the identity
+    std::vector<Vec6> boards;               // board to reference camera of each frame
+};
+
+// normal equations of one frame
+struct FrameSystem
+{
+    FrameSystem():
+        V(Matx66::zeros()),
+        gf(Vec6::all(0)),
+        cost(0)
+    {
+    }
+
+    std::vector<int> cameras;               // rig index of each observation with camera parameters
+    std::vector<Matx66> U;                  // J_camera^T J_camera
+    std::vector<Matx66> W;                  // J_camera^T J_board
+    std::vector<Vec6> gc;                   // J_camera^T r
+    Matx66 V;                               // J_board^T J_board
+    Vec6 gf;                                // J_board^T r
+    double cost;                            // sum of squared residuals
+};
+
+// contribution of one frame to the reduced camera system
+struct FrameSchur
+{
+    Matx66 V_inv;
+    std::vector<Matx66> S;                  // blocks of all observation pairs, row major
+    std::vector<Vec6> rhs;
+};
+
+static void splitPose(const Vec6 &pose,cv::Mat &rvec,cv::Mat &tvec)
+{
+    rvec = (cv::Mat_<double>(3,1) << pose[0],pose[1],pose[2]);
+    tvec = (cv::Mat_<double>(3,1) << pose[3],pose[4],pose[5]);
+}
+
+static Vec6 joinPose(const cv::Mat &rvec,const cv::Mat &tvec)
+{
+    cv::Mat r,t;
+    rvec.convertTo(r,CV_64F);
+    tvec.convertTo(t,CV_64F);
+    return Vec6(r.at<double>(0),r.at<double>(1),r.at<double>(2),t.at<double>(0),t.at<double>(1),t.at<double>(2));
+}
+
+// applies first then second
+static Vec6 composePose(const Vec6 &first,const Vec6 &second)
+{
+    cv::Mat r1,t1,r2,t2,r3,t3;
+    splitPose(first,r1,t1);
+    splitPose(second,r2,t2);
+    cv::composeRT(r1,t1,r2,t2,r3,t3);
+    return joinPose(r3,t3);
+}
+
+static Vec6 invertPose(const Vec6 &pose)
+{
+    cv::Mat rvec,tvec,rotation;
+    splitPose(pose,rvec,tvec);
+    cv::Rodrigues(rvec,rotation);
+    cv::Mat rotation_inv = rotation.t();
+    cv::Mat rvec_inv;
+    cv::Rodrigues(rotation_inv,rvec_inv);
+    return joinPose(rvec_inv,-rotation_inv*tvec);
+}
+
+static Matx66 poseDerivative(const cv::Mat &drdr,const cv::Mat &drdt,const cv::Mat &dtdr,const cv::Mat &dtdt)
+{
+    Matx66 d;
+    for(int r=0;r < 3;++r)
+    {
+        for(int c=0;c < 3;++c)
+        {
+            d(r,c) = drdr.at<double>(r,c);
+            d(r,c+3) = drdt.at<double>(r,c);
+            d(r+3,c) = dtdr.at<double>(r,c);
+            d(r+3,c+3) = dtdt.at<double>(r,c);
+        }
+    }
+    return d;
+}
+
+// sum of squared reprojection errors of corners seen by a camera with the board at the given pose
+static double reprojectionCost(const RigProblem &problem,int camera,const Vec6 &pose,const std::vector<cv::Point2f> &corners)
+{
+    cv::Mat rvec,tvec;
+    std::vector<cv::Point2f> projected;
+    splitPose(pose,rvec,tvec);
+    problem.models[camera].project(cv::Mat(problem.board),rvec,tvec,projected);
+    double cost = 0;
+    for(size_t i=0;i < projected.size();++i)
+    {
+        const cv::Point2f d = projected[i]-corners[i];
+        cost += d.x*d.x+d.y*d.y;
+    }
+    return cost;
+}
+
+static double observationCost(const RigProblem &problem,const RigParameters &parameters,int index)
+{
+    const RigObservation &observation = problem.observations[index];
+    const Vec6 pose = composePose(parameters.boards[observation.frame],parameters.cameras[observation.camera]);
+    return reprojectionCost(problem,observation.camera,pose,observation.corners);
+}
+
+static double frameCost(const RigProblem *problem,const RigParameters *parameters,int frame)
+{
+    double cost = 0;
+    const std::vector<int> &observations = problem->frames[frame];
+    for(size_t i=0;i < observations.size();++i)
+        cost += observationCost(*problem,*parameters,observations[i]);
+    return cost;
+}
+
+static FrameSystem linearizeFrame(const RigProblem *problem,const RigParameters *parameters,int frame)
+{
+    FrameSystem system;
+    const std::vector<int> &observations = problem->frames[frame];
+    for(size_t o=0;o < observations.size();++o)
+    {
+        const RigObservation &observation = problem->observations[observations[o]];
+        cv::Mat r1,t1,r2,t2,r3,t3;
+        cv::Mat dr3dr1,dr3dt1,dr3dr2,dr3dt2,dt3dr1,dt3dt1,dt3dr2,dt3dt2;
+        splitPose(parameters->boards[frame],r1,t1);
+        splitPose(parameters->cameras[observation.camera],r2,t2);
+        cv::composeRT(r1,t1,r2,t2,r3,t3,dr3dr1,dr3dt1,dr3dr2,dr3dt2,dt3dr1,dt3dt1,dt3dr2,dt3dt2);
+
+        std::vector<cv::Point2f> projected;
+        cv::Mat jacobian;
+        problem->models[observation.camera].project(cv::Mat(problem->board),r3,t3,projected,&jacobian);
+
+        // normal equations of the composed pose, the first six columns of the jacobian
+        Matx66 A = Matx66::zeros();
+        Vec6 b = Vec6::all(0);
+        for(size_t i=0;i < projected.size();++i)
+        {
+            const double rx = projected[i].x-observation.corners[i].x;
+            const double ry = projected[i].y-observation.corners[i].y;
+            const double *jx = jacobian.ptr<double>(2*i);
+            const double *jy = jacobian.ptr<double>(2*i+1);
+            for(int r=0;r < 6;++r)
+            {
+                b[r] += jx[r]*rx+jy[r]*ry;
+                for(int c=r;c < 6;++c)
+                    A(r,c) += jx[r]*jx[c]+jy[r]*jy[c];
+            }
+            system.cost += rx*rx+ry*ry;
+        }
+        for(int r=0;r < 6;++r)
+        {
+            for(int c=0;c < r;++c)
+                A(r,c) = A(c,r);
+        }
+
+        // chain rule through the composition of board and camera pose
+        const Matx66 d_board = poseDerivative(dr3dr1,dr3dt1,dt3dr1,dt3dt1);
+        const Matx66 A_board = A*d_board;
+        system.V += d_board.t()*A_board;
+        system.gf += d_board.t()*b;
+        if(observation.camera > 0)
+        {
+            const Matx66 d_camera = poseDerivative(dr3dr2,dr3dt2,dt3dr2,dt3dt2);
+            system.cameras.push_back(observation.camera);
+            system.U.push_back(d_camera.t()*A*d_camera);
+            system.W.push_back(d_camera.t()*A_board);
+            system.gc.push_back(d_camera.t()*b);
+        }
+    }
+    return system;
+}
+
+static FrameSchur eliminateFrame(const std::vector<FrameSystem> *systems,double lambda,int frame)
+{
+    const FrameSystem &system = (*systems)[frame];
+    FrameSchur schur;
+    Matx66 V = system.V;
+    for(int i=0;i < 6;++i)
+        V(i,i) *= 1.0+lambda;
+    schur.V_inv = V.inv(cv::DECOMP_CHOLESKY);
+
+    const size_t count = system.cameras.size();
+    std::vector<Matx66> WV_inv(count);
+    for(size_t a=0;a < count;++a)
+    {
+        WV_inv[a] = system.W[a]*schur.V_inv;
+        schur.rhs.push_back(WV_inv[a]*system.gf);
+    }
+    for(size_t a=0;a < count;++a)
+    {
+        for(size_t b=0;b < count;++b)
+            schur.S.push_back(WV_inv[a]*system.W[b].t());
+    }
+    return schur;
+}
+
+// median of each component
+static Vec6 medianPose(const std::vector<Vec6> &poses)
+{
+    Vec6 median;
+    std::vector<double> values(poses.size());
+    for(int i=0;i < 6;++i)
+    {
+        for(size_t j=0;j < poses.size();++j)
+            values[j] = poses[j][i];
+        std::nth_element(values.begin(),values.begin()+values.size()/2,values.end());
+        median[i] = values[values.size()/2];
+    }
+    return median;
+}
+
+// the candidate closest to the component wise median, robust against wrong single views
+static Vec6 robustPose(const std::vector<Vec6> &poses)
+{
+    const Vec6 median = medianPose(poses);
+    size_t best = 0;
+    double best_distance = -1;
+    for(size_t i=0;i < poses.size();++i)
+    {
+        const Vec6 d = poses[i]-median;
+        // rotations are compared in radian, translations relative to the median distance
+        const double scale = std::max(cv::norm(cv::Vec3d(median[3],median[4],median[5])),1e-6);
+        const double distance = d[0]*d[0]+d[1]*d[1]+d[2]*d[2]+(d[3]*d[3]+d[4]*d[4]+d[5]*d[5])/(scale*scale);
+        if(best_distance < 0 || distance < best_distance)
+        {
+            best = i;
+            best_distance = distance;
+        }
+    }
+    return poses[best];
+}
+
+// the last number of the file name
+static bool parseTimestamp(const std::string &name,double &timestamp)
+{
+    const QString base = QFileInfo(QString::fromStdString(name)).completeBaseName();
+    QRegExp number("(\\d+(\\.\\d+)?)");
+    int pos = 0;
+    int last = -1;
+    while((pos = number.indexIn(base,pos)) != -1)
+    {
+        last = pos;
+        pos += number.matchedLength();
+    }
+    if(last < 0)
+        return false;
+    number.indexIn(base,last);
+    timestamp = number.cap(1).toDouble();
+    return true;
+}
+
+struct RigImage
+{
+    int camera;
+    double timestamp;
+    ImageDataPtr image;
+
+    bool operator<(const RigImage &other)const
+    {
+        return timestamp < other.timestamp;
+    }
+};
+
+// groups the images of all cameras into frames, each camera appears at most once per frame
+static std::vector<std::vector<RigImage> > matchFrames(const std::vector<CameraDataPtr> &cameras,size_t corners,const RigSettings &settings)
+{
+    std::vector<std::vector<RigImage> > frames;
+    if(settings.matching == RIG_MATCH_NAME)
+    {
+        std::map<QString,size_t> frame_ids;
+        for(size_t c=0;c < cameras.size();++c)
+        {
+            std::map<int,ImageDataPtr>::const_iterator iter = cameras[c]->images.begin();
+            for(;iter != cameras[c]->images.end();++iter)
+            {
+                if(iter->second->corners.size() != corners)
+                    continue;
+                const QString key = QFileInfo(QString::fromStdString(iter->second->name)).completeBaseName();
+                std::map<QString,size_t>::const_iterator id = frame_ids.find(key);
+                if(id == frame_ids.end())
+                {
+                    id = frame_ids.insert(std::make_pair(key,frames.size())).first;
+                    frames.push_back(std::vector<RigImage>());
+                }
+                std::vector<RigImage> &frame = frames[id->second];
+                if(!frame.empty() && frame.back().camera == int(c))
+                    continue;
+                RigImage image = {int(c),0,iter->second};
+                frame.push_back(image);
+            }
+        }
+        return frames;
+    }
+
+    std::vector<RigImage> images;
+    for(size_t c=0;c < cameras.size();++c)
+    {
+        std::map<int,ImageDataPtr>::const_iterator iter = cameras[c]->images.begin();
+        for(;iter != cameras[c]->images.end();++iter)
+        {
+            RigImage image = {int(c),0,iter->second};
+            if(iter->second->corners.size() == corners && parseTimestamp(iter->second->name,image.timestamp))
+                images.push_back(image);
+        }
+    }
+    std::sort(images.begin(),images.end());
+    double start = 0;
+    for(size_t i=0;i < images.size();++i)
+    {
+        bool new_frame = frames.empty() || images[i].timestamp-start > settings.max_time_difference;
+        for(size_t j=0;!new_frame && j < frames.back().size();++j)
+            new_frame = frames.back()[j].camera == images[i].camera;
+        if(new_frame)
+        {
+            frames.push_back(std::vector<RigImage>());
+            start = images[i].timestamp;
+        }
+        frames.back().push_back(images[i]);
+    }
+    return frames;
+}
+
+static double rms(double cost,int points)
+{
+    return points > 0 ? std::sqrt(cost/points) : -1;
+}
+
+RigResult qcam_calib::calibrateRig(const std::vector<CameraDataPtr> &cameras,int cols,int rows,float dx,float dy,
+                                   const RigSettings &settings,CalibrationProgress *progress)
+{
+    ScopedProfile profile("rig calibration");
+    QTime timer;
+    timer.start();
+    if(cameras.size() < 2)
+        throw std::runtime_error("a rig needs at least two cameras");
+
+    RigResult result;
+    RigProblem problem;
+    for(int row=0;row < rows; ++row)
+    {
+        for(int col=0;col < cols; ++col)
+            problem.board.push_back(cv::Point3f(dx*col,dy*row,0));
+    }
+    for(size_t c=0;c < cameras.size();++c)
+    {
+        const CameraData &camera = *cameras[c];
+        if(!camera.calibration)
+            throw std::runtime_error("camera " + camera.name + " is not calibrated");
+        const CalibrationResult &calibration = *camera.calibration;
+        problem.models.push_back(CameraModel(calibration.distortion,calibration.camera_matrix,calibration.dist_coeffs));
+        result.camera_ids.push_back(camera.id);
+        result.camera_names.push_back(camera.name);
+    }
+
+    // synchronized frames with the initial board pose of each view
+    const std::vector<std::vector<RigImage> > frames = matchFrames(cameras,problem.board.size(),settings);
+    std::vector<std::vector<RigObservation> > frame_observations;
+    for(size_t f=0;f < frames.size();++f)
+    {
+        if(frames[f].size() < 2)
+            continue;
+        std::vector<RigObservation> observations;
+        for(size_t i=0;i < frames[f].size();++i)
+        {
+            const RigImage &image = frames[f][i];
+            RigObservation observation;
+            observation.camera = image.camera;
+            observation.frame = frame_observations.size();
+            observation.corners = image.image->corners;
+            cv::Mat rvec,tvec;
+            if(!cameras[image.camera]->calibration->getViewPose(image.image->id,rvec,tvec))
+                problem.models[image.camera].solvePose(cv::Mat(problem.board),cv::Mat(observation.corners),rvec,tvec);
+            observation.pose = joinPose(rvec,tvec);
+            observations.push_back(observation);
+        }
+        frame_observations.push_back(observations);
+    }
+    if(frame_observations.empty())
+        throw std::runtime_error("no chessboard is seen by two cameras at the same time");
+
+    // initial camera poses, cameras without common frames with the reference are chained through other cameras
+    RigParameters parameters;
+    parameters.cameras.resize(cameras.size(),Vec6::all(0));
+    std::vector<bool> known(cameras.size(),false);
+    known[0] = true;
+    for(bool changed=true;changed;)
+    {
+        changed = false;
+        for(size_t c=1;c < cameras.size();++c)
+        {
+            if(known[c])
+                continue;
+            // candidates of the known camera with the most common frames
+            std::vector<std::vector<Vec6> > candidates(cameras.size());
+            for(size_t f=0;f < frame_observations.size();++f)
+            {
+                const std::vector<RigObservation> &observations = frame_observations[f];
+                const RigObservation *target = NULL;
+                for(size_t i=0;i < observations.size();++i)
+                {
+                    if(observations[i].camera == int(c))
+                        target = &observations[i];
+                }
+                for(size_t i=0;target && i < observations.size();++i)
+                {
+                    const int k = observations[i].camera;
+                    if(!known[k])
+                        continue;
+                    const Vec6 camera_to_board = composePose(parameters.cameras[k],invertPose(observations[i].pose));
+                    candidates[k].push_back(composePose(camera_to_board,target->pose));
+                }
+            }
+            size_t best = 0;
+            for(size_t k=1;k < candidates.size();++k)
+            {
+                if(candidates[k].size() > candidates[best].size())
+                    best = k;
+            }
+            if(candidates[best].empty())
+                continue;
+            parameters.cameras[c] = robustPose(candidates[best]);
+            known[c] = true;
+            changed = true;
+        }
+    }
+    for(size_t c=0;c < cameras.size();++c)
+    {
+        if(!known[c])
+            throw std::runtime_error("camera " + cameras[c]->name + " shares no synchronized views with the rig");
+    }
+
+    // initial board poses, fix the corner order of each view and drop views which do not fit
+    const double max_cost = settings.max_initial_error*settings.max_initial_error*problem.board.size();
+    for(size_t f=0;f < frame_observations.size();++f)
+    {
+        const std::vector<RigObservation> &observations = frame_observations[f];
+        const RigObservation &first = observations.front();
+        const Vec6 board = composePose(first.pose,invertPose(parameters.cameras[first.camera]));
+        std::vector<RigObservation> kept;
+        for(size_t i=0;i < observations.size();++i)
+        {
+            // symmetric boards might be detected with reversed corner order
+            RigObservation observation = observations[i];
+            const Vec6 pose = composePose(board,parameters.cameras[observation.camera]);
+            std::vector<cv::Point2f> reversed(observation.corners.rbegin(),observation.corners.rend());
+            double cost = reprojectionCost(problem,observation.camera,pose,observation.corners);
+            const double cost_reversed = reprojectionCost(problem,observation.camera,pose,reversed);
+            if(cost_reversed < cost)
+            {
+                observation.corners.swap(reversed);
+                cost = cost_reversed;
+            }
+            if(cost > max_cost)
+                ++result.dropped;
+            else
+                kept.push_back(observation);
+        }
+        if(kept.size() < 2)
+        {
+            result.dropped += kept.size();
+            continue;
+        }
+        const int frame = problem.frames.size();
+        problem.frames.push_back(std::vector<int>());
+        for(size_t i=0;i < kept.size();++i)
+        {
+            kept[i].frame = frame;
+            problem.frames.back().push_back(problem.observations.size());
+            problem.observations.push_back(kept[i]);
+        }
+        parameters.boards.push_back(board);
+    }
+
+    result.camera_views.assign(cameras.size(),0);
+    for(size_t i=0;i < problem.observations.size();++i)
+        ++result.camera_views[problem.observations[i].camera];
+    for(size_t c=0;c < cameras.size();++c)
+    {
+        if(result.camera_views[c] == 0)
+            throw std::runtime_error("camera " + cameras[c]->name + " has no views which fit the rig");
+    }
+    result.frames = problem.frames.size();
+    result.observations = problem.observations.size();
+    const int points = result.observations*problem.board.size();
+
+    // sparse Levenberg-Marquardt, the board poses are eliminated with the Schur complement
+    QList<int> frame_ids;
+    for(int f=0;f < result.frames;++f)
+        frame_ids << f;
+    const int size = 6*(cameras.size()-1);
+    double lambda = 1e-3;
+    std::vector<FrameSystem> systems;
+    double cost = 0;
+    {
+        ScopedProfile profile("rig linearization");
+        QList<FrameSystem> list = QtConcurrent::blockingMapped<QList<FrameSystem> >(frame_ids,boost::bind(linearizeFrame,&problem,&parameters,_1));
+        systems.assign(list.begin(),list.end());
+    }
+    for(size_t f=0;f < systems.size();++f)
+        cost += systems[f].cost;
+
+    for(result.iterations=0;result.iterations < settings.max_iterations;)
+    {
+        ++result.iterations;
+        bool improved = false;
+        double new_cost = cost;
+        for(int attempt=0;attempt < 10 && !improved;++attempt)
+        {
+            // reduced camera system
+            cv::Mat S = cv::Mat::zeros(size,size,CV_64FC1);
+            cv::Mat rhs = cv::Mat::zeros(size,1,CV_64FC1);
+            cv::Mat U_diagonal = cv::Mat::zeros(size,1,CV_64FC1);
+            std::vector<FrameSchur> schurs;
+            {
+                ScopedProfile profile("rig schur complement");
+                QList<FrameSchur> list = QtConcurrent::blockingMapped<QList<FrameSchur> >(frame_ids,boost::bind(eliminateFrame,&systems,lambda,_1));
+                schurs.assign(list.begin(),list.end());
+            }
+            for(size_t f=0;f < systems.size();++f)
+            {
+                const FrameSystem &system = systems[f];
+                const FrameSchur &schur = schurs[f];
+                const size_t count = system.cameras.size();
+                for(size_t a=0;a < count;++a)
+                {
+                    const int ca = 6*(system.cameras[a]-1);
+                    cv::Mat block = S(cv::Rect(ca,ca,6,6));
+                    block += cv::Mat(system.U[a]);
+                    cv::Mat rhs_block = rhs(cv::Rect(0,ca,1,6));
+                    rhs_block += cv::Mat(schur.rhs[a]-system.gc[a]);
+                    for(int i=0;i < 6;++i)
+                        U_diagonal.at<double>(ca+i) += system.U[a](i,i);
+                    for(size_t b=0;b < count;++b)
+                    {
+                        const int cb = 6*(system.cameras[b]-1);
+                        cv::Mat block = S(cv::Rect(cb,ca,6,6));
+                        block -= cv::Mat(schur.S[a*count+b]);
+                    }
+                }
+            }
+            // the camera blocks are damped on their summed diagonal
+            for(int i=0;i < size;++i)
+                S.at<double>(i,i) += lambda*U_diagonal.at<double>(i);
+            cv::Mat delta;
+            if(!cv::solve(S,rhs,delta,cv::DECOMP_CHOLESKY))
+            {
+                lambda *= 10;
+                continue;
+            }
+
+            // back substitution of the board poses
+            RigParameters candidate = parameters;
+            for(size_t c=1;c < cameras.size();++c)
+                candidate.cameras[c] += Vec6(delta.ptr<double>(6*(c-1)));
+            for(size_t f=0;f < systems.size();++f)
+            {
+                const FrameSystem &system = systems[f];
+                Vec6 g = -system.gf;
+                for(size_t a=0;a < system.cameras.size();++a)
+                    g -= system.W[a].t()*Vec6(delta.ptr<double>(6*(system.cameras[a]-1)));
+                candidate.boards[f] += schurs[f].V_inv*g;
+            }
+
+            {
+                ScopedProfile profile("rig cost");
+                QList<double> costs = QtConcurrent::blockingMapped<QList<double> >(frame_ids,boost::bind(frameCost,&problem,&candidate,_1));
+                new_cost = 0;
+                for(int f=0;f < costs.size();++f)
+                    new_cost += costs[f];
+            }
+            if(new_cost < cost)
+            {
+                parameters = candidate;
+                improved = true;
+                lambda = std::max(lambda*0.1,1e-12);
+            }
+            else
+                lambda *= 10;
+        }
+        const double decrease = cost-new_cost;
+        if(improved)
+            cost = new_cost;
+        if(progress && !progress->step(result.iterations,rms(cost,points),timer.elapsed()*0.001))
+        {
+            result.canceled = true;
+            break;
+        }
+        if(!improved || decrease < 1e-10*cost)
+            break;
+
+        ScopedProfile profile("rig linearization");
+        QList<FrameSystem> list = QtConcurrent::blockingMapped<QList<FrameSystem> >(frame_ids,boost::bind(linearizeFrame,&problem,&parameters,_1));
+        systems.assign(list.begin(),list.end());
+    }
+
+    // result
+    std::vector<double> camera_costs(cameras.size(),0);
+    for(size_t i=0;i < problem.observations.size();++i)
+        camera_costs[problem.observations[i].camera] += observationCost(problem,parameters,i);
+    for(size_t c=0;c < cameras.size();++c)
+    {
+        cv::Mat rvec,tvec;
+        splitPose(parameters.cameras[c],rvec,tvec);
+        result.rvecs.push_back(rvec);
+        result.tvecs.push_back(tvec);
+        result.distortions.push_back(problem.models[c].getDistortionModel());
+        result.camera_matrices.push_back(problem.models[c].getCameraMatrix());
+        result.dist_coeffs.push_back(problem.models[c].getDistCoeffs());
+        result.camera_errors.push_back(rms(camera_costs[c],result.camera_views[c]*problem.board.size()));
+    }
+    result.error = rms(cost,points);
+    return result;
+}
+
+void qcam_calib::saveRig(const std::string &path,const RigResult &result)
+{
+    cv::FileStorage fs(path, cv::FileStorage::WRITE);
+    if(!fs.isOpened())
+        throw std::runtime_error("cannot open " + path);
+    time_t rawtime; time(&rawtime);
+    fs << "calibrationDate" << asctime(localtime(&rawtime));
+    fs << "rmsError" << result.error;
+    fs << "cameras" << "[";
+    for(size_t c=0;c < result.camera_names.size();++c)
+    {
+        cv::Mat rotation;
+        cv::Rodrigues(result.rvecs[c],rotation);
+        fs << "{" << "name" << result.camera_names[c]
+           << "cameraMatrix" << result.camera_matrices[c]
+           << "distortionModel" << getDistortionModelName(result.distortions[c]) << "distCoeffs" << result.dist_coeffs[c]
+           << "R" << rotation << "T" << result.tvecs[c]
+           << "rmsError" << result.camera_errors[c] << "views" << result.camera_views[c] << "}";
+    }
+    fs << "]";
+    fs.release();
+}
@@ -0,0 +1,100 @@
+#ifndef QCAMCALIB_RIG_CALIBRATION_HPP
+#define QCAMCALIB_RIG_CALIBRATION_HPP
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+#include <string>
+
+#include "Calibration.hpp"
+#include "Dataset.hpp"
+
+namespace qcam_calib
+{
+    /**
+     * \brief Selects how images of different cameras are matched to synchronized frames
+     *
+     * RIG_MATCH_NAME pairs images with the same file name without suffix.
+     * RIG_MATCH_TIMESTAMP reads the last number of the file name as timestamp
+     * and groups images whose timestamps differ by at most max_time_difference.
+     */
+    enum RigMatching
+    {
+        RIG_MATCH_NAME = 0,
+        RIG_MATCH_TIMESTAMP = 1
+    };
+
+    /**
+     * \brief Parameters of the rig calibration
+     */
+    struct RigSettings
+    {
+        RigSettings();
+
+        RigMatching matching;
+        double max_time_difference;     // in units of the timestamps, only used for RIG_MATCH_TIMESTAMP
+        int max_iterations;
+        double max_initial_error;       // views with a larger rms error after the initialization are dropped (pixel)
+    };
+
+    /**
+     * \brief Output of a rig calibration
+     *
+     * The first camera is the reference of the rig. The pose of each camera
+     * maps points from the reference camera frame into the camera frame
+     * (x_camera = R(rvec) * x_reference + tvec), so the pose of the reference
+     * camera is the identity.
+     */
+    struct RigResult
+    {
+        RigResult();
+
+        std::vector<int> camera_ids;
+        std::vector<std::string> camera_names;
+        std::vector<DistortionModel> distortions;
+        std::vector<cv::Mat> camera_matrices;   // intrinsics used for each camera, they are not changed
+        std::vector<cv::Mat> dist_coeffs;
+        std::vector<cv::Mat> rvecs;             // 3x1 CV_64FC1
+        std::vector<cv::Mat> tvecs;             // 3x1 CV_64FC1
+        std::vector<double> camera_errors;      // rms reprojection error of each camera in pixel
+        std::vector<int> camera_views;          // number of views of each camera used
+        int frames;                             // synchronized frames seen by at least two cameras
+        int observations;                       // views used in total
+        int dropped;                            // views dropped after the initialization
+        double error;                           // rms reprojection error in pixel
+        int iterations;
+        bool canceled;
+    };
+
+    /**
+     * \brief Calibrates the relative poses of a multi camera rig
+     *
+     * The intrinsics of each camera are taken from its calibration and are
+     * kept fixed. Images are matched to synchronized frames and the chessboard
+     * pose of each frame is solved jointly with the poses of all cameras in a
+     * sparse Levenberg-Marquardt bundle adjustment. The board poses are
+     * eliminated with the Schur complement, so each iteration only solves a
+     * dense system of size 6*(cameras-1) and the cost grows linearly with
+     * the number of frames. The frames are linearized in parallel.
+     *
+     * The initial camera poses are derived from the per view board poses of
+     * the single camera calibrations, chaining cameras which do not share
+     * frames with the reference camera.
+     *
+     * \param[in] cameras The calibrated cameras, the first one is the reference
+     * \param[in] cols The number of inner chessboard corners per row
+     * \param[in] rows The number of inner chessboard corners per column
+     * \param[in] dx The width of a chessboard cell
+     * \param[in] dy The height of a chessboard cell
+     * \param[in] settings The matching and solver parameters
+     * \param[in] progress Optional receiver of the progress
+     */
+    RigResult calibrateRig(const std::vector<CameraDataPtr> &cameras,int cols,int rows,float dx,float dy,
+                           const RigSettings &settings = RigSettings(),CalibrationProgress *progress = NULL);
+
+    /**
+     * \brief Saves the intrinsics and poses of all rig cameras as YAML or XML
+     */
+    void saveRig(const std::string &path,const RigResult &result);
+}
+
+#endif
@@ -0,0 +1,86 @@
+#include "RigCalibrationJob.hpp"
+
+#include <QtConcurrentRun>
+#include <stdexcept>
+#include <boost/bind.hpp>
+
+using namespace qcam_calib;
+
+RigCalibrationJob::RigCalibrationJob(QObject *parent):
+    QObject(parent),
+    canceled(0),
+    watcher(NULL)
+{
+    watcher = new QFutureWatcher<RigResult>(this);
+    connect(watcher,SIGNAL(finished()),SIGNAL(finished()));
+}
+
+RigCalibrationJob::~RigCalibrationJob()
+{
+    cancel();
+    watcher->waitForFinished();
+}
+
+RigResult RigCalibrationJob::run(RigCalibrationJob *job,DatasetPtr dataset,QList<int> camera_ids,int cols,int rows,float dx,float dy)
+{
+    try
+    {
+        std::vector<CameraDataPtr> cameras;
+        QList<int>::const_iterator iter = camera_ids.begin();
+        for(;iter != camera_ids.end();++iter)
+            cameras.push_back(dataset->getCamera(*iter));
+        return calibrateRig(cameras,cols,rows,dx,dy,job->settings,job);
+    }
+    catch(const std::exception &e)
+    {
+        job->error = e.what();
+    }
+    return RigResult();
+}
+
+void RigCalibrationJob::start(const DatasetPtr &dataset,const QList<int> &camera_ids,int cols,int rows,float dx,float dy)
+{
+    if(isRunning())
+        throw std::runtime_error("RigCalibrationJob: calibration is already running");
+    error.clear();
+    canceled = 0;
+    watcher->setFuture(QtConcurrent::run(boost::bind(RigCalibrationJob::run,this,dataset,camera_ids,cols,rows,dx,dy)));
+}
+
+bool RigCalibrationJob::isRunning()const
+{
+    return watcher->isRunning();
+}
+
+void RigCalibrationJob::setSettings(const RigSettings &settings)
+{
+    if(isRunning())
+        throw std::runtime_error("RigCalibrationJob: cannot change the settings while running");
+    this->settings = settings;
+}
+
+RigSettings RigCalibrationJob::getSettings()const
+{
+    return settings;
+}
+
+RigResult RigCalibrationJob::getResult()const
+{
+    return watcher->result();
+}
+
+QString RigCalibrationJob::getError()const
+{
+    return error;
+}
+
+bool RigCalibrationJob::step(int iteration,double error,double elapsed)
+{
+    emit progress(iteration,error,elapsed);
+    return canceled == 0;
+}
+
+void RigCalibrationJob::cancel()
+{
+    canceled = 1;
+}
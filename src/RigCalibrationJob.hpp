@@ -0,0 +1,79 @@
+#ifndef QCAMCALIB_RIG_CALIBRATION_JOB_HPP
+#define QCAMCALIB_RIG_CALIBRATION_JOB_HPP
+
+#include <QObject>
+#include <QFutureWatcher>
+#include <QAtomicInt>
+#include <QString>
+#include <QList>
+
+#include "RigCalibration.hpp"
+#include "Dataset.hpp"
+
+namespace qcam_calib
+{
+    /**
+     * \brief Runs a rig calibration in the background
+     *
+     * Like CalibrationJob the job works on snapshots of the cameras taken
+     * from the Dataset. The rig result is not stored in the Dataset, it is
+     * only returned by getResult.
+     */
+    class RigCalibrationJob : public QObject, public CalibrationProgress
+    {
+        Q_OBJECT
+        public:
+            RigCalibrationJob(QObject *parent = 0);
+            virtual ~RigCalibrationJob();
+
+            /**
+             * \brief Starts the rig calibration
+             *
+             * \param[in] dataset The dataset holding the calibrated cameras
+             * \param[in] camera_ids The cameras of the rig, the first one is the reference
+             * \param[in] cols The number of inner chessboard corners per row
+             * \param[in] rows The number of inner chessboard corners per column
+             * \param[in] dx The width of a chessboard cell
+             * \param[in] dy The height of a chessboard cell
+             */
+            void start(const DatasetPtr &dataset,const QList<int> &camera_ids,int cols,int rows,float dx,float dy);
+            bool isRunning()const;
+
+            /**
+             * \brief Sets the matching and solver parameters used by the next calibrations
+             */
+            void setSettings(const RigSettings &settings);
+            RigSettings getSettings()const;
+
+            /**
+             * \brief Returns the result of the last rig calibration
+             */
+            RigResult getResult()const;
+
+            /**
+             * \brief Returns the error message if the last rig calibration failed
+             */
+            QString getError()const;
+
+            // CalibrationProgress interface, called from the worker thread
+            virtual bool step(int iteration,double error,double elapsed);
+
+        public slots:
+            void cancel();
+
+        signals:
+            void progress(int iteration,double error,double elapsed);
+            void finished();
+
+        private:
+            static RigResult run(RigCalibrationJob *job,DatasetPtr dataset,QList<int> camera_ids,int cols,int rows,float dx,float dy);
+
+        private:
+            RigSettings settings;
+            QString error;
+            QAtomicInt canceled;
+            QFutureWatcher<RigResult> *watcher;
+    };
+}
+
+#endif
@@ -0,0 +1,293 @@
+#include "SparseCalibration.hpp"
+#include "Profiler.hpp"
+
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <stdexcept>
+#include <QTime>
+#include <QList>
+#include <QtConcurrentMap>
+#include <boost/bind.hpp>
+
+using namespace qcam_calib;
+
+typedef cv::Matx<double,6,6> Matx66;
+typedef cv::Vec<double,6> Vec6;
+
+struct SparseParameters
+{
+    DistortionModel distortion;
+    std::vector<double> intrinsics;     // fx, fy, cx, cy and the distortion coefficients
+    std::vector<Vec6> poses;            // rvec and tvec of each view
+};
+
+// normal equations of a single view, the number of intrinsics depends on the distortion model
+struct ViewSystem
+{
+    ViewSystem():cost(0){};
+
+    cv::Mat U;                          // intrinsics x intrinsics
+    cv::Mat W;                          // intrinsics x pose
+    Matx66 V;                           // pose x pose
+    cv::Mat gc;                         // gradient of the intrinsics
+    Vec6 gv;                            // gradient of the pose
+    double cost;
+};
+
+// contribution of a single view to the reduced system of the intrinsics
+struct ViewSchur
+{
+    Matx66 V_inv;                       // inverse of the damped pose block
+    cv::Mat WV_inv;
+};
+
+static void splitPose(const Vec6 &pose,cv::Mat &rvec,cv::Mat &tvec)
+{
+    rvec = (cv::Mat_<double>(3,1) << pose[0],pose[1],pose[2]);
+    tvec = (cv::Mat_<double>(3,1) << pose[3],pose[4],pose[5]);
+}
+
+// differences between the projected and the detected corners as 2Nx1 CV_64FC1
+static cv::Mat computeResiduals(const CalibrationData *data,const SparseParameters *parameters,int view,cv::Mat *jacobian)
+{
+    cv::Mat rvec,tvec;
+    splitPose(parameters->poses[view],rvec,tvec);
+    std::vector<cv::Point2f> projected;
+    const CameraModel model(parameters->distortion,parameters->intrinsics);
+    model.project(data->object_points,rvec,tvec,projected,jacobian);
+    const int rows = 2*projected.size();
+    cv::Mat residuals;
+    cv::subtract(cv::Mat(projected).reshape(1,rows),data->getImagePoints(view).reshape(1,rows),residuals,cv::Mat(),CV_64F);
+    return residuals;
+}
+
+static double viewCost(const CalibrationData *data,const SparseParameters *parameters,int view)
+{
+    const cv::Mat residuals = computeResiduals(data,parameters,view,NULL);
+    return residuals.dot(residuals);
+}
+
+static ViewSystem linearizeView(const CalibrationData *data,const SparseParameters *parameters,int view)
+{
+    // the jacobian columns are rvec, tvec, fx, fy, cx, cy and the distortion coefficients
+    cv::Mat jacobian;
+    const cv::Mat residuals = computeResiduals(data,parameters,view,&jacobian);
+    const cv::Mat Jp = jacobian.colRange(0,6);
+    const cv::Mat Jc = jacobian.colRange(6,jacobian.cols);
+
+    ViewSystem system;
+    cv::Mat V(6,6,CV_64FC1,system.V.val);
+    cv::Mat gv(6,1,CV_64FC1,system.gv.val);
+    cv::gemm(Jc,Jc,1,cv::Mat(),0,system.U,cv::GEMM_1_T);
+    cv::gemm(Jc,Jp,1,cv::Mat(),0,system.W,cv::GEMM_1_T);
+    cv::gemm(Jp,Jp,1,cv::Mat(),0,V,cv::GEMM_1_T);
+    cv::gemm(Jc,residuals,1,cv::Mat(),0,system.gc,cv::GEMM_1_T);
+    cv::gemm(Jp,residuals,1,cv::Mat(),0,gv,cv::GEMM_1_T);
+    system.cost = residuals.dot(residuals);
+    return system;
+}
+
+static ViewSchur eliminateView(const std::vector<ViewSystem> *systems,double lambda,int view)
+{
+    const ViewSystem &system = (*systems)[view];
+    Matx66 V = system.V;
+    for(int i=0;i < 6;++i)
+        V(i,i) += lambda*V(i,i);
+
+    ViewSchur schur;
+    cv::Mat V_inv(6,6,CV_64FC1,schur.V_inv.val);
+    if(!cv::invert(cv::Mat(V),V_inv,cv::DECOMP_CHOLESKY))
+        cv::invert(cv::Mat(V),V_inv,cv::DECOMP_SVD);
+    schur.WV_inv = system.W*cv::Mat(schur.V_inv);
+    return schur;
+}
+
+static Vec6 initialPose(const CalibrationData *data,const CameraModel *model,int view)
+{
+    cv::Mat rvec,tvec;
+    model->solvePose(data->object_points,data->getImagePoints(view),rvec,tvec);
+    return Vec6(rvec.at<double>(0),rvec.at<double>(1),rvec.at<double>(2),
+                tvec.at<double>(0),tvec.at<double>(1),tvec.at<double>(2));
+}
+
+static std::vector<ViewSystem> linearize(const CalibrationData &data,const SparseParameters &parameters,const QList<int> &views)
+{
+    ScopedProfile profile("sparse linearization");
+    QList<ViewSystem> list = QtConcurrent::blockingMapped<QList<ViewSystem> >(views,boost::bind(linearizeView,&data,&parameters,_1));
+    return std::vector<ViewSystem>(list.begin(),list.end());
+}
+
+CalibrationResult qcam_calib::calibrateCameraSparse(const CalibrationData &data,CalibrationProgress *progress,int max_iterations,
+                                                    const CalibrationResult *initial)
+{
+    if(data.getViewCount() < 1)
+        throw std::runtime_error("not enough detected chessboards");
+
+    QTime timer;
+    timer.start();
+
+    CalibrationResult result;
+    result.image_ids = data.image_ids;
+    result.image_size = data.image_size;
+    const int points = data.getViewCount()*data.object_points.rows;
+    QList<int> views;
+    for(int i=0;i < data.getViewCount();++i)
+        views << i;
+
+    // intrinsics from the previous result or from the board homographies like cv::calibrateCamera
+    cv::Mat camera_matrix,dist_coeffs;
+    if(initial)
+    {
+        initial->camera_matrix.convertTo(camera_matrix,CV_64F);
+        initial->dist_coeffs.convertTo(dist_coeffs,CV_64F);
+        result.warm_started = true;
+    }
+    else
+    {
+        ScopedProfile profile("sparse initialization");
+        camera_matrix = cv::initCameraMatrix2D(data.getObjectPointViews(),data.getImagePointViews(),data.image_size,0);
+        dist_coeffs = cv::Mat::zeros(getDistortionCoeffCount(data.distortion),1,CV_64FC1);
+    }
+    const CameraModel initial_model(data.distortion,camera_matrix,dist_coeffs);
+    SparseParameters parameters;
+    parameters.distortion = data.distortion;
+    parameters.intrinsics.push_back(camera_matrix.at<double>(0,0));
+    parameters.intrinsics.push_back(camera_matrix.at<double>(1,1));
+    parameters.intrinsics.push_back(camera_matrix.at<double>(0,2));
+    parameters.intrinsics.push_back(camera_matrix.at<double>(1,2));
+    const cv::Mat coeffs = initial_model.getDistCoeffs();
+    parameters.intrinsics.insert(parameters.intrinsics.end(),coeffs.ptr<double>(),coeffs.ptr<double>()+coeffs.total());
+    {
+        // only views which are not part of the previous result need a pose estimation
+        ScopedProfile profile("sparse initialization");
+        std::map<int,int> known_views;
+        if(initial)
+        {
+            for(size_t i=0;i < initial->image_ids.size() && i < initial->rvecs.size() && i < initial->tvecs.size();++i)
+                known_views[initial->image_ids[i]] = i;
+        }
+        QList<int> new_views;
+        parameters.poses.resize(views.size());
+        for(int i=0;i < views.size();++i)
+        {
+            std::map<int,int>::const_iterator iter = known_views.find(data.image_ids[i]);
+            if(iter == known_views.end())
+            {
+                new_views << i;
+                continue;
+            }
+            cv::Mat rvec,tvec;
+            initial->rvecs[iter->second].convertTo(rvec,CV_64F);
+            initial->tvecs[iter->second].convertTo(tvec,CV_64F);
+            parameters.poses[i] = Vec6(rvec.at<double>(0),rvec.at<double>(1),rvec.at<double>(2),
+                                       tvec.at<double>(0),tvec.at<double>(1),tvec.at<double>(2));
+        }
+        QList<Vec6> poses = QtConcurrent::blockingMapped<QList<Vec6> >(new_views,boost::bind(initialPose,&data,&initial_model,_1));
+        for(int i=0;i < new_views.size();++i)
+            parameters.poses[new_views[i]] = poses[i];
+    }
+    const int size = parameters.intrinsics.size();
+
+    std::vector<ViewSystem> systems = linearize(data,parameters,views);
+    double cost = 0;
+    for(size_t i=0;i < systems.size();++i)
+        cost += systems[i].cost;
+
+    double lambda = 1e-3;
+    for(result.iterations=0;result.iterations < max_iterations;)
+    {
+        ++result.iterations;
+
+        // the intrinsic block does not depend on the damping
+        cv::Mat U = cv::Mat::zeros(size,size,CV_64FC1);
+        cv::Mat gc = cv::Mat::zeros(size,1,CV_64FC1);
+        for(size_t i=0;i < systems.size();++i)
+        {
+            U += systems[i].U;
+            gc += systems[i].gc;
+        }
+
+        bool improved = false;
+        double new_cost = cost;
+        for(int attempt=0;attempt < 10 && !improved;++attempt)
+        {
+            // reduced system of the intrinsics
+            std::vector<ViewSchur> schurs;
+            {
+                ScopedProfile profile("sparse schur complement");
+                QList<ViewSchur> list = QtConcurrent::blockingMapped<QList<ViewSchur> >(views,boost::bind(eliminateView,&systems,lambda,_1));
+                schurs.assign(list.begin(),list.end());
+            }
+            cv::Mat S = U.clone();
+            for(int i=0;i < size;++i)
+                S.at<double>(i,i) += lambda*U.at<double>(i,i);
+            cv::Mat rhs = -gc;
+            for(size_t i=0;i < systems.size();++i)
+            {
+                cv::gemm(schurs[i].WV_inv,systems[i].W,-1,S,1,S,cv::GEMM_2_T);
+                rhs += schurs[i].WV_inv*cv::Mat(systems[i].gv);
+            }
+            cv::Mat delta;
+            if(!cv::solve(S,rhs,delta,cv::DECOMP_CHOLESKY))
+            {
+                lambda *= 10;
+                continue;
+            }
+
+            // back substitution of the board poses
+            SparseParameters candidate = parameters;
+            for(int i=0;i < size;++i)
+                candidate.intrinsics[i] += delta.at<double>(i);
+            for(size_t i=0;i < systems.size();++i)
+            {
+                const cv::Mat g = cv::Mat(systems[i].gv)+systems[i].W.t()*delta;
+                candidate.poses[i] -= schurs[i].V_inv*Vec6(g.ptr<double>());
+            }
+
+            {
+                ScopedProfile profile("sparse cost");
+                QList<double> costs = QtConcurrent::blockingMapped<QList<double> >(views,boost::bind(viewCost,&data,&candidate,_1));
+                new_cost = 0;
+                for(int i=0;i < costs.size();++i)
+                    new_cost += costs[i];
+            }
+            if(new_cost < cost)
+            {
+                parameters = candidate;
+                improved = true;
+                lambda = std::max(lambda*0.1,1e-12);
+            }
+            else
+                lambda *= 10;
+        }
+        const double decrease = cost-new_cost;
+        if(improved)
+            cost = new_cost;
+        if(progress && !progress->step(result.iterations,std::sqrt(cost/points),timer.elapsed()*0.001))
+        {
+            result.canceled = true;
+            break;
+        }
+        // the solver converged if a step does not improve the error any more
+        if(!improved || decrease <= 1e-9*cost)
+            break;
+        systems = linearize(data,parameters,views);
+    }
+
+    const CameraModel model(parameters.distortion,parameters.intrinsics);
+    result.distortion = parameters.distortion;
+    result.camera_matrix = model.getCameraMatrix();
+    result.dist_coeffs = model.getDistCoeffs();
+    for(size_t i=0;i < parameters.poses.size();++i)
+    {
+        cv::Mat rvec,tvec;
+        splitPose(parameters.poses[i],rvec,tvec);
+        result.rvecs.push_back(rvec);
+        result.tvecs.push_back(tvec);
+    }
+    result.error = std::sqrt(cost/points);
+    return result;
+}
@@ -0,0 +1,33 @@
+#ifndef QCAMCALIB_SPARSE_CALIBRATION_HPP
+#define QCAMCALIB_SPARSE_CALIBRATION_HPP
+
+#include "Calibration.hpp"
+
+namespace qcam_calib
+{
+    /**
+     * \brief Calibrates a pinhole camera with a sparse Levenberg-Marquardt solver
+     *
+     * Estimates fx, fy, cx, cy, the coefficients of data.distortion and one
+     * board pose per view. The normal equations are block sparse: each board
+     * pose only couples with itself and the intrinsics. The pose blocks are
+     * eliminated with the Schur complement, so each iteration solves a system
+     * of the size of the intrinsics (8 to 16) and its cost grows linearly
+     * with the number of views. The per view jacobians and Schur blocks are
+     * evaluated in parallel with the kernels of CameraModel, which is why
+     * this solver supports all distortion models independent of the OpenCV
+     * version.
+     *
+     * The solver reports its progress after each iteration.
+     *
+     * \param[in] data The detected chessboards
+     * \param[in] progress Optional receiver of the progress
+     * \param[in] max_iterations The maximal number of iterations
+     * \param[in] initial Optional previous result for the same image size used as initial guess,
+     *                    the board poses are only estimated for views it does not contain
+     */
+    CalibrationResult calibrateCameraSparse(const CalibrationData &data,CalibrationProgress *progress = NULL,int max_iterations = 30,
+                                            const CalibrationResult *initial = NULL);
+}
+
+#endif
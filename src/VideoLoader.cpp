@@ -0,0 +1,308 @@
+#include "VideoLoader.hpp"
+#include "ImageBuffer.hpp"
+#include "ChessboardTracker.hpp"
+#include "Profiler.hpp"
+
+#include <opencv2/core/version.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#if CV_MAJOR_VERSION >= 3
+#include <opencv2/videoio/videoio.hpp>
+static const int PROP_FRAME_COUNT = cv::CAP_PROP_FRAME_COUNT;
+#else
+#include <opencv2/highgui/highgui.hpp>
+static const int PROP_FRAME_COUNT = CV_CAP_PROP_FRAME_COUNT;
+#endif
+
+#include <QFileInfo>
+#include <QList>
+#include <QMetaType>
+#include <QMutexLocker>
+#include <QThread>
+#include <QtConcurrentRun>
+#include <stdexcept>
+#include <algorithm>
+
+using namespace qcam_calib;
+
+// width of the gray image the frame metrics are computed on
+static const int METRIC_WIDTH = 320;
+
+// progress is reported every n frames to not flood the event loop
+static const int PROGRESS_INTERVAL = 10;
+
+FrameDecimation::FrameDecimation():
+    min_motion(3.0),
+    min_sharpness(20.0),
+    max_frames(200),
+    tracking(false)
+{
+}
+
+VideoStatistics::VideoStatistics():
+    frames(0),
+    duplicates(0),
+    blurry(0),
+    candidates(0),
+    chessboards(0),
+    tracked(0),
+    unsupported(0)
+{
+}
+
+struct VideoFrame
+{
+    int index;
+    QImage image;
+    QVector<QPointF> chessboard;
+};
+
+// converts decoded frames to 8 bit gray or BGR, returns false for other channel counts
+static bool normalizeFrame(cv::Mat &frame)
+{
+    if(frame.depth() != CV_8U)
+    {
+        double scale = 1.0;
+        if(frame.depth() == CV_16U)
+            scale = 1.0/256;
+        else if(frame.depth() == CV_32F || frame.depth() == CV_64F)
+            scale = 255.0;
+        cv::Mat converted;
+        frame.convertTo(converted,CV_8U,scale);
+        frame = converted;
+    }
+    if(frame.channels() == 4)
+    {
+        cv::Mat converted;
+        cv::cvtColor(frame,converted,cv::COLOR_BGRA2BGR);
+        frame = converted;
+    }
+    return frame.channels() == 1 || frame.channels() == 3;
+}
+
+static VideoFrame detectFrame(VideoFrame frame,int cols,int rows,DetectorSettings detector)
+{
+    frame.chessboard = ImageItem::findChessboard(frame.image,cols,rows,detector);
+    if(frame.chessboard.empty())
+        frame.image = QImage();
+    return frame;
+}
+
+VideoLoader::VideoLoader(QObject *parent):
+    QObject(parent),
+    max_in_flight(0),
+    canceled(0),
+    watcher(NULL)
+{
+    // frames are reported from the worker thread
+    qRegisterMetaType<QVector<QPointF> >("QVector<QPointF>");
+    setMaxInFlight(0);
+    watcher = new QFutureWatcher<void>(this);
+    connect(watcher,SIGNAL(finished()),SIGNAL(finished()));
+}
+
+VideoLoader::~VideoLoader()
+{
+    cancel();
+    watcher->waitForFinished();
+}
+
+void VideoLoader::setDecimation(const FrameDecimation &decimation)
+{
+    if(isRunning())
+        throw std::runtime_error("VideoLoader: cannot change the decimation while running");
+    this->decimation = decimation;
+}
+
+FrameDecimation VideoLoader::getDecimation()const
+{
+    return decimation;
+}
+
+void VideoLoader::setMaxInFlight(int count)
+{
+    if(isRunning())
+        throw std::runtime_error("VideoLoader: cannot change the window while running");
+    if(count < 1)
+        count = QThread::idealThreadCount();
+    max_in_flight = count < 1 ? 1 : count;
+}
+
+int VideoLoader::getMaxInFlight()const
+{
+    return max_in_flight;
+}
+
+bool VideoLoader::isRunning()const
+{
+    return watcher && watcher->isRunning();
+}
+
+void VideoLoader::start(const QString &path,int cols,int rows,const DetectorSettings &detector)
+{
+    if(isRunning())
+        throw std::runtime_error("VideoLoader: loading is already in progress");
+    {
+        QMutexLocker locker(&mutex);
+        statistics = VideoStatistics();
+        error.clear();
+    }
+    canceled = 0;
+    emit progressRangeChanged(0,0);
+    emit progressValueChanged(0);
+    watcher->setFuture(QtConcurrent::run(VideoLoader::run,this,path,cols,rows,detector));
+}
+
+VideoStatistics VideoLoader::getStatistics()const
+{
+    QMutexLocker locker(&mutex);
+    return statistics;
+}
+
+QString VideoLoader::getError()const
+{
+    QMutexLocker locker(&mutex);
+    return error;
+}
+
+void VideoLoader::cancel()
+{
+    canceled = 1;
+}
+
+void VideoLoader::run(VideoLoader *loader,QString path,int cols,int rows,DetectorSettings detector)
+{
+    Profiler::setCurrentItem(path);
+    cv::VideoCapture capture;
+    if(!capture.open(path.toStdString()))
+    {
+        QMutexLocker locker(&loader->mutex);
+        loader->error = QString("cannot open video %1").arg(path);
+        return;
+    }
+    const int frame_count = (int)capture.get(PROP_FRAME_COUNT);
+    if(frame_count > 0)
+        emit loader->progressRangeChanged(0,frame_count);
+
+    const FrameDecimation &decimation = loader->decimation;
+    const QString base_name = QFileInfo(path).completeBaseName();
+    VideoStatistics statistics;
+    ChessboardTracker tracker(cols,rows,detector);
+    cv::Mat frame,small,gray,last_candidate,laplacian;
+    QList<QFuture<VideoFrame> > jobs;
+    bool end_of_video = false;
+    for(int index=0;;++index)
+    {
+        // hand over finished frames in order, wait if the window is full or the video ended
+        while(!jobs.empty() && (end_of_video || jobs.front().isFinished() || jobs.size() >= loader->max_in_flight))
+        {
+            VideoFrame result = jobs.front().result();
+            jobs.pop_front();
+            if(loader->canceled != 0 || result.chessboard.empty() ||
+               (decimation.max_frames > 0 && statistics.chessboards >= decimation.max_frames))
+                continue;
+            ++statistics.chessboards;
+            emit loader->frameLoaded(QString("%1_%2").arg(base_name).arg(result.index,6,10,QChar('0')),
+                                     result.image,result.chessboard);
+        }
+        if(end_of_video)
+            break;
+        if(loader->canceled != 0 || (decimation.max_frames > 0 && statistics.chessboards >= decimation.max_frames))
+        {
+            end_of_video = true;
+            continue;
+        }
+
+        {
+            ScopedProfile profile("video decode");
+            end_of_video = !capture.read(frame) || frame.empty();
+        }
+        if(end_of_video)
+            continue;
+        ++statistics.frames;
+        if(!normalizeFrame(frame))
+        {
+            ++statistics.unsupported;
+            continue;
+        }
+        if(index % PROGRESS_INTERVAL == 0)
+        {
+            emit loader->progressValueChanged(index);
+            QMutexLocker locker(&loader->mutex);
+            loader->statistics = statistics;
+        }
+
+        // cheap metrics on a small gray image
+        {
+            ScopedProfile profile("frame metrics");
+            const double scale = std::min(1.0,double(METRIC_WIDTH)/frame.cols);
+            cv::resize(frame,small,cv::Size(),scale,scale,cv::INTER_AREA);
+            if(small.channels() == 3)
+                cv::cvtColor(small,gray,cv::COLOR_BGR2GRAY);
+            else
+                gray = small.clone();
+        }
+        if(!last_candidate.empty() && last_candidate.size() == gray.size())
+        {
+            cv::Mat diff;
+            cv::absdiff(gray,last_candidate,diff);
+            if(cv::mean(diff)[0] < decimation.min_motion)
+            {
+                ++statistics.duplicates;
+                continue;
+            }
+        }
+        if(decimation.min_sharpness > 0)
+        {
+            cv::Scalar mean,stddev;
+            cv::Laplacian(gray,laplacian,CV_16S);
+            cv::meanStdDev(laplacian,mean,stddev);
+            if(stddev[0]*stddev[0] < decimation.min_sharpness)
+            {
+                ++statistics.blurry;
+                continue;
+            }
+        }
+        gray.copyTo(last_candidate);
+        ++statistics.candidates;
+
+        // only candidate frames are converted and kept until their search is done
+        VideoFrame candidate;
+        candidate.index = index;
+        {
+            ScopedProfile profile("frame conversion");
+            if(frame.type() == CV_8UC3)
+            {
+                ImageBuffer buffer(frame.cols,frame.rows,CV_8UC3);
+                cv::cvtColor(frame,buffer.getMat(),cv::COLOR_BGR2RGB);
+                candidate.image = buffer.getImage();
+            }
+            else
+            {
+                ImageBuffer buffer(frame.cols,frame.rows,CV_8UC1);
+                frame.copyTo(buffer.getMat());
+                candidate.image = buffer.getImage();
+            }
+            profile.addAllocation(candidate.image.byteCount());
+        }
+
+        // tracked frames are handled in order here, so they never overtake searched ones
+        if(decimation.tracking)
+        {
+            candidate.chessboard = tracker.track(candidate.image);
+            const TrackingStatistics tracking = tracker.getStatistics();
+            statistics.tracked = tracking.tracked+tracking.roi;
+            if(candidate.chessboard.empty())
+                continue;
+            ++statistics.chessboards;
+            emit loader->frameLoaded(QString("%1_%2").arg(base_name).arg(candidate.index,6,10,QChar('0')),
+                                     candidate.image,candidate.chessboard);
+            continue;
+        }
+        jobs.push_back(QtConcurrent::run(detectFrame,candidate,cols,rows,detector));
+    }
+
+    if(frame_count > 0)
+        emit loader->progressValueChanged(frame_count);
+    QMutexLocker locker(&loader->mutex);
+    loader->statistics = statistics;
+}
@@ -0,0 +1,118 @@
+#ifndef QCAMCALIB_VIDEO_LOADER_HPP
+#define QCAMCALIB_VIDEO_LOADER_HPP
+
+#include <QObject>
+#include <QImage>
+#include <QVector>
+#include <QPointF>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QFutureWatcher>
+
+#include "Items.hpp"
+
+namespace qcam_calib
+{
+    /**
+     * \brief Decides which frames of a video are searched for chessboards
+     *
+     * Both metrics are computed on a downscaled gray copy of the frame, which
+     * is much cheaper than the chessboard search.
+     */
+    struct FrameDecimation
+    {
+        FrameDecimation();
+
+        double min_motion;      // mean absolute gray value difference to the last candidate frame
+        double min_sharpness;   // variance of the Laplacian, 0 disables the blur check
+        int max_frames;         // maximal number of frames with chessboard, 0 for no limit (each one is kept decoded in memory)
+        bool tracking;          // follow the board from candidate to candidate instead of searching each one in parallel
+    };
+
+    /**
+     * \brief Counts how many frames were dropped by which stage
+     */
+    struct VideoStatistics
+    {
+        VideoStatistics();
+
+        int frames;             // decoded frames
+        int duplicates;         // skipped because of too little motion
+        int blurry;             // skipped because of motion blur
+        int candidates;         // searched for a chessboard
+        int chessboards;        // frames with chessboard which were reported
+        int tracked;            // chessboards found from the last board without a full frame search
+        int unsupported;        // skipped because the pixel format cannot be converted
+    };
+
+    /**
+     * \brief Streams the frames of a video file and detects chessboards in them
+     *
+     * The video is decoded sequentially on a worker thread. Near duplicate
+     * and blurry frames are skipped before any chessboard search. The remaining
+     * candidate frames are searched in parallel with at most maxInFlight
+     * frames in memory at a time. Only frames with a chessboard are reported
+     * by frameLoaded, in the order of the video, so the video never has to be
+     * extracted to disk.
+     *
+     * With FrameDecimation::tracking the candidates are instead given in order
+     * to a ChessboardTracker on the decoding thread, which is much faster for
+     * high resolution videos where the board moves little between candidates.
+     */
+    class VideoLoader : public QObject
+    {
+        Q_OBJECT
+        public:
+            VideoLoader(QObject *parent = 0);
+            virtual ~VideoLoader();
+
+            void setDecimation(const FrameDecimation &decimation);
+            FrameDecimation getDecimation()const;
+
+            /**
+             * \brief Sets the maximal number of frames which are searched at the same time
+             *
+             * \param[in] count The window size. Values smaller than 1 select the ideal thread count.
+             */
+            void setMaxInFlight(int count);
+            int getMaxInFlight()const;
+
+            bool isRunning()const;
+
+            /**
+             * \brief Starts loading the given video in the background
+             */
+            void start(const QString &path,int cols,int rows,const DetectorSettings &detector=DetectorSettings());
+
+            VideoStatistics getStatistics()const;
+
+            /**
+             * \brief Returns the error message if the last video could not be loaded
+             */
+            QString getError()const;
+
+        public slots:
+            void cancel();
+
+        signals:
+            void frameLoaded(const QString &name,const QImage &image,const QVector<QPointF> &chessboard);
+            void progressRangeChanged(int minimum,int maximum);
+            void progressValueChanged(int value);
+            void finished();
+
+        private:
+            static void run(VideoLoader *loader,QString path,int cols,int rows,DetectorSettings detector);
+
+        private:
+            FrameDecimation decimation;
+            int max_in_flight;
+            QAtomicInt canceled;
+            QFutureWatcher<void> *watcher;
+
+            mutable QMutex mutex;       // guards statistics and error
+            VideoStatistics statistics;
+            QString error;
+    };
+}
+
+#endif